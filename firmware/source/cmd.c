@@ -19,6 +19,19 @@
 #include "ams-enc.h"
 #include "carray.h"
 #include "telem.h"
+#include "isr_stats.h"
+#include "sched.h"
+#include "vel_obs.h"
+#include "move_queue.h"
+#include "phase_lock.h"
+#include "steering.h"
+#include "gain_sched.h"
+#include "autotune.h"
+#include "excite.h"
+#include "ilc.h"
+#include "telem_pack.h"
+#include "telem_comp.h"
+#include "telem_stream.h"
 
 #include <stdio.h>
 #include <string.h>
@@ -44,6 +57,8 @@ void cmdError(void);
 static unsigned char cmdNop(unsigned char type, unsigned char status, unsigned char length, unsigned char *frame, unsigned int src_addr);
 static unsigned char cmdWhoAmI(unsigned char type, unsigned char status, unsigned char length, unsigned char *frame, unsigned int src_addr);
 static unsigned char cmdGetAMSPos(unsigned char type, unsigned char status, unsigned char length, unsigned char *frame, unsigned int src_addr);
+static unsigned char cmdGetIsrStats(unsigned char type, unsigned char status, unsigned char length, unsigned char *frame, unsigned int src_addr);
+static unsigned char cmdBenchPID(unsigned char type, unsigned char status, unsigned char length, unsigned char *frame, unsigned int src_addr);
 
 //Motor and PID functions
 static unsigned char cmdSetThrustOpenLoop(unsigned char type, unsigned char status, unsigned char length, unsigned char *frame, unsigned int src_addr);
@@ -52,14 +67,34 @@ static unsigned char cmdSetPIDGains(unsigned char type, unsigned char status, un
 static unsigned char cmdPIDStartMotors(unsigned char type, unsigned char status, unsigned char length, unsigned char *frame, unsigned int src_addr);
 static unsigned char cmdPIDStopMotors(unsigned char type, unsigned char status, unsigned char length, unsigned char *frame, unsigned int src_addr);
 static unsigned char cmdSetVelProfile(unsigned char type, unsigned char status, unsigned char length, unsigned char *frame, unsigned int src_addr);
+static unsigned char cmdSetGaitTable(unsigned char type, unsigned char status, unsigned char length, unsigned char *frame, unsigned int src_addr);
+static unsigned char cmdSetMoveQueue(unsigned char type, unsigned char status, unsigned char length, unsigned char *frame, unsigned int src_addr);
 static unsigned char cmdZeroPos(unsigned char type, unsigned char status, unsigned char length, unsigned char *frame, unsigned int src_addr);
 static unsigned char cmdSetPhase(unsigned char type, unsigned char status, unsigned char length, unsigned char *frame, unsigned int src_addr);
+static unsigned char cmdSetPhaseLock(unsigned char type, unsigned char status, unsigned char length, unsigned char *frame, unsigned int src_addr);
+static unsigned char cmdSetSteeringGains(unsigned char type, unsigned char status, unsigned char length, unsigned char *frame, unsigned int src_addr);
+static unsigned char cmdSetYawRate(unsigned char type, unsigned char status, unsigned char length, unsigned char *frame, unsigned int src_addr);
+static unsigned char cmdSetOutputLimits(unsigned char type, unsigned char status, unsigned char length, unsigned char *frame, unsigned int src_addr);
+static unsigned char cmdSetGainTable(unsigned char type, unsigned char status, unsigned char length, unsigned char *frame, unsigned int src_addr);
+static unsigned char cmdSetBattComp(unsigned char type, unsigned char status, unsigned char length, unsigned char *frame, unsigned int src_addr);
+static unsigned char cmdAutotune(unsigned char type, unsigned char status, unsigned char length, unsigned char *frame, unsigned int src_addr);
+static unsigned char cmdSetExcitation(unsigned char type, unsigned char status, unsigned char length, unsigned char *frame, unsigned int src_addr);
+static unsigned char cmdSetILC(unsigned char type, unsigned char status, unsigned char length, unsigned char *frame, unsigned int src_addr);
+static unsigned char cmdResetILC(unsigned char type, unsigned char status, unsigned char length, unsigned char *frame, unsigned int src_addr);
+static unsigned char cmdSetLatencyComp(unsigned char type, unsigned char status, unsigned char length, unsigned char *frame, unsigned int src_addr);
+static unsigned char cmdSetVelEstimator(unsigned char type, unsigned char status, unsigned char length, unsigned char *frame, unsigned int src_addr);
 
 //Experiment/Flash Commands
 static unsigned char cmdStartTimedRun(unsigned char type, unsigned char status, unsigned char length, unsigned char *frame, unsigned int src_addr);
 static unsigned char cmdStartTelemetry(unsigned char type, unsigned char status, unsigned char length, unsigned char *frame, unsigned int src_addr);
 static unsigned char cmdEraseSectors(unsigned char type, unsigned char status, unsigned char length, unsigned char *frame, unsigned int src_addr);
 static unsigned char cmdFlashReadback(unsigned char type, unsigned char status, unsigned char length, unsigned char *frame, unsigned int src_addr);
+static unsigned char cmdFlashReadbackPacked(unsigned char type, unsigned char status, unsigned char length, unsigned char *frame, unsigned int src_addr);
+static unsigned char cmdFlashReadbackRanges(unsigned char type, unsigned char status, unsigned char length, unsigned char *frame, unsigned int src_addr);
+static unsigned char cmdFlashReadbackComp(unsigned char type, unsigned char status, unsigned char length, unsigned char *frame, unsigned int src_addr);
+static unsigned char cmdSetTelemComp(unsigned char type, unsigned char status, unsigned char length, unsigned char *frame, unsigned int src_addr);
+static unsigned char cmdSetTelemFields(unsigned char type, unsigned char status, unsigned char length, unsigned char *frame, unsigned int src_addr);
+static unsigned char cmdTelemStream(unsigned char type, unsigned char status, unsigned char length, unsigned char *frame, unsigned int src_addr);
 /*-----------------------------------------------------------------------------
  *          Public functions
 -----------------------------------------------------------------------------*/
@@ -76,16 +111,38 @@ void cmdSetup(void) {
 
     cmd_func[CMD_SET_THRUST_OPEN_LOOP] = &cmdSetThrustOpenLoop;
     cmd_func[CMD_SET_MOTOR_MODE] = &cmdSetMotorMode;
+    cmd_func[CMD_GET_ISR_STATS] = &cmdGetIsrStats;
+    cmd_func[CMD_BENCH_PID] = &cmdBenchPID;
     cmd_func[CMD_PID_START_MOTORS] = &cmdPIDStartMotors;
     cmd_func[CMD_SET_PID_GAINS] = &cmdSetPIDGains;
     cmd_func[CMD_GET_AMS_POS] = &cmdGetAMSPos;
     cmd_func[CMD_START_TELEMETRY] = &cmdStartTelemetry;
     cmd_func[CMD_ERASE_SECTORS] = &cmdEraseSectors;
     cmd_func[CMD_FLASH_READBACK] = &cmdFlashReadback;
+    cmd_func[CMD_FLASH_READBACK_PACKED] = &cmdFlashReadbackPacked;
+    cmd_func[CMD_FLASH_READBACK_RANGES] = &cmdFlashReadbackRanges;
+    cmd_func[CMD_FLASH_READBACK_COMP] = &cmdFlashReadbackComp;
+    cmd_func[CMD_SET_TELEM_COMP] = &cmdSetTelemComp;
+    cmd_func[CMD_SET_TELEM_FIELDS] = &cmdSetTelemFields;
+    cmd_func[CMD_TELEM_STREAM] = &cmdTelemStream;
     cmd_func[CMD_SET_VEL_PROFILE] = &cmdSetVelProfile;
+    cmd_func[CMD_SET_GAIT_TABLE] = &cmdSetGaitTable;
+    cmd_func[CMD_SET_MOVE_QUEUE] = &cmdSetMoveQueue;
     cmd_func[CMD_WHO_AM_I] = &cmdWhoAmI;
     cmd_func[CMD_ZERO_POS] = &cmdZeroPos;   
     cmd_func[CMD_SET_PHASE] = &cmdSetPhase;   
+    cmd_func[CMD_SET_PHASE_LOCK] = &cmdSetPhaseLock;
+    cmd_func[CMD_SET_STEERING_GAINS] = &cmdSetSteeringGains;
+    cmd_func[CMD_SET_YAW_RATE] = &cmdSetYawRate;
+    cmd_func[CMD_SET_OUTPUT_LIMITS] = &cmdSetOutputLimits;
+    cmd_func[CMD_SET_GAIN_TABLE] = &cmdSetGainTable;
+    cmd_func[CMD_SET_BATT_COMP] = &cmdSetBattComp;
+    cmd_func[CMD_AUTOTUNE] = &cmdAutotune;
+    cmd_func[CMD_SET_EXCITATION] = &cmdSetExcitation;
+    cmd_func[CMD_SET_ILC] = &cmdSetILC;
+    cmd_func[CMD_RESET_ILC] = &cmdResetILC;
+    cmd_func[CMD_SET_LATENCY_COMP] = &cmdSetLatencyComp;
+    cmd_func[CMD_SET_VEL_ESTIMATOR] = &cmdSetVelEstimator;
     cmd_func[CMD_START_TIMED_RUN] = &cmdStartTimedRun;
     cmd_func[CMD_PID_STOP_MOTORS] = &cmdPIDStopMotors;
 
@@ -164,6 +221,40 @@ unsigned char cmdGetAMSPos(unsigned char type, unsigned char status,
 
     return 1;
 }
+// Send Timer1 ISR timing statistics, one packet per scheduled task and one
+// for the state read, then reset them. The unused slots are not sent
+unsigned char cmdGetIsrStats(unsigned char type, unsigned char status,
+        unsigned char length, unsigned char *frame, unsigned int src_addr) {
+    isrStatsReport_t reports[ISR_STATS_NUM];
+    unsigned int i;
+
+    isrStatsSnapshot(reports);
+    for (i = 0; i < ISR_STATS_NUM; i++) {
+        if (i < schedNumTasks() || i == ISR_STATS_STATE_READ) {
+            radioSendData(src_addr, status, CMD_GET_ISR_STATS,
+                    sizeof(isrStatsReport_t), (unsigned char *)&(reports[i]), 0);
+        }
+    }
+
+    return 1;
+}
+
+// Time the UpdatePID kernel; replies with {iterations, timebase us}, us
+// being -1 if refused because a PID loop is on.
+unsigned char cmdBenchPID(unsigned char type, unsigned char status,
+        unsigned char length, unsigned char *frame, unsigned int src_addr) {
+    PKT_UNPACK(_args_cmdBenchPID, argsPtr, frame);
+    int32_t result[2];
+
+    result[0] = argsPtr->iterations;
+    result[1] = pidBenchKernel(argsPtr->iterations);
+
+    radioSendData(src_addr, status, CMD_BENCH_PID,
+            sizeof(result), (unsigned char *)result, 0);
+
+    return 1;
+}
+
 // ==== Flash/Experiment Commands ==============================================================================
 // =============================================================================================================
 unsigned char cmdStartTimedRun(unsigned char type, unsigned char status, unsigned char length, unsigned char *frame, unsigned int src_addr){
@@ -171,18 +262,16 @@ unsigned char cmdStartTimedRun(unsigned char type, unsigned char status, unsigne
     PKT_UNPACK(_args_cmdStartTimedRun, argsPtr, frame);
 
     int i;
+    // the end time goes in before the legs see the time flag
+    pidStartTimedTrial(argsPtr->run_time);
     for (i = 0; i < NUM_PIDS; i++){
         pidSetTimeFlag(i,1);
         //pidObjs[i].timeFlag = 1;
         pidSetInput(i, 0);
         checkSwapBuff(i);
         pidOn(i);
+        pidSetMode(i, PID_MODE_CONTROLED);
     }
-    
-    pidSetMode(LEFT_LEGS_PID_NUM ,PID_MODE_CONTROLED);
-    pidSetMode(RIGHT_LEGS_PID_NUM ,PID_MODE_CONTROLED);
-
-    pidStartTimedTrial(argsPtr->run_time);
 
     return 1;
 }
@@ -192,8 +281,8 @@ unsigned char cmdStartTelemetry(unsigned char type, unsigned char status, unsign
     PKT_UNPACK(_args_cmdStartTelemetry, argsPtr, frame);
 
     if (argsPtr->numSamples != 0) {
-        telemSetStartTime(); // Start telemetry samples from approx 0 time
-        telemSetSamplesToSave(argsPtr->numSamples);
+        // Start telemetry samples from approx 0 time
+        telemCompStart(argsPtr->numSamples);
     }
     return 1;
 }
@@ -201,7 +290,7 @@ unsigned char cmdEraseSectors(unsigned char type, unsigned char status, unsigned
     //Unpack unsigned char* frame into structured values
     PKT_UNPACK(_args_cmdEraseSector, argsPtr, frame);
 
-    telemErase(argsPtr->samples);
+    telemCompErase(argsPtr->samples);
 
     //Send confirmation packet; this only happens when flash erase is completed.
     radioSendData(src_addr, 0, CMD_ERASE_SECTORS, length, frame, 0);
@@ -216,6 +305,78 @@ unsigned char cmdFlashReadback(unsigned char type, unsigned char status, unsigne
     return 1;
 }
 
+// Same samples as cmdFlashReadback, streamed across full packets, see telem_pack.h
+unsigned char cmdFlashReadbackPacked(unsigned char type, unsigned char status, unsigned char length, unsigned char *frame, unsigned int src_addr){
+    PKT_UNPACK(_args_cmdFlashReadbackPacked, argsPtr, frame);
+
+    telemPackReadback(argsPtr->start, argsPtr->samples, src_addr);
+    return 1;
+}
+
+// Packed readback of only the samples the host is missing, range by range
+unsigned char cmdFlashReadbackRanges(unsigned char type, unsigned char status, unsigned char length, unsigned char *frame, unsigned int src_addr){
+    PKT_UNPACK(_args_cmdFlashReadbackRanges, argsPtr, frame);
+    unsigned int i;
+
+    for (i = 0; i < length / sizeof (_args_readbackRange) && i < READBACK_CHUNK_RANGES; i++) {
+        telemPackReadback(argsPtr->ranges[i].start, argsPtr->ranges[i].samples, src_addr);
+    }
+    return 1;
+}
+
+// Pages of a compressed log, see telem_comp.h
+unsigned char cmdFlashReadbackComp(unsigned char type, unsigned char status, unsigned char length, unsigned char *frame, unsigned int src_addr){
+    PKT_UNPACK(_args_cmdFlashReadbackComp, argsPtr, frame);
+
+    telemCompReadback(argsPtr->start, argsPtr->pages, src_addr);
+    return 1;
+}
+
+// Replies with the format in use, unchanged while samples are being saved
+unsigned char cmdSetTelemComp(unsigned char type, unsigned char status, unsigned char length, unsigned char *frame, unsigned int src_addr){
+    PKT_UNPACK(_args_cmdSetTelemComp, argsPtr, frame);
+    int16_t enabled;
+
+    telemCompSetEnable(argsPtr->enable);
+    enabled = telemCompEnabled();
+    radioSendData(src_addr, status, CMD_SET_TELEM_COMP, sizeof (enabled), (unsigned char *) &enabled, 0);
+    return 1;
+}
+
+// Replies with the schema in use, unchanged while samples are being saved
+unsigned char cmdSetTelemFields(unsigned char type, unsigned char status, unsigned char length, unsigned char *frame, unsigned int src_addr){
+    PKT_UNPACK(_args_cmdSetTelemFields, argsPtr, frame);
+    unsigned char buf[6 + TELEM_FIELDS_CHUNK * sizeof (vrTelemFieldDesc)];
+    uint32_t mask;
+    unsigned int first = 0, total, n;
+
+    if (argsPtr->mask != 0 && !telemCompBusy()) {
+        vrTelemSetFields(argsPtr->mask);
+    }
+    mask = vrTelemGetFields();
+    total = vrTelemNumFields();
+    do {
+        n = vrTelemDescribe(first, (vrTelemFieldDesc *) (buf + 6), TELEM_FIELDS_CHUNK);
+        memcpy(buf, &mask, sizeof (mask));
+        buf[4] = first;
+        buf[5] = total;
+        radioSendData(src_addr, status, CMD_SET_TELEM_FIELDS,
+                6 + n * sizeof (vrTelemFieldDesc), buf, 0);
+        first += n;
+    } while (first < total);
+    return 1;
+}
+
+// Live telemetry to the sender, alongside any flash logging
+unsigned char cmdTelemStream(unsigned char type, unsigned char status, unsigned char length, unsigned char *frame, unsigned int src_addr){
+    PKT_UNPACK(_args_cmdTelemStream, argsPtr, frame);
+    uint16_t rate;
+
+    rate = telemStreamSet(argsPtr->rate, src_addr);
+    radioSendData(src_addr, status, CMD_TELEM_STREAM, sizeof (rate), (unsigned char *) &rate, 0);
+    return 1;
+}
+
 // ==== Motor PID Commands =====================================================================================
 // =============================================================================================================
 
@@ -258,63 +419,133 @@ unsigned char cmdSetThrustOpenLoop(unsigned char type, unsigned char status, uns
     return 1; //success
 }
 
+unsigned char cmdSetVelEstimator(unsigned char type, unsigned char status, unsigned char length, unsigned char *frame, unsigned int src_addr) {
+    //Unpack unsigned char* frame into structured values
+    PKT_UNPACK(_args_cmdSetVelEstimator, argsPtr, frame);
+
+    velObsSetGains(argsPtr->alpha, argsPtr->beta, argsPtr->gamma);
+    pidSetVelEstimator(argsPtr->mode);
+
+    radioSendData(src_addr, status, CMD_SET_VEL_ESTIMATOR, length, frame, 0);
+
+    return 1; //success
+}
+
 unsigned char cmdSetVelProfile(unsigned char type, unsigned char status, unsigned char length, unsigned char *frame, unsigned int src_addr) {
     
     //Unpack unsigned char* frame into structured values
     PKT_UNPACK(_args_cmdSetVelProfile, argsPtr, frame);
 
-    int interval1[NUM_VELS], vel1[NUM_VELS], delta1[NUM_VELS];
-    int interval2[NUM_VELS], vel2[NUM_VELS], delta2[NUM_VELS];
+    int16_t pos1[NUM_VELS], pos2[NUM_VELS];
+    int stride1 = 0, stride2 = 0;
     int i;
 
+    // deltas between equally spaced setpoints become a NUM_VELS point gait table
     for(i = 0; i < NUM_VELS; i++){
-        delta1[i] = argsPtr->deltaL[i] << 2;
-        delta2[i] = argsPtr->deltaR[i] << 2;
-        //Clipping of deltas to range [-8192, 8191] ?
-
-        // Calculation of intervals is fixed to equally spaced intervals.
-        interval1[i] = argsPtr->periodLeft/NUM_VELS;
-        interval2[i] = argsPtr->periodRight/NUM_VELS;
-
-        vel1[i] = delta1[i] / interval1[i];
-        vel2[i] = delta2[i] / interval2[i];
+        pos1[i] = stride1;
+        pos2[i] = stride2;
+        stride1 += argsPtr->deltaL[i];
+        stride2 += argsPtr->deltaR[i];
     }
 
-    setPIDVelProfile(LEFT_LEGS_PID_NUM, interval1, delta1, vel1, argsPtr->flagLeft);
-    setPIDVelProfile(RIGHT_LEGS_PID_NUM, interval2, delta2, vel2, argsPtr->flagRight);
+    pidLoadGaitTable(LEFT_LEGS_PID_NUM, NUM_VELS, 0, NUM_VELS, pos1,
+            argsPtr->periodLeft, stride1, argsPtr->flagLeft);
+    pidLoadGaitTable(RIGHT_LEGS_PID_NUM, NUM_VELS, 0, NUM_VELS, pos2,
+            argsPtr->periodRight, stride2, argsPtr->flagRight);
 
     //Send confirmation packet
     // TODO : Send confirmation packet with packet index
     return 1; //success
 }
 
+unsigned char cmdSetGaitTable(unsigned char type, unsigned char status, unsigned char length, unsigned char *frame, unsigned int src_addr) {
+    //Unpack unsigned char* frame into structured values
+    PKT_UNPACK(_args_cmdSetGaitTable, argsPtr, frame);
+    int16_t reply[3];
+
+    reply[0] = argsPtr->channel;
+    reply[1] = -1;
+    reply[2] = argsPtr->num_points;
+    if (argsPtr->count >= 0 && argsPtr->count <= GAIT_CHUNK_POINTS) {
+        reply[1] = pidLoadGaitTable(argsPtr->channel, argsPtr->num_points,
+                argsPtr->start, argsPtr->count, argsPtr->points,
+                argsPtr->period, argsPtr->stride, argsPtr->flags);
+    }
+
+    // points loaded so far, so the host can resend from there
+    radioSendData(src_addr, status, CMD_SET_GAIT_TABLE, sizeof (reply), (unsigned char *) reply, 0);
+
+    return 1; //success
+}
+
+unsigned char cmdSetMoveQueue(unsigned char type, unsigned char status, unsigned char length, unsigned char *frame, unsigned int src_addr) {
+    //Unpack unsigned char* frame into structured values
+    PKT_UNPACK(_args_cmdSetMoveQueue, argsPtr, frame);
+    int period[NUM_PIDS];
+    int16_t reply[3];
+    int i, j, queued = 0;
+
+    reply[0] = 0;
+    for (i = 0; i < argsPtr->num_segments && i < MOVE_CHUNK_SEGMENTS; i++) {
+        for (j = 0; j < NUM_PIDS; j++) {
+            period[j] = 0;
+        }
+        period[LEFT_LEGS_PID_NUM] = argsPtr->segments[i].periodLeft;
+        period[RIGHT_LEGS_PID_NUM] = argsPtr->segments[i].periodRight;
+        queued = moveQueueAdd(period, argsPtr->segments[i].phase,
+                argsPtr->segments[i].count, argsPtr->segments[i].flags);
+        if (queued < 0) {
+            break;
+        }
+        reply[0]++;
+    }
+
+    // segments accepted from this packet, queued in total (-1 if full), and
+    // table swaps held back by an upload still arriving since the last reply
+    reply[1] = queued;
+    reply[2] = pidGetSwapsHeld();
+    radioSendData(src_addr, status, CMD_SET_MOVE_QUEUE, sizeof (reply), (unsigned char *) reply, 0);
+
+    return 1; //success
+}
+
 unsigned char cmdPIDStartMotors(unsigned char type, unsigned char status, unsigned char length, unsigned char *frame, unsigned int src_addr) {
 
+    int i;
+
     //All actions have been moved to a PID module function
-    pidStartMotor(LEFT_LEGS_PID_NUM);
-    pidStartMotor(RIGHT_LEGS_PID_NUM);
+    for (i = 0; i < NUM_PIDS; i++) {
+        pidStartMotor(i);
+    }
 
     return 1;
 }
 
 unsigned char cmdPIDStopMotors(unsigned char type, unsigned char status, unsigned char length, unsigned char *frame, unsigned int src_addr) {
 
-    pidOff(LEFT_LEGS_PID_NUM);
-    pidOff(RIGHT_LEGS_PID_NUM);
+    int i;
+
+    autotuneStop();
+    exciteStop();
+    for (i = 0; i < NUM_PIDS; i++) {
+        pidOff(i);
+    }
 
     return 1;
 }
 
 unsigned char cmdZeroPos(unsigned char type, unsigned char status, unsigned char length, unsigned char *frame, unsigned int src_addr) {
     long motor_count[2];
-    motor_count[0] = pidGetPState(0);
-    motor_count[1] = pidGetPState(1);
+    int i;
+    motor_count[0] = pidGetPState(LEFT_LEGS_PID_NUM);
+    motor_count[1] = pidGetPState(RIGHT_LEGS_PID_NUM);
 
     radioSendData(src_addr, status, CMD_ZERO_POS, 
         sizeof(motor_count), (unsigned char *)motor_count, 0);
 
-    pidZeroPos(LEFT_LEGS_PID_NUM);
-    pidZeroPos(RIGHT_LEGS_PID_NUM);
+    for (i = 0; i < NUM_PIDS; i++) {
+        pidZeroPos(i);
+    }
     
     return 1;
 }
@@ -331,10 +562,182 @@ unsigned char cmdSetPhase(unsigned char type, unsigned char status, unsigned cha
 
     pidSetPInput(LEFT_LEGS_PID_NUM, p_state[0] + error/2);
     pidSetPInput(RIGHT_LEGS_PID_NUM, p_state[1] - error/2);
+    phaseLockSetTarget(argsPtr->offset); // and hold it, if the lock is on
 
     return 1;
 }
 
+unsigned char cmdSetPhaseLock(unsigned char type, unsigned char status, unsigned char length, unsigned char *frame, unsigned int src_addr) {
+    //Unpack unsigned char* frame into structured values
+    PKT_UNPACK(_args_cmdSetPhaseLock, argsPtr, frame);
+
+    phaseLockSet(argsPtr->enable, argsPtr->target, argsPtr->Kp, argsPtr->Ki);
+
+    radioSendData(src_addr, status, CMD_SET_PHASE_LOCK, length, frame, 0);
+
+    return 1; //success
+}
+
+unsigned char cmdSetSteeringGains(unsigned char type, unsigned char status, unsigned char length, unsigned char *frame, unsigned int src_addr) {
+    //Unpack unsigned char* frame into structured values
+    PKT_UNPACK(_args_cmdSetSteeringGains, argsPtr, frame);
+
+    steeringSetGains(argsPtr->Kp, argsPtr->Ki, argsPtr->Kd, argsPtr->Kaw,
+            argsPtr->Kff, argsPtr->mode);
+
+    radioSendData(src_addr, status, CMD_SET_STEERING_GAINS, length, frame, 0);
+
+    return 1; //success
+}
+
+unsigned char cmdSetYawRate(unsigned char type, unsigned char status, unsigned char length, unsigned char *frame, unsigned int src_addr) {
+    //Unpack unsigned char* frame into structured values
+    PKT_UNPACK(_args_cmdSetYawRate, argsPtr, frame);
+
+    steeringSetRate(argsPtr->rate);
+
+    return 1; //success
+}
+
+unsigned char cmdSetOutputLimits(unsigned char type, unsigned char status, unsigned char length, unsigned char *frame, unsigned int src_addr) {
+    //Unpack unsigned char* frame into structured values
+    PKT_UNPACK(_args_cmdSetOutputLimits, argsPtr, frame);
+    int16_t reply[2];
+
+    reply[0] = argsPtr->channel;
+    reply[1] = pidSetLimits(argsPtr->channel, argsPtr->minDC, argsPtr->maxDC,
+            argsPtr->slew);
+
+    // -1 if rejected, so the host can tell it from a lost packet
+    radioSendData(src_addr, status, CMD_SET_OUTPUT_LIMITS, sizeof (reply), (unsigned char *) reply, 0);
+
+    return 1; //success
+}
+
+unsigned char cmdSetGainTable(unsigned char type, unsigned char status, unsigned char length, unsigned char *frame, unsigned int src_addr) {
+    //Unpack unsigned char* frame into structured values
+    PKT_UNPACK(_args_cmdSetGainTable, argsPtr, frame);
+    int16_t reply[2];
+
+    reply[0] = argsPtr->channel;
+    reply[1] = gainSchedLoad(argsPtr->channel, argsPtr->enable, argsPtr->shift,
+            &argsPtr->gains[0][0]);
+
+    // -1 if rejected, so the host can tell it from a lost packet
+    radioSendData(src_addr, status, CMD_SET_GAIN_TABLE, sizeof (reply), (unsigned char *) reply, 0);
+
+    return 1; //success
+}
+
+unsigned char cmdSetBattComp(unsigned char type, unsigned char status, unsigned char length, unsigned char *frame, unsigned int src_addr) {
+    //Unpack unsigned char* frame into structured values
+    PKT_UNPACK(_args_cmdSetBattComp, argsPtr, frame);
+
+    gainSchedSetBatt(argsPtr->enable, argsPtr->nominal);
+
+    radioSendData(src_addr, status, CMD_SET_BATT_COMP, length, frame, 0);
+
+    return 1; //success
+}
+
+// Starts a relay experiment on a channel and replies at once; the host
+// polls with start = 0 until the status is no longer AUTOTUNE_RUNNING
+unsigned char cmdAutotune(unsigned char type, unsigned char status, unsigned char length, unsigned char *frame, unsigned int src_addr) {
+    //Unpack unsigned char* frame into structured values
+    PKT_UNPACK(_args_cmdAutotune, argsPtr, frame);
+    struct {
+        int16_t channel;
+        autotuneResult result;
+    } reply;
+    int i;
+
+    if (argsPtr->channel < 0 || argsPtr->channel >= NUM_PIDS) {
+        return 0;
+    }
+    if (argsPtr->start) {
+        for (i = 0; i < NUM_PIDS; i++) {
+            pidOff(i);
+        }
+        if (autotuneStart(argsPtr->channel, argsPtr->amplitude,
+                argsPtr->hysteresis, argsPtr->cycles, argsPtr->rule,
+                argsPtr->timeout) < 0) {
+            return 0;
+        }
+    }
+    reply.channel = argsPtr->channel;
+    autotuneGetResult(argsPtr->channel, &reply.result);
+
+    radioSendData(src_addr, status, CMD_AUTOTUNE,
+            sizeof(reply), (unsigned char *)&reply, 0);
+
+    return 1; //success
+}
+
+// Configures one channel; with EXCITE_FLAG_START, puts every channel in
+// PWMPASS and starts all configured ones together on the next PID tick
+unsigned char cmdSetExcitation(unsigned char type, unsigned char status, unsigned char length, unsigned char *frame, unsigned int src_addr) {
+    //Unpack unsigned char* frame into structured values
+    PKT_UNPACK(_args_cmdSetExcitation, argsPtr, frame);
+    exciteConfig config;
+    int i;
+
+    config.type = argsPtr->type;
+    config.offset = argsPtr->offset;
+    config.amplitude = argsPtr->amplitude;
+    config.duration = argsPtr->duration;
+    config.period = argsPtr->period;
+    config.order = argsPtr->order;
+    config.step = ((uint32_t) argsPtr->stepHi << 16) | argsPtr->stepLo;
+    config.growth = argsPtr->growth;
+    if (exciteSet(argsPtr->channel, &config) < 0) {
+        return 0;
+    }
+
+    if (argsPtr->flags & EXCITE_FLAG_START) {
+        for (i = 0; i < NUM_PIDS; i++) {
+            pidOff(i);
+            pidSetPWMDes(i, 0); // motors stop when the sequence ends
+            pidSetMode(i, PID_MODE_PWMPASS);
+        }
+        exciteStart(argsPtr->telemSamples);
+    }
+
+    radioSendData(src_addr, status, CMD_SET_EXCITATION, length, frame, 0);
+
+    return 1; //success
+}
+
+
+unsigned char cmdSetILC(unsigned char type, unsigned char status, unsigned char length, unsigned char *frame, unsigned int src_addr) {
+    //Unpack unsigned char* frame into structured values
+    PKT_UNPACK(_args_cmdSetILC, argsPtr, frame);
+
+    ilcSet(argsPtr->enable, argsPtr->gain, argsPtr->lead, argsPtr->forget);
+
+    radioSendData(src_addr, status, CMD_SET_ILC, length, frame, 0);
+
+    return 1; //success
+}
+
+// Forget the learned corrections, e.g. after a gait or surface change
+unsigned char cmdResetILC(unsigned char type, unsigned char status, unsigned char length, unsigned char *frame, unsigned int src_addr) {
+    ilcReset();
+
+    radioSendData(src_addr, status, CMD_RESET_ILC, length, frame, 0);
+
+    return 1; //success
+}
+
+unsigned char cmdSetLatencyComp(unsigned char type, unsigned char status, unsigned char length, unsigned char *frame, unsigned int src_addr) {
+    //Unpack unsigned char* frame into structured values
+    PKT_UNPACK(_args_cmdSetLatencyComp, argsPtr, frame);
+
+    pidSetLatencyComp(argsPtr->mask, argsPtr->ctrlDelay);
+
+    radioSendData(src_addr, status, CMD_SET_LATENCY_COMP, length, frame, 0);
+
+    return 1; //success
+}
 
 void cmdError() {
     int i;
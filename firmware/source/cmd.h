@@ -8,6 +8,9 @@
 
 //// Includes here should be to provide TYPES and ENUMS only
 #include "pid-ip2.5.h"
+#include "gain_sched.h"
+#include "autotune.h"
+#include "excite.h"
 
 #define CMD_TEST_RADIO              0x00
 #define CMD_TEST_MPU                0x06
@@ -15,6 +18,8 @@
 #define CMD_PID_START_MOTORS        0x81
 #define CMD_SET_PID_GAINS           0x82
 #define CMD_GET_AMS_POS             0x84
+#define CMD_SET_MOVE_QUEUE          0x86
+#define CMD_SET_STEERING_GAINS      0x87
 #define CMD_ERASE_SECTORS           0x8A 
 #define CMD_FLASH_READBACK          0x8B 
 #define CMD_SET_VEL_PROFILE         0x8D
@@ -25,6 +30,26 @@
 #define CMD_PID_STOP_MOTORS         0x92         
 #define CMD_SET_PHASE               0x93         
 #define CMD_SET_MOTOR_MODE          0x94
+#define CMD_GET_ISR_STATS           0x95
+#define CMD_BENCH_PID               0x96
+#define CMD_SET_VEL_ESTIMATOR       0x97
+#define CMD_SET_GAIT_TABLE          0x98
+#define CMD_SET_PHASE_LOCK          0x99
+#define CMD_SET_YAW_RATE            0x9A
+#define CMD_SET_GAIN_TABLE          0x9B
+#define CMD_SET_BATT_COMP           0x9C
+#define CMD_AUTOTUNE                0x9D
+#define CMD_SET_EXCITATION          0x9E
+#define CMD_SET_OUTPUT_LIMITS       0x9F
+#define CMD_SET_ILC                 0xA0
+#define CMD_RESET_ILC               0xA1
+#define CMD_SET_LATENCY_COMP        0xA2
+#define CMD_FLASH_READBACK_PACKED   0xA3
+#define CMD_FLASH_READBACK_RANGES   0xA4
+#define CMD_SET_TELEM_COMP          0xA5
+#define CMD_FLASH_READBACK_COMP     0xA6
+#define CMD_SET_TELEM_FIELDS        0xA7
+#define CMD_TELEM_STREAM            0xA8
 // Redefine
 
 void cmdSetup(void);
@@ -74,6 +99,47 @@ typedef struct{
     uint32_t samples;
 } _args_cmdFlashReadback;
 
+//cmdFlashReadbackPacked
+typedef struct{
+    uint32_t start;                 // first sample index
+    uint32_t samples;
+} _args_cmdFlashReadbackPacked;
+
+//cmdFlashReadbackRanges, as many ranges as the packet length carries
+#define READBACK_CHUNK_RANGES   14
+typedef struct{
+    uint32_t start;                 // first sample index
+    uint32_t samples;
+} _args_readbackRange;
+typedef struct{
+    _args_readbackRange ranges[READBACK_CHUNK_RANGES];
+} _args_cmdFlashReadbackRanges;
+
+//cmdFlashReadbackComp
+typedef struct{
+    uint16_t start;                 // first page
+    uint16_t pages;                 // 0 for the whole log
+} _args_cmdFlashReadbackComp;
+
+//cmdSetTelemComp
+typedef struct{
+    int16_t enable;                 // see telem_comp.h
+} _args_cmdSetTelemComp;
+
+//cmdSetTelemFields, replies with the schema in packets of a
+//uint32 mask, uint8 first, uint8 total and up to TELEM_FIELDS_CHUNK
+//vrTelemFieldDesc
+#define TELEM_FIELDS_CHUNK      13
+typedef struct{
+    uint32_t mask;                  // VR_TELEM_*, 0 to only query
+} _args_cmdSetTelemFields;
+
+//cmdTelemStream, replies with the rate in effect, then streams, see
+//telem_stream.h
+typedef struct{
+    uint16_t rate;                  // Hz, 0 to stop
+} _args_cmdTelemStream;
+
 //cmdSetVelProfile
 typedef struct{
     int16_t periodLeft;
@@ -84,10 +150,126 @@ typedef struct{
     int16_t flagRight;
 } _args_cmdSetVelProfile;
 
+//cmdSetGaitTable
+#define GAIT_CHUNK_POINTS   32
+typedef struct{
+    int16_t channel;
+    int16_t num_points;             // table length, up to GAIT_MAX_POINTS
+    int16_t start, count;           // points carried by this chunk
+    int16_t period;                 // ms per stride
+    int16_t stride;                 // advance per stride, 0x4000 per rev
+    int16_t flags;                  // onceFlag, as in cmdSetVelProfile
+    int16_t points[GAIT_CHUNK_POINTS]; // position at phase k/num_points
+} _args_cmdSetGaitTable;
+
+//cmdSetMoveQueue
+#define MOVE_CHUNK_SEGMENTS 8
+typedef struct{
+    int16_t periodLeft, periodRight; // ms per stride, 0 keeps the current
+    int16_t phase;                  // left - right, 0x10000 per rev
+    uint16_t count;                 // strides, or ms with MOVE_DURATION
+    int16_t flags;                  // MOVE_* in move_queue.h
+} _args_moveSegment;
+typedef struct{
+    int16_t num_segments;
+    _args_moveSegment segments[MOVE_CHUNK_SEGMENTS];
+} _args_cmdSetMoveQueue;
+
 //cmdSetPhase
 typedef struct{
     int32_t offset;
 } _args_cmdSetPhase;
 
+//cmdSetSteeringGains
+typedef struct{
+    int16_t Kp, Ki, Kd, Kaw, Kff;   // see steering.h
+    int16_t mode;                   // STEER_MODE_*
+} _args_cmdSetSteeringGains;
+
+//cmdSetYawRate
+typedef struct{
+    int16_t rate;                   // gyro Z LSB, 16.4 per deg/s at +-2000
+} _args_cmdSetYawRate;
+
+//cmdSetOutputLimits, replies with int16 channel and 0, or -1 if rejected
+typedef struct{
+    int16_t channel;
+    int16_t minDC, maxDC;           // duty, within +-MAXTHROT
+    uint16_t slew;                  // duty change per ms, 0 for none
+} _args_cmdSetOutputLimits;
+
+//cmdSetILC
+typedef struct{
+    int16_t enable;
+    int16_t gain;                   // Q12 on the bin mean position error
+    uint16_t lead;                  // bins, see ilc.h
+    uint16_t forget;                // Q15
+} _args_cmdSetILC;
+
+//cmdSetLatencyComp
+typedef struct{
+    uint16_t mask;                  // PID_LATENCY_* sensors to extrapolate
+    uint16_t ctrlDelay;             // us from pidUpdate start to tiHSetDC
+} _args_cmdSetLatencyComp;
+
+//cmdSetGainTable, replies with int16 channel and 0, or -1 if rejected
+typedef struct{
+    int16_t channel;
+    int16_t enable;
+    int16_t shift;                  // |v_input| per point is 1 << shift
+    int16_t gains[GAIN_SCHED_POINTS][GAIN_SCHED_GAINS]; // Kp, Ki, Kd, Kaw, ff
+} _args_cmdSetGainTable;
+
+//cmdSetBattComp
+typedef struct{
+    int16_t enable;
+    uint16_t nominal;               // Vbatt A/D units the gains were tuned at
+} _args_cmdSetBattComp;
+
+//cmdAutotune
+typedef struct{
+    int16_t channel;
+    int16_t start;                  // 0 just reports the last result
+    int16_t amplitude;              // relay duty
+    int16_t hysteresis;             // p_state units, above the encoder noise
+    int16_t cycles;                 // limit cycles averaged
+    int16_t rule;                   // AUTOTUNE_RULE_*
+    uint16_t timeout;               // ms
+} _args_cmdAutotune;
+
+//cmdSetExcitation
+#define EXCITE_FLAG_START   0x01    // start all configured channels
+typedef struct{
+    int16_t channel;
+    int16_t type;                   // EXCITE_* in excite.h
+    int16_t offset, amplitude;      // duty
+    uint16_t duration;              // ms, 0 until stopped
+    uint16_t period;                // PRBS bit hold, multisine fundamental, ms
+    uint16_t order;                 // PRBS register bits, multisine harmonics
+    uint16_t stepLo, stepHi;        // chirp start phase step, 2^32 per cycle
+    uint16_t growth;                // chirp step growth per ms, Q24
+    int16_t flags;                  // EXCITE_FLAG_*
+    uint32_t telemSamples;          // started with the excitation if not 0
+} _args_cmdSetExcitation;
+
+//cmdSetPhaseLock
+typedef struct{
+    int16_t enable;
+    int16_t target;                 // left - right, 0x10000 per rev
+    int16_t Kp, Ki;                 // see phase_lock.h
+} _args_cmdSetPhaseLock;
+
+//cmdBenchPID, replies with a uint32 iterations and an int32 total time
+//in timebase us, -1 if refused because a PID loop is on
+typedef struct{
+    uint16_t iterations;
+} _args_cmdBenchPID;
+
+//cmdSetVelEstimator
+typedef struct{
+    int16_t mode;
+    int16_t alpha, beta, gamma;     // Q15 observer gains, see vel_obs.h
+} _args_cmdSetVelEstimator;
+
 
 #endif // __CMD_H
\ No newline at end of file
@@ -62,6 +62,8 @@
 #include "settings.h"
 #include "dfmem.h"
 #include "telem.h"
+#include "telem_comp.h"
+#include "telem_stream.h"
 #include "interrupts.h"
 #include "mpu6000.h"
 #include "sclock.h"
@@ -110,6 +112,8 @@ int main() {
     tiHSetup();
     dfmemSetup();
     telemSetup();
+    telemCompSetup();
+    telemStreamSetup();
     adcSetup();
     pidSetup();
 
@@ -136,6 +140,12 @@ int main() {
         //Service pending commands
         cmdHandleRadioRxBuffer();
 
+        // Encode and write out compressed telemetry
+        telemCompProcess();
+
+        // Live telemetry, as far as the radio TX queue has room
+        telemStreamProcess();
+
         // Send outgoing uart packets
 //        if(uart_tx_flag) {
 //            uartSendPacket(uart_tx_packet);
@@ -0,0 +1,139 @@
+/*
+ * Name: adc_ring.c
+ * Desc: PWM triggered back EMF and battery conversions, DMA'd into a ring
+ */
+#include <xc.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "adc_pid.h"
+#include "adc_ring.h"
+#include "timebase.h"
+
+#define ADC_RING_MASK   (ADC_RING_PASSES - 1)
+
+static unsigned int adcRing[ADC_RING_PASSES][ADC_RING_PASS_WORDS]
+        __attribute__((space(dma)));
+static timebaseTime adcRingTime[ADC_RING_PASSES];
+static volatile unsigned int adcRingHead;      // pass DMA is filling
+static volatile unsigned int adcRingPasses;
+
+void adcSetup(void) {
+    unsigned int k;
+
+    adcRingHead = 0;
+    adcRingPasses = 0;
+    for (k = 0; k < ADC_RING_PASSES; k++) {
+        adcRingTime[k] = 0;
+    }
+
+    AD1CON1bits.ADON = 0;       //disable
+    AD1CON1bits.ADSIDL = 0;     //continue in idle mode
+    AD1CON1bits.AD12B = 0;      //10 bit mode
+    AD1CON1bits.FORM = 0b00;    //integer (0000 00dd dddd dddd) format output
+    AD1CON1bits.SSRC = 0b011;   //Sample clock source based on PWM
+    AD1CON1bits.SIMSAM = 1;     //Sample channels simultaneously
+    AD1CON1bits.ASAM = 1;       //Sample again right after each conversion
+    AD1CON1bits.ADDMABM = 1;    //DMA buffers written in conversion order
+
+    AD1CON2bits.VCFG = 0b000;   //Vdd is pos. ref and Vss is neg. ref.
+    AD1CON2bits.CSCNA = 1;      //Scan CH0 over the motor inputs
+    AD1CON2bits.CHPS = 0b01;    //Convert channels 0 and 1
+    AD1CON2bits.SMPI = ADC_RING_PASS_WORDS - 1; //Interrupt once per scan pass
+    AD1CON2bits.BUFM = 0;
+    AD1CON2bits.ALTS = 0;       //Do not alternate MUXes for analog input selection
+
+    AD1CON3bits.ADRC = 0;       //Derive conversion clock from system clock
+    AD1CON3bits.ADCS = 0b00000010; // Each TAD is 3 Tcy
+    AD1CON4bits.DMABL = 0b000;  //1 word per input, DMA does the buffering
+
+    AD1PCFGL = ~(0x0001 | (((1 << ADC_RING_MOTORS) - 1) << 8)); //AN0, AN8.. analog
+    AD1CSSL = ((1 << ADC_RING_MOTORS) - 1) << 8;   //scan AN8..
+
+    AD1CHS0bits.CH0NA = 0;      //Select Vref- for CH0 -ve input
+    AD1CHS123bits.CH123SA = 0;  //CH1 on AN0, the battery
+    AD1CHS123bits.CH123NA = 0b00; //Select Vref- for CH1 -ve input
+
+    // DMA0: ADC1 -> ring, continuous, wraps at the end of the ring
+    DMA0CONbits.CHEN = 0;
+    DMA0CONbits.SIZE = 0;       //word
+    DMA0CONbits.DIR = 0;        //peripheral to RAM
+    DMA0CONbits.AMODE = 0b00;   //register indirect, post increment
+    DMA0CONbits.MODE = 0b00;    //continuous, no ping-pong
+    DMA0PAD = (unsigned int) (uintptr_t) &ADC1BUF0;
+    DMA0REQ = 13;               //ADC1 convert done
+    DMA0STA = __builtin_dmaoffset(adcRing);
+    DMA0CNT = ADC_RING_PASSES * ADC_RING_PASS_WORDS - 1;
+    _DMA0IE = 0;
+    DMA0CONbits.CHEN = 1;
+
+    // Timer1's priority, see SetupTimer1, so neither can interrupt the other
+    // in the middle of a 32 bit sclock read. A pass finishing during the
+    // PID tick is stamped after it, but that tick could not read it anyway
+    _AD1IP = 4;
+    _AD1IF = 0;
+    _AD1IE = 1;
+    AD1CON1bits.ADON = 1;       //enable
+}
+
+void __attribute__((interrupt, no_auto_psv)) _ADC1Interrupt(void) {
+    adcRingTime[adcRingHead] = timebaseNow();
+    adcRingHead = (adcRingHead + 1) & ADC_RING_MASK;
+    adcRingPasses++;
+    _AD1IF = 0;
+}
+
+unsigned int adcRingRead(unsigned int input, timebaseTime *timestamp) {
+    unsigned int newest, slot, k, m;
+    unsigned long sum = 0;
+
+    // passes behind the head are complete and DMA will not reach them
+    // again for ADC_RING_PASSES - ADC_RING_DECIM passes
+    newest = (adcRingHead - 1) & ADC_RING_MASK;
+    if (timestamp != NULL) {
+        *timestamp = adcRingTime[newest];
+    }
+    for (k = 0; k < ADC_RING_DECIM; k++) {
+        slot = (newest - k) & ADC_RING_MASK;
+        if (input == ADC_RING_VBATT) {
+            for (m = 0; m < ADC_RING_MOTORS; m++) {
+                sum += adcRing[slot][2 * m + 1];
+            }
+        } else if (input < ADC_RING_MOTORS) {
+            sum += adcRing[slot][2 * input];
+        }
+    }
+    if (input == ADC_RING_VBATT) {
+        return sum / (ADC_RING_DECIM * ADC_RING_MOTORS);
+    }
+    return sum / ADC_RING_DECIM;
+}
+
+timebaseTime adcRingGetSampleTime(void) {
+    // the pass is stamped at its last conversion
+    return adcRingTime[(adcRingHead - 1) & ADC_RING_MASK] -
+            (ADC_RING_DECIM * ADC_RING_MOTORS - 1) * ADC_RING_PWM_US / 2;
+}
+
+unsigned int adcRingGetPasses(void) {
+    return adcRingPasses;
+}
+
+unsigned int adcGetVbatt(void) {
+    return adcRingRead(ADC_RING_VBATT, NULL);
+}
+
+unsigned int adcGetMotorA(void) {
+    return adcRingRead(ADC_RING_MOTOR_A, NULL);
+}
+
+unsigned int adcGetMotorB(void) {
+    return adcRingRead(ADC_RING_MOTOR_B, NULL);
+}
+
+unsigned int adcGetMotorC(void) {
+    return adcRingRead(ADC_RING_MOTOR_C, NULL);
+}
+
+unsigned int adcGetMotorD(void) {
+    return adcRingRead(ADC_RING_MOTOR_D, NULL);
+}
@@ -0,0 +1,55 @@
+/*
+ * Name: adc_ring.h
+ * Desc: PWM triggered back EMF and battery conversions, DMA'd into a ring
+ *
+ * Replaces imageproc-lib/adc_pid.c and implements its adc_pid.h API.
+ * Every PWM special event converts CH0, scanning the first ADC_RING_MOTORS
+ * motor inputs (AN8.., motor A..D), together with CH1 on the battery (AN0).
+ * DMA0 copies each conversion into a ring of ADC_RING_PASSES scan passes,
+ * and the ADC interrupt at the end of a pass only stamps it with the
+ * timebase. Nothing converts on demand, so reads never block. DMA0 is
+ * this module's alone; nothing else in this tree touches a DMA channel.
+ *
+ * Reads average the newest ADC_RING_DECIM passes, one PID tick's worth:
+ * with 2 motors at 4 kHz PWM each back EMF is sampled twice per ms and the
+ * battery four times. Above 2 kHz PID a read may repeat the last tick's.
+ */
+#ifndef __ADC_RING_H
+#define __ADC_RING_H
+
+#include "settings.h"
+#include "loop_rate.h"
+#include "timebase.h"
+
+#ifndef ADC_RING_MOTORS
+#define ADC_RING_MOTORS     2       // motor inputs scanned, A first
+#endif
+#if ADC_RING_MOTORS < 1 || ADC_RING_MOTORS > 4
+#error "ADC_RING_MOTORS must be 1 to 4"
+#endif
+
+#define ADC_RING_PWM_PER_MS 4       // PWM special events per ms, see SetupPWM
+#define ADC_RING_PWM_US     (1000 / ADC_RING_PWM_PER_MS)
+#define ADC_RING_PASSES     8       // power of 2
+#define ADC_RING_DECIM      (ADC_RING_PWM_PER_MS / ADC_RING_MOTORS / PID_TICKS_PER_MS > 1 ? \
+                             ADC_RING_PWM_PER_MS / ADC_RING_MOTORS / PID_TICKS_PER_MS : 1)
+#define ADC_RING_PASS_WORDS (2 * ADC_RING_MOTORS)   // CH0, CH1 per trigger
+
+// adcRingRead inputs
+#define ADC_RING_MOTOR_A    0
+#define ADC_RING_MOTOR_B    1
+#define ADC_RING_MOTOR_C    2
+#define ADC_RING_MOTOR_D    3
+#define ADC_RING_VBATT      4
+
+// Average of the newest ADC_RING_DECIM passes. If timestamp is not NULL it
+// gets the time the newest pass completed.
+unsigned int adcRingRead(unsigned int input, timebaseTime *timestamp);
+// Mean time of the conversions adcRingRead averages. The battery
+// is converted at exactly that mean; each motor input within half a PWM
+// period of it.
+timebaseTime adcRingGetSampleTime(void);
+// Scan passes completed since adcSetup, wraps
+unsigned int adcRingGetPasses(void);
+
+#endif // __ADC_RING_H
@@ -0,0 +1,161 @@
+/*
+ * Name: autotune.c
+ * Desc: Relay feedback autotuning of the leg position PIDs
+ *
+ * autotuneUpdate runs in the Timer1 ISR from pidUpdate, once per channel
+ * per PID tick; autotuneStart and autotuneGetResult run from the command
+ * handler. The divides are done once, when a channel finishes.
+ */
+#include "autotune.h"
+#include "pid_kernel.h"
+#include "utils.h"
+
+#define AUTOTUNE_KU_SCALE       5215    // 4 / pi * 4096
+
+// {Kp / Ku, Ti / Pu, Td / Pu}, Q8
+static const uint16_t autotuneRules[AUTOTUNE_NUM_RULES][3] = {
+    [AUTOTUNE_RULE_ZN] = {154, 128, 32},
+    [AUTOTUNE_RULE_OVERSHOOT] = {85, 128, 85},
+    [AUTOTUNE_RULE_NO_OVERSHOOT] = {51, 128, 85},
+};
+
+typedef struct {
+    long target;                    // leg position at the start
+    long hi, lo;                    // extremes this cycle
+    uint32_t sumSwing, sumPeriod;
+    uint32_t ticks, cycleStart, timeout;    // PID ticks
+    int16_t amplitude, hysteresis, out;
+    unsigned char cycles, upSwitches, measured, rule, started;
+} autotuneState;
+
+static autotuneState tuneState[NUM_PIDS];
+static autotuneResult tuneResult[NUM_PIDS];
+static volatile unsigned char tuneRunning; // bit per channel
+
+void autotuneSetup(void) {
+    unsigned int j;
+    tuneRunning = 0;
+    for (j = 0; j < NUM_PIDS; j++) {
+        tuneResult[j].status = AUTOTUNE_IDLE;
+    }
+}
+
+int autotuneStart(unsigned int chan, int amplitude, int hysteresis,
+        unsigned int cycles, unsigned char rule, unsigned int timeout_ms) {
+    autotuneState *s;
+
+    if (chan >= NUM_PIDS || rule >= AUTOTUNE_NUM_RULES || cycles < 1 ||
+            cycles > AUTOTUNE_MAX_CYCLES || amplitude <= 0 || timeout_ms == 0) {
+        return -1;
+    }
+    CRITICAL_SECTION_START;
+    tuneRunning &= ~(1 << chan);
+    CRITICAL_SECTION_END;
+    s = &tuneState[chan];
+    s->amplitude = amplitude;
+    s->hysteresis = hysteresis > 0 ? hysteresis : 0;
+    s->cycles = cycles;
+    s->rule = rule;
+    s->timeout = (uint32_t) timeout_ms << PID_TICK_SHIFT;
+    s->started = 0; // the ISR latches the target on its first tick
+    tuneResult[chan].status = AUTOTUNE_RUNNING;
+    CRITICAL_SECTION_START;
+    tuneRunning |= 1 << chan;
+    CRITICAL_SECTION_END;
+    return 0;
+}
+
+void autotuneStop(void) {
+    unsigned int j;
+    CRITICAL_SECTION_START;
+    for (j = 0; j < NUM_PIDS; j++) {
+        if (tuneRunning & (1 << j)) {
+            tuneResult[j].status = AUTOTUNE_IDLE;
+        }
+    }
+    tuneRunning = 0;
+    CRITICAL_SECTION_END;
+}
+
+unsigned char autotuneActive(void) {
+    return tuneRunning != 0;
+}
+
+static void autotuneFinish(unsigned int chan) {
+    autotuneState *s = &tuneState[chan];
+    autotuneResult *r = &tuneResult[chan];
+    const uint16_t *rule = autotuneRules[s->rule];
+    long swing, Ku, Kp, Ti, Td;
+
+    tuneRunning &= ~(1 << chan);
+    swing = s->sumSwing / (2 * s->cycles);
+    if (swing <= 0) {
+        r->status = AUTOTUNE_TIMEOUT;
+        return;
+    }
+    Ku = pidClamp((long) s->amplitude * AUTOTUNE_KU_SCALE / swing, 0, 0x7fff);
+    Kp = (Ku * rule[0]) >> 8;
+    r->Pu = (s->sumPeriod >> PID_TICK_SHIFT) / s->cycles;
+    Ti = ((long) r->Pu * rule[1]) >> 8;
+    Td = ((long) r->Pu * rule[2]) >> 8;
+    r->Ku = Ku;
+    r->swing = pidClamp(swing >> 2, 0, 0xffff);
+    r->Kp = Kp;
+    r->Ki = pidClamp(Kp * 256 / (Ti > 0 ? Ti : 1), 0, 0x7fff);
+    r->Kd = pidClamp(Kp * Td / K_EMF, 0, 0x7fff);
+    r->status = AUTOTUNE_DONE;
+}
+
+int autotuneUpdate(unsigned int chan, long p_state) {
+    autotuneState *s = &tuneState[chan];
+    long err;
+
+    if (!(tuneRunning & (1 << chan))) {
+        return 0;
+    }
+    if (!s->started) {
+        s->target = p_state;
+        s->hi = s->lo = p_state;
+        s->sumSwing = s->sumPeriod = 0;
+        s->ticks = s->cycleStart = 0;
+        s->upSwitches = s->measured = 0;
+        s->out = s->amplitude;
+        s->started = 1;
+    }
+    s->ticks++;
+    if (p_state > s->hi) {
+        s->hi = p_state;
+    }
+    if (p_state < s->lo) {
+        s->lo = p_state;
+    }
+    err = s->target - p_state;
+    if (err < -s->hysteresis && s->out > 0) {
+        s->out = -s->amplitude;
+    } else if (err > s->hysteresis && s->out < 0) {
+        // a full cycle ends on each switch up
+        s->out = s->amplitude;
+        if (s->upSwitches++ >= AUTOTUNE_SKIP_CYCLES) {
+            s->sumPeriod += s->ticks - s->cycleStart;
+            s->sumSwing += s->hi - s->lo;
+            if (++s->measured >= s->cycles) {
+                autotuneFinish(chan);
+                return 0;
+            }
+        }
+        s->cycleStart = s->ticks;
+        s->hi = s->lo = p_state;
+    }
+    if (s->ticks >= s->timeout) {
+        tuneRunning &= ~(1 << chan);
+        tuneResult[chan].status = AUTOTUNE_TIMEOUT;
+        return 0;
+    }
+    return s->out;
+}
+
+void autotuneGetResult(unsigned int chan, autotuneResult *result) {
+    CRITICAL_SECTION_START;
+    *result = tuneResult[chan];
+    CRITICAL_SECTION_END;
+}
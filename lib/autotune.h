@@ -0,0 +1,65 @@
+/*
+ * Name: autotune.h
+ * Desc: Relay feedback autotuning of the leg position PIDs
+ *
+ * While a channel tunes, its PID is bypassed and the motor is driven at
+ * +-amplitude duty by a relay on the position error about the point where
+ * the leg stood when the experiment started, with hysteresis. The leg
+ * settles into a limit cycle at the ultimate period Pu. After
+ * AUTOTUNE_SKIP_CYCLES for the transient, Pu and the peak to peak swing
+ * 2a are averaged over the requested number of cycles, and the describing
+ * function gives the ultimate gain in the units of pidPos.Kp:
+ *
+ *   Ku = 4 * amplitude / (pi * a) * 4096             p->output is Kp >> 12
+ *
+ * Gains follow from a tuning rule of {Kp / Ku, Ti / Pu, Td / Pu}, in the
+ * scaling of UpdatePID with the back emf velocity estimate:
+ *
+ *   Ki = Kp * 256 / Ti                               Ti, Td in ms
+ *   Kd = Kp * Td / K_EMF
+ *
+ * the D term being Kd * v >> 4 with v = K_EMF * dp >> 8 per ms, so that it
+ * equals Kp * Td * dp >> 12 like the P term.
+ *
+ * Legs should be free to swing, e.g. with the robot held off the ground.
+ */
+#ifndef __AUTOTUNE_H
+#define __AUTOTUNE_H
+
+#include <stdint.h>
+#include "pid-ip2.5.h"
+
+#define AUTOTUNE_SKIP_CYCLES    2
+#define AUTOTUNE_MAX_CYCLES     16
+
+// tuning rules
+#define AUTOTUNE_RULE_ZN        0   // Ziegler-Nichols, 0.6 Ku, Pu / 2, Pu / 8
+#define AUTOTUNE_RULE_OVERSHOOT 1   // some overshoot, Ku / 3, Pu / 2, Pu / 3
+#define AUTOTUNE_RULE_NO_OVERSHOOT 2 // Ku / 5, Pu / 2, Pu / 3
+#define AUTOTUNE_NUM_RULES      3
+
+// result status
+#define AUTOTUNE_IDLE           0
+#define AUTOTUNE_RUNNING        1
+#define AUTOTUNE_DONE           2
+#define AUTOTUNE_TIMEOUT        3   // no steady limit cycle, try more amplitude
+
+typedef struct {
+    int16_t status;
+    int16_t Ku;                     // ultimate gain, pidPos.Kp units
+    uint16_t Pu;                    // ultimate period, ms
+    uint16_t swing;                 // a, 0x4000 per rev
+    int16_t Kp, Ki, Kd;             // from the rule
+} autotuneResult;
+
+void autotuneSetup(void);
+// Returns 0, or -1 for a bad channel, rule, cycle count or a zero timeout
+int autotuneStart(unsigned int chan, int amplitude, int hysteresis,
+        unsigned int cycles, unsigned char rule, unsigned int timeout_ms);
+void autotuneStop(void);
+unsigned char autotuneActive(void);
+// Returns the duty for chan this tick, in pidPos.output direction
+int autotuneUpdate(unsigned int chan, long p_state);
+void autotuneGetResult(unsigned int chan, autotuneResult *result);
+
+#endif // __AUTOTUNE_H
@@ -0,0 +1,215 @@
+/*
+ * Name: excite.c
+ * Desc: System identification excitation for PID_MODE_PWMPASS
+ *
+ * exciteTick and exciteUpdate run in the Timer1 ISR from pidUpdate; the
+ * setters run from the command handler. Sines come from a quarter wave
+ * table with linear interpolation, so the ISR does no divides.
+ */
+#include "excite.h"
+#include "pid_kernel.h"
+#include "utils.h"
+
+// sin(pi / 2 * i / 64), Q15
+static const int16_t exciteQuarterSine[65] = {
+    0, 804, 1608, 2410, 3212, 4011, 4808, 5602,
+    6393, 7179, 7962, 8739, 9512, 10278, 11039, 11793,
+    12539, 13279, 14010, 14732, 15446, 16151, 16846, 17530,
+    18204, 18868, 19519, 20159, 20787, 21403, 22005, 22594,
+    23170, 23731, 24279, 24811, 25329, 25832, 26319, 26790,
+    27245, 27683, 28105, 28510, 28898, 29268, 29621, 29956,
+    30273, 30571, 30852, 31113, 31356, 31580, 31785, 31971,
+    32137, 32285, 32412, 32521, 32609, 32678, 32728, 32757,
+    32767,
+};
+
+// Galois feedback masks for maximal length sequences, by register bits
+static const uint16_t excitePrbsMask[17] = {
+    0, 0, 0x0003, 0x0006, 0x000C, 0x0014, 0x0030, 0x0060, 0x00B8,
+    0x0110, 0x0240, 0x0500, 0x0829, 0x100D, 0x2015, 0x6000, 0xD008,
+};
+
+typedef struct {
+    exciteConfig cfg;
+    uint32_t phase[EXCITE_MAX_HARMONICS];
+    uint32_t step;                  // multisine fundamental, chirp now per ms
+    uint32_t ticks, hold, duration; // PID ticks
+    uint16_t lfsr;
+    int16_t scale;                  // multisine 1 / harmonics, Q15
+    int16_t level;                  // PRBS -1 or 1, Q15
+} exciteState;
+
+static exciteState excite[NUM_PIDS];
+static volatile unsigned char exciteRunning;   // bit per channel
+static volatile unsigned char excitePending;
+static volatile unsigned long exciteTelemSamples;
+
+void exciteSetup(void) {
+    unsigned int j;
+    exciteRunning = 0;
+    excitePending = 0;
+    for (j = 0; j < NUM_PIDS; j++) {
+        excite[j].cfg.type = EXCITE_OFF;
+    }
+}
+
+int exciteSet(unsigned int chan, const exciteConfig *config) {
+    if (chan >= NUM_PIDS) {
+        return -1;
+    }
+    switch (config->type) {
+        case EXCITE_OFF:
+        case EXCITE_CHIRP:
+            break;
+        case EXCITE_PRBS:
+            if (config->order < 2 || config->order > 16 || config->period == 0) {
+                return -1;
+            }
+            break;
+        case EXCITE_MULTISINE:
+            if (config->order < 1 || config->order > EXCITE_MAX_HARMONICS ||
+                    config->period == 0) {
+                return -1;
+            }
+            break;
+        default:
+            return -1;
+    }
+    CRITICAL_SECTION_START;
+    exciteRunning &= ~(1 << chan);
+    CRITICAL_SECTION_END;
+    excite[chan].cfg = *config;
+    return 0;
+}
+
+// Initial state, with the divides, in command context
+static void exciteInit(exciteState *s) {
+    unsigned int k, r;
+
+    s->ticks = 0;
+    s->duration = (uint32_t) s->cfg.duration << PID_TICK_SHIFT;
+    switch (s->cfg.type) {
+        case EXCITE_PRBS:
+            s->lfsr = 1;
+            s->hold = 0;
+            break;
+        case EXCITE_MULTISINE:
+            s->step = 0xffffffffUL / ((uint32_t) s->cfg.period << PID_TICK_SHIFT) + 1;
+            s->scale = 0x7fff / s->cfg.order;
+            // Schroeder phases, -pi k (k - 1) / K for harmonic k
+            for (k = 1; k <= s->cfg.order; k++) {
+                r = (k * (k - 1)) % (2 * s->cfg.order);
+                s->phase[k - 1] = 0 - r * (0x80000000UL / s->cfg.order);
+            }
+            break;
+        case EXCITE_CHIRP:
+            s->step = s->cfg.step;
+            s->phase[0] = 0;
+            break;
+    }
+}
+
+void exciteStart(unsigned long telem_samples) {
+    unsigned int j;
+
+    exciteStop();
+    for (j = 0; j < NUM_PIDS; j++) {
+        if (excite[j].cfg.type != EXCITE_OFF) {
+            exciteInit(&excite[j]);
+        }
+    }
+    exciteTelemSamples = telem_samples;
+    excitePending = 1;
+}
+
+void exciteStop(void) {
+    CRITICAL_SECTION_START;
+    excitePending = 0;
+    exciteRunning = 0;
+    CRITICAL_SECTION_END;
+}
+
+unsigned long exciteTick(void) {
+    unsigned int j;
+
+    if (!excitePending) {
+        return 0;
+    }
+    excitePending = 0;
+    for (j = 0; j < NUM_PIDS; j++) {
+        if (excite[j].cfg.type != EXCITE_OFF) {
+            exciteRunning |= 1 << j;
+        }
+    }
+    return exciteTelemSamples;
+}
+
+unsigned char exciteActive(unsigned int chan) {
+    return (exciteRunning >> chan) & 1;
+}
+
+static int16_t exciteSin8(unsigned char idx) {
+    int16_t v = (idx & 0x40) ? exciteQuarterSine[64 - (idx & 0x3f)] :
+            exciteQuarterSine[idx & 0x3f];
+    return (idx & 0x80) ? -v : v;
+}
+
+// Q15 sine of a 2^32 per cycle phase, 256 table steps interpolated
+static int16_t exciteSin(uint32_t phase) {
+    unsigned char idx = phase >> 24;
+    int16_t a = exciteSin8(idx);
+    return a + (PID_MULSU(exciteSin8(idx + 1) - a, (phase >> 16) & 0xff) >> 8);
+}
+
+int exciteUpdate(unsigned int chan) {
+    exciteState *s = &excite[chan];
+    int32_t sum;
+    uint32_t step;
+    unsigned int k;
+    int16_t out;
+
+    if (!exciteActive(chan)) {
+        return 0;
+    }
+    switch (s->cfg.type) {
+        case EXCITE_PRBS:
+            if (s->hold == 0) {
+                if (s->lfsr & 1) {
+                    s->lfsr = (s->lfsr >> 1) ^ excitePrbsMask[s->cfg.order];
+                    s->level = 0x7fff;
+                } else {
+                    s->lfsr >>= 1;
+                    s->level = -0x7fff;
+                }
+                s->hold = (uint32_t) s->cfg.period << PID_TICK_SHIFT;
+            }
+            s->hold--;
+            out = s->level;
+            break;
+        case EXCITE_MULTISINE:
+            sum = 0;
+            step = s->step;
+            for (k = 0; k < s->cfg.order; k++) {
+                sum += exciteSin(s->phase[k]);
+                s->phase[k] += step;
+                step += s->step;
+            }
+            out = pidMulShr(s->scale, sum, 15);
+            break;
+        case EXCITE_CHIRP:
+            out = exciteSin(s->phase[0]);
+            s->phase[0] += s->step >> PID_TICK_SHIFT;
+            if ((s->ticks & (PID_TICKS_PER_MS - 1)) == PID_TICKS_PER_MS - 1) {
+                s->step += (PID_MULUU(s->step >> 16, s->cfg.growth) >> 8) +
+                        (PID_MULUU(s->step, s->cfg.growth) >> 24);
+            }
+            break;
+        default:
+            out = 0;
+            break;
+    }
+    if (++s->ticks >= s->duration && s->duration) {
+        exciteRunning &= ~(1 << chan);
+    }
+    return s->cfg.offset + pidMulShr(s->cfg.amplitude, out, 15);
+}
@@ -0,0 +1,62 @@
+/*
+ * Name: excite.h
+ * Desc: System identification excitation for PID_MODE_PWMPASS
+ *
+ * Generates a duty sequence per channel at the PID rate, in place of the
+ * constant pwmDes, so frequency response data can be logged without
+ * streaming duty cycles over the radio. Every signal is offset +
+ * amplitude * s[n], s in -1..1:
+ *
+ *   EXCITE_PRBS       maximal length LFSR of `order` bits (2..16), each
+ *                     bit held for `period` ms
+ *   EXCITE_MULTISINE  harmonics 1..order (at most EXCITE_MAX_HARMONICS) of
+ *                     a `period` ms fundamental with Schroeder phases,
+ *                     scaled by 1 / order so the peak stays in range
+ *   EXCITE_CHIRP      logarithmic sweep; the phase step starts at `step`
+ *                     (2^32 per cycle, per ms) and grows by step * growth
+ *                     >> 24 each ms, so f(t) = f0 * exp(growth * t / 2^24)
+ *
+ * and stops after `duration` ms, 0 running until stopped. Signals are
+ * periodic where the type allows, for averaging over periods. All
+ * configured channels start together on a PID tick, optionally with
+ * telemetry: sample k of the log then holds duty k * PID_TICKS_PER_MS of
+ * the sequence in DCL/DCR, and the response to it measured one tick later.
+ */
+#ifndef __EXCITE_H
+#define __EXCITE_H
+
+#include <stdint.h>
+#include "pid-ip2.5.h"
+
+#define EXCITE_OFF          0
+#define EXCITE_PRBS         1
+#define EXCITE_MULTISINE    2
+#define EXCITE_CHIRP        3
+
+#define EXCITE_MAX_HARMONICS 8
+
+typedef struct {
+    unsigned char type;             // EXCITE_*
+    int16_t offset, amplitude;      // duty
+    uint16_t duration;              // ms, 0 until stopped
+    uint16_t period;                // PRBS bit hold, multisine fundamental, ms
+    uint16_t order;                 // PRBS register bits, multisine harmonics
+    uint32_t step;                  // chirp start phase step
+    uint16_t growth;                // chirp step growth, Q24
+} exciteConfig;
+
+void exciteSetup(void);
+// Returns 0, or -1 for a bad channel or parameters
+int exciteSet(unsigned int chan, const exciteConfig *config);
+// Starts every configured channel on the next PID tick, and telemetry
+// for telem_samples samples if not 0
+void exciteStart(unsigned long telem_samples);
+void exciteStop(void);
+// Called on the first PID tick of each ms before exciteUpdate; returns the
+// number of telemetry samples to start on this tick, 0 for none
+unsigned long exciteTick(void);
+unsigned char exciteActive(unsigned int chan);
+// Returns this tick's duty for chan, in pidPos.output direction
+int exciteUpdate(unsigned int chan);
+
+#endif // __EXCITE_H
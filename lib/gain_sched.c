@@ -0,0 +1,123 @@
+/*
+ * Name: gain_sched.c
+ * Desc: Battery sag compensation and velocity gain tables for the leg PIDs
+ *
+ * gainSchedBattUpdate, gainSchedBattScale and gainSchedApply run in the
+ * Timer1 ISR from pidUpdate; the setters run from the command handler.
+ */
+#include "gain_sched.h"
+#include "pid_kernel.h"
+
+static volatile unsigned char battEnable;
+static volatile uint16_t battNominal;
+static int32_t battRatio;               // Q22
+static volatile uint16_t battVbatt;     // last reading, for the seed
+
+static int16_t schedGains[NUM_PIDS][GAIN_SCHED_POINTS][GAIN_SCHED_GAINS];
+static unsigned char schedShift[NUM_PIDS];
+static volatile unsigned char schedEnable[NUM_PIDS];
+
+void gainSchedSetup(void) {
+    unsigned int j;
+    battEnable = 0;
+    battNominal = 0;
+    battRatio = (int32_t) GAIN_SCHED_BATT_ONE << 8;
+    battVbatt = 0;
+    for (j = 0; j < NUM_PIDS; j++) {
+        schedEnable[j] = 0;
+    }
+}
+
+void gainSchedSetBatt(unsigned char enable, unsigned int nominal) {
+    uint16_t vbatt = battVbatt;
+
+    battEnable = 0;
+    battNominal = 0; // the ISR leaves the ratio alone
+    if (nominal > 0 && vbatt > 0) {
+        // start where the servo would settle; the divide is fine here
+        battRatio = pidClamp(((uint32_t) nominal << 22) / vbatt,
+                (int32_t) GAIN_SCHED_BATT_MIN << 8,
+                (int32_t) GAIN_SCHED_BATT_MAX << 8);
+    }
+    battNominal = nominal;
+    battEnable = enable && nominal > 0;
+}
+
+void gainSchedBattUpdate(unsigned int vbatt) {
+    int32_t err;
+
+    battVbatt = vbatt;
+    if (battNominal == 0) {
+        return;
+    }
+    err = (int32_t) battNominal -
+            (int32_t) (PID_MULUU(battRatio >> 8, vbatt) >> 14);
+    battRatio = pidClamp(battRatio + (err << GAIN_SCHED_BATT_SH),
+            (int32_t) GAIN_SCHED_BATT_MIN << 8,
+            (int32_t) GAIN_SCHED_BATT_MAX << 8);
+}
+
+int32_t gainSchedBattScale(int32_t output) {
+    // branch free, like the rest of UpdatePID
+    return PID_SELECT(PID_MASK(battEnable), output,
+            pidMulShr(battRatio >> 8, output, 14));
+}
+
+int gainSchedGetBattRatio(void) {
+    return battRatio >> 8;
+}
+
+int gainSchedLoad(unsigned int chan, unsigned char enable, unsigned char shift,
+        const int16_t *gains) {
+    unsigned int k, g;
+
+    if (chan >= NUM_PIDS || shift > 15) {
+        return -1;
+    }
+    schedEnable[chan] = 0; // the ISR goes back to the commanded gains
+    for (k = 0; k < GAIN_SCHED_POINTS; k++) {
+        for (g = 0; g < GAIN_SCHED_GAINS; g++) {
+            schedGains[chan][k][g] = *gains++;
+        }
+    }
+    schedShift[chan] = shift;
+    schedEnable[chan] = enable;
+    return 0;
+}
+
+// Sets the gains in effect: the commanded ones, or with a table enabled
+// linear between the two points either side of |v_input|, flat past the last
+void gainSchedApply(unsigned int chan, pidPos *pid) {
+    const int16_t *lo, *hi;
+    int16_t frac;
+    unsigned int v, k;
+    int16_t g[GAIN_SCHED_GAINS];
+    unsigned int n;
+
+    if (!schedEnable[chan]) {
+        pid->Kp = pid->setGains[0];
+        pid->Ki = pid->setGains[1];
+        pid->Kd = pid->setGains[2];
+        pid->Kaw = pid->setGains[3];
+        pid->feedforward = pid->setGains[4];
+        return;
+    }
+    v = pid->v_input < 0 ? -pid->v_input : pid->v_input;
+    k = v >> schedShift[chan];
+    if (k >= GAIN_SCHED_POINTS - 1) {
+        k = GAIN_SCHED_POINTS - 1;
+        frac = 0;
+    } else {
+        frac = (v & ((1u << schedShift[chan]) - 1)) << (15 - schedShift[chan]);
+    }
+    lo = schedGains[chan][k];
+    hi = frac ? schedGains[chan][k + 1] : lo;
+    for (n = 0; n < GAIN_SCHED_GAINS; n++) {
+        g[n] = lo[n] + pidMulShr(frac, (int32_t) hi[n] - lo[n], 15);
+    }
+    pid->Kp = g[0];
+    pid->Ki = g[1];
+    pid->Kd = g[2];
+    pid->Kaw = g[3];
+    pid->feedforward = g[4];
+}
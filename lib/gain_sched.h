@@ -0,0 +1,52 @@
+/*
+ * Name: gain_sched.h
+ * Desc: Battery sag compensation and velocity gain tables for the leg PIDs
+ *
+ * Battery compensation scales the controlled PWM output by nominal /
+ * measured battery voltage, so a drained pack gets the duty that a fresh
+ * one would have needed. The ratio is a Q14 servo rather than a divide:
+ *
+ *   ratio += (nominal - ratio * vbatt >> 14) << GAIN_SCHED_BATT_SH    (Q22)
+ *
+ * which settles on nominal / vbatt with a time constant of about
+ * 2^(22 - GAIN_SCHED_BATT_SH) / vbatt ms, long enough to ride through
+ * the sag of a single stride. Setting the nominal voltage seeds the ratio
+ * with nominal / vbatt from the last reading, so it is right from the
+ * first tick, and it tracks from then on but is only applied while
+ * enabled; it is limited to GAIN_SCHED_BATT_MIN..MAX.
+ *
+ * Gain tables hold GAIN_SCHED_POINTS sets of {Kp, Ki, Kd, Kaw, ff} per
+ * channel, spaced 1 << shift A/D units of |v_input| apart. While a table
+ * is enabled, the gains in effect on that channel are interpolated from
+ * it every tick. The ones from CMD_SET_PID_GAINS are kept in
+ * pidPos.setGains and are back in effect from the tick after the table
+ * is disabled.
+ */
+#ifndef __GAIN_SCHED_H
+#define __GAIN_SCHED_H
+
+#include <stdint.h>
+#include "pid-ip2.5.h"
+
+#define GAIN_SCHED_POINTS       8
+#define GAIN_SCHED_GAINS        PID_NUM_GAINS   // Kp, Ki, Kd, Kaw, ff
+
+#define GAIN_SCHED_BATT_SH      3       // ~1.6 s at 330 A/D units
+#define GAIN_SCHED_BATT_ONE     0x4000  // ratio of 1.0, Q14
+#define GAIN_SCHED_BATT_MIN     0x2000  // 0.5
+#define GAIN_SCHED_BATT_MAX     0x6000  // 1.5
+
+void gainSchedSetup(void);
+void gainSchedSetBatt(unsigned char enable, unsigned int nominal);
+void gainSchedBattUpdate(unsigned int vbatt);
+// Returns the output scaled by the battery ratio, saturated, or as is when
+// disabled. UpdatePID applies it to the raw output before the limits
+int32_t gainSchedBattScale(int32_t output);
+int gainSchedGetBattRatio(void);
+// gains holds GAIN_SCHED_POINTS rows of {Kp, Ki, Kd, Kaw, ff}.
+// Returns 0, or -1 for a bad channel or shift
+int gainSchedLoad(unsigned int chan, unsigned char enable, unsigned char shift,
+        const int16_t *gains);
+void gainSchedApply(unsigned int chan, pidPos *pid);
+
+#endif // __GAIN_SCHED_H
@@ -0,0 +1,106 @@
+/*
+ * Name: ilc.c
+ * Desc: Iterative learning control across strides
+ *
+ * ilcUpdate and ilcHold run in the Timer1 ISR from pidSetControl; the
+ * setters run from the command handler. Each bin change does the learning
+ * for the bin just left, so the work is spread over the stride, and the
+ * bin mean uses a reciprocal table instead of a divide.
+ */
+#include "ilc.h"
+#include "pid-ip2.5.h"
+#include "pid_kernel.h"
+#include "utils.h"
+
+#define ILC_BINS_MASK       (ILC_BINS - 1)
+#define ILC_MAX_SAMPLES     16      // per bin mean, older samples fade
+
+// 32767 / n, Q15
+static const int16_t ilcRecip[ILC_MAX_SAMPLES + 1] = {
+    0, 32767, 16384, 10923, 8192, 6554, 5461, 4681, 4096,
+    3641, 3277, 2979, 2731, 2521, 2341, 2185, 2048,
+};
+
+typedef struct {
+    int16_t u[ILC_BINS];            // duty correction per bin
+    int32_t sum;                    // error over the current bin
+    unsigned char count;
+    unsigned char bin;
+    unsigned char tracking;         // bin and sum are valid
+} ilcState;
+
+static ilcState ilc[NUM_PIDS];
+static volatile unsigned char ilcOn;
+static volatile int16_t ilcGain = ILC_GAIN;
+static volatile unsigned char ilcLead = ILC_LEAD;
+static volatile int16_t ilcForget = ILC_FORGET;
+
+void ilcSetup(void) {
+    ilcOn = 0;
+    ilcReset();
+}
+
+void ilcSet(unsigned char enable, int gain, unsigned int lead, unsigned int forget) {
+    ilcOn = 0;
+    ilcGain = gain;
+    ilcLead = lead & ILC_BINS_MASK;
+    ilcForget = forget > 0x7fff ? 0x7fff : forget;
+    ilcOn = enable;
+}
+
+void ilcReset(void) {
+    unsigned int j, k;
+    CRITICAL_SECTION_START;
+    for (j = 0; j < NUM_PIDS; j++) {
+        for (k = 0; k < ILC_BINS; k++) {
+            ilc[j].u[k] = 0;
+        }
+        ilc[j].tracking = 0;
+    }
+    CRITICAL_SECTION_END;
+}
+
+// Learn from the bin just left, and any the leg skipped on its way to next
+static void ilcLearn(ilcState *s, unsigned char next) {
+    int16_t e = pidClamp(pidMulShr(ilcRecip[s->count], s->sum, 15), -0x7fff, 0x7fff);
+    int32_t du = PID_MULSS(ilcGain, e) >> 12;
+    unsigned char steps = (next - s->bin) & ILC_BINS_MASK;
+    unsigned char k;
+    int32_t u;
+
+    for (k = s->bin - ilcLead; steps-- > 0; k++) {
+        k &= ILC_BINS_MASK;
+        u = pidMulShr(ilcForget, pidSatAdd(s->u[k], du), 15);
+        u = (s->u[(k - 1) & ILC_BINS_MASK] + 2 * u + s->u[(k + 1) & ILC_BINS_MASK]) >> 2;
+        s->u[k] = pidClamp(u, -ILC_MAX_CORRECTION, ILC_MAX_CORRECTION);
+    }
+}
+
+int ilcUpdate(unsigned int chan, uint32_t phase, int32_t p_error) {
+    ilcState *s = &ilc[chan];
+    unsigned char bin = phase >> (32 - ILC_BINS_LOG2);
+
+    if (!ilcOn) {
+        s->tracking = 0;
+        return 0;
+    }
+    if (s->tracking && bin != s->bin) {
+        ilcLearn(s, bin);
+    }
+    if (!s->tracking || bin != s->bin) {
+        s->bin = bin;
+        s->sum = 0;
+        s->count = 0;
+        s->tracking = 1;
+    }
+    s->sum += pidClamp(p_error, -0x7fff, 0x7fff);
+    if (++s->count > ILC_MAX_SAMPLES) {
+        s->sum >>= 1;
+        s->count = ILC_MAX_SAMPLES / 2;
+    }
+    return s->u[bin];
+}
+
+void ilcHold(unsigned int chan) {
+    ilc[chan].tracking = 0;
+}
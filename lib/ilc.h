@@ -0,0 +1,44 @@
+/*
+ * Name: ilc.h
+ * Desc: Iterative learning control across strides
+ *
+ * The legs track the same periodic trajectory every stride and make the
+ * same phase dependent errors, from ground contact and the crank
+ * geometry. ILC_BINS bins of stride phase per channel hold a duty
+ * correction that UpdatePID adds to the feedforward. The position error
+ * is averaged over each bin as the leg passes through it, and once the
+ * bin is done it updates the correction `lead` bins earlier, which the
+ * leg will next use a stride later:
+ *
+ *   u[k - lead] = forget * (u[k - lead] + gain * e[k] >> 12)    Q15 forget
+ *
+ * followed by a [1 2 1] / 4 smoothing with its neighbours, which together
+ * with the forgetting factor is the Q filter that keeps learning stable.
+ * The lead makes up for the motor lag, about 10-20 ms, so it grows with
+ * stride frequency: 2-4 bins at 3-5 Hz, 6 at 10-14 Hz. Learning diverges
+ * slowly with too little lead. gain is in pidPos.Kp units. Corrections
+ * are limited to ILC_MAX_CORRECTION duty.
+ */
+#ifndef __ILC_H
+#define __ILC_H
+
+#include <stdint.h>
+
+#define ILC_BINS_LOG2       6
+#define ILC_BINS            (1 << ILC_BINS_LOG2)
+#define ILC_MAX_CORRECTION  2000    // duty
+
+#define ILC_GAIN            1024    // a bit over half the usual Kp
+#define ILC_LEAD            4       // bins, 12.5 ms at 5 Hz
+#define ILC_FORGET          32440   // 0.99
+
+void ilcSetup(void);
+void ilcSet(unsigned char enable, int gain, unsigned int lead, unsigned int forget);
+// Clears the learned corrections of every channel
+void ilcReset(void);
+// Called every PID tick with the leg running; returns the correction
+int ilcUpdate(unsigned int chan, uint32_t phase, int32_t p_error);
+// Called instead while the leg is off, so no partial bin is learned from
+void ilcHold(unsigned int chan);
+
+#endif // __ILC_H
@@ -4,7 +4,11 @@
 #include "uart.h"
 #include "pwm.h"
 #include "ports.h"
-extern unsigned long t1_ticks;
+#include "loop_rate.h"
+
+// Timer1 period for the scheduler tick, FCY (interrupts.h) / 8 prescale
+#define T1_PERIOD   (40000000L / 8 / SCHED_TICK_HZ)
+LOOP_STATIC_ASSERT(T1_PERIOD * 8 * SCHED_TICK_HZ == 40000000L && T1_PERIOD <= 0xffff, t1_period);
 
 
 void SetupADC(void)
@@ -106,9 +110,11 @@ void SetupTimer1(void)
     unsigned int T1CON1value, T1PERvalue;
     T1CON1value = T1_ON & T1_SOURCE_INT & T1_PS_1_8 & T1_GATE_OFF &
                   T1_SYNC_EXT_OFF & T1_INT_PRIOR_2 & T1_IDLE_CON;
-    T1PERvalue = 0x03E8; //clock period = 0.0002s = ((T1PERvalue * prescaler)/FCY) (5000Hz)
-  	t1_ticks = 0;
+    T1PERvalue = T1_PERIOD; //clock period = ((T1PERvalue * prescaler)/FCY), SCHED_TICK_HZ
     OpenTimer1(T1CON1value, T1PERvalue);
+    // T1_INT_PRIOR_* in T1CON does nothing; the ADC pass interrupt in
+    // adc_ring.c must share this priority
+    _T1IP = 4;
 }
 
 void SetupTimer2(void)
@@ -0,0 +1,104 @@
+/*
+ * Name: isr_stats.c
+ * Desc: Execution time statistics for the Timer1 ISR tasks
+ *
+ * isrStatsRecord() is called from inside _T1Interrupt, so it only does
+ * compares, an add and a short shift loop. Means are computed when the
+ * statistics are read out from the main loop.
+ */
+#include "isr_stats.h"
+#include "utils.h"
+
+typedef struct {
+    unsigned long count;
+    unsigned long sum;
+    unsigned int min;
+    unsigned int max;
+    unsigned int overruns;
+    unsigned int shed;
+    unsigned int hist[ISR_STATS_HIST_BINS];
+} isrSlotStats;
+
+static isrSlotStats isrStats[ISR_STATS_NUM];
+
+static void isrStatsClear(isrSlotStats *s) {
+    unsigned int k;
+    s->count = 0;
+    s->sum = 0;
+    s->min = 0xffff;
+    s->max = 0;
+    s->overruns = 0;
+    s->shed = 0;
+    for (k = 0; k < ISR_STATS_HIST_BINS; k++) {
+        s->hist[k] = 0;
+    }
+}
+
+void isrStatsReset(void) {
+    unsigned int i;
+    CRITICAL_SECTION_START;
+    for (i = 0; i < ISR_STATS_NUM; i++) {
+        isrStatsClear(&isrStats[i]);
+    }
+    CRITICAL_SECTION_END;
+}
+
+void isrStatsRecord(unsigned int slot, unsigned long ticks) {
+    isrSlotStats *s;
+    unsigned int t, bin;
+
+    if (slot >= ISR_STATS_NUM) {
+        return;
+    }
+    s = &isrStats[slot];
+    t = (ticks > 0xffff) ? 0xffff : (unsigned int) ticks;
+
+    s->count++;
+    s->sum += t;
+    if (t < s->min) s->min = t;
+    if (t > s->max) s->max = t;
+
+    bin = 0;
+    while (t != 0 && bin < ISR_STATS_HIST_BINS - 1) {
+        t >>= 1;
+        bin++;
+    }
+    if (s->hist[bin] != 0xffff) { // saturate rather than wrap
+        s->hist[bin]++;
+    }
+}
+
+void isrStatsOverrun(unsigned int slot) {
+    if (slot < ISR_STATS_NUM && isrStats[slot].overruns != 0xffff) {
+        isrStats[slot].overruns++;
+    }
+}
+
+void isrStatsShed(unsigned int slot) {
+    if (slot < ISR_STATS_NUM && isrStats[slot].shed != 0xffff) {
+        isrStats[slot].shed++;
+    }
+}
+
+// Copy out all entries and clear them, atomically with respect to the ISR
+void isrStatsSnapshot(isrStatsReport_t *reports) {
+    unsigned int i, k;
+    isrSlotStats *s;
+
+    CRITICAL_SECTION_START;
+    for (i = 0; i < ISR_STATS_NUM; i++) {
+        s = &isrStats[i];
+        reports[i].slot = i;
+        reports[i].count = s->count;
+        reports[i].min = (s->count != 0) ? s->min : 0;
+        reports[i].max = s->max;
+        reports[i].mean = (s->count != 0) ? (uint16_t) (s->sum / s->count) : 0;
+        reports[i].overruns = s->overruns;
+        reports[i].shed = s->shed;
+        for (k = 0; k < ISR_STATS_HIST_BINS; k++) {
+            reports[i].hist[k] = s->hist[k];
+        }
+        isrStatsClear(s);
+    }
+    CRITICAL_SECTION_END;
+}
@@ -0,0 +1,38 @@
+/*
+ * Name: isr_stats.h
+ * Desc: Execution time statistics for the Timer1 ISR tasks
+ *
+ * Entries 0 .. schedNumTasks()-1 follow the task table in sched.c.
+ * Times are in timebase ticks (microseconds), see timebase.h. Each entry
+ * keeps min/max/sum and a log2 histogram: bin 0 counts zero-length
+ * samples, bin k counts samples with 2^(k-1) <= t < 2^k, and the last
+ * bin also collects everything longer.
+ */
+#ifndef __ISR_STATS_H
+#define __ISR_STATS_H
+
+#include <stdint.h>
+
+#define ISR_STATS_NUM           8
+#define ISR_STATS_STATE_READ    7   // sensor read section of pidGetState
+#define ISR_STATS_HIST_BINS     16
+
+// One report per entry, sent as a CMD_GET_ISR_STATS packet
+typedef struct {
+    uint16_t slot;
+    uint16_t min;
+    uint16_t max;
+    uint16_t mean;
+    uint16_t overruns;          // runs longer than the task budget
+    uint16_t shed;              // runs skipped by the scheduler
+    uint32_t count;
+    uint16_t hist[ISR_STATS_HIST_BINS];
+} isrStatsReport_t;
+
+void isrStatsReset(void);
+void isrStatsRecord(unsigned int slot, unsigned long ticks);
+void isrStatsOverrun(unsigned int slot);
+void isrStatsShed(unsigned int slot);
+void isrStatsSnapshot(isrStatsReport_t *reports);
+
+#endif // __ISR_STATS_H
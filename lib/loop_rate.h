@@ -0,0 +1,56 @@
+/*
+ * Name: loop_rate.h
+ * Desc: Build time PID loop rate and the constants derived from it
+ *
+ * PID_LOOP_HZ, 1000, 2000 or 4000, is the one setting; define it in
+ * settings.h to change it. Everything that counts PID ticks derives its
+ * scale from PID_TICK_SHIFT here, so the command interface keeps ms units
+ * at any rate: gait periods, run times, spindown, autotune and excitation
+ * times are converted to ticks on the way in, velocities stay per ms
+ * (K_EMF), and the integrator and per tick differences are rescaled.
+ *
+ * The outer loops (yaw rate, phase lock, battery compensation) and
+ * telemetry stay at 1 kHz, on the first PID tick of each ms.
+ *
+ * Timer1 runs the scheduler at PID_LOOP_HZ * SCHED_SLOTS, SCHED_SLOTS
+ * ticks per PID period, see sched.c.
+ */
+#ifndef __LOOP_RATE_H
+#define __LOOP_RATE_H
+
+#include "settings.h"
+
+#ifndef PID_LOOP_HZ
+#define PID_LOOP_HZ         1000
+#endif
+
+#if PID_LOOP_HZ == 1000
+#define PID_TICK_SHIFT      0
+#define SCHED_SLOTS         5       // 5 kHz Timer1, as before
+#elif PID_LOOP_HZ == 2000
+#define PID_TICK_SHIFT      1
+#define SCHED_SLOTS         4       // 8 kHz Timer1
+#elif PID_LOOP_HZ == 4000
+#define PID_TICK_SHIFT      2
+#define SCHED_SLOTS         2       // 8 kHz Timer1
+#else
+#error "PID_LOOP_HZ must be 1000, 2000 or 4000"
+#endif
+
+#define PID_TICKS_PER_MS    (1 << PID_TICK_SHIFT)
+#define PID_TICK_US         (1000 / PID_TICKS_PER_MS)
+
+#define SCHED_TICK_HZ       (PID_LOOP_HZ * SCHED_SLOTS)
+#define SCHED_TICKS_PER_MS  (SCHED_TICK_HZ / 1000)
+#define SCHED_TICK_PERIOD_US (1000000L / SCHED_TICK_HZ)
+
+// Compile time check of a derived constant, name must be unique
+#define LOOP_STATIC_ASSERT(cond, name) \
+    typedef char loop_static_assert_##name[(cond) ? 1 : -1]
+
+LOOP_STATIC_ASSERT(PID_LOOP_HZ == 1000L * PID_TICKS_PER_MS, pid_ticks_per_ms);
+LOOP_STATIC_ASSERT(SCHED_TICK_HZ == 1000L * SCHED_TICKS_PER_MS, sched_ticks_per_ms);
+LOOP_STATIC_ASSERT(SCHED_TICK_PERIOD_US * SCHED_TICK_HZ == 1000000L, sched_period_exact);
+LOOP_STATIC_ASSERT(PID_TICK_US * PID_TICKS_PER_MS == 1000, pid_tick_exact);
+
+#endif // __LOOP_RATE_H
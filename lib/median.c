@@ -0,0 +1,65 @@
+/*
+ * Name: median.c
+ * Desc: Running median over a small ring buffer, for back EMF
+ *
+ * Networks from J. Devillard, "Fast median search: an ANSI C
+ * implementation", 1998.
+ */
+#include "median.h"
+
+// Order a <= b without branching
+#define MEDIAN_CE(a, b) { \
+    int d_ = (b) - (a); \
+    d_ &= d_ >> (8 * sizeof(int) - 1); \
+    (a) += d_; \
+    (b) -= d_; \
+}
+
+int medianOf3(int *p) {
+    MEDIAN_CE(p[0], p[1]); MEDIAN_CE(p[1], p[2]); MEDIAN_CE(p[0], p[1]);
+    return p[1];
+}
+
+int medianOf5(int *p) {
+    MEDIAN_CE(p[0], p[1]); MEDIAN_CE(p[3], p[4]); MEDIAN_CE(p[0], p[3]);
+    MEDIAN_CE(p[1], p[4]); MEDIAN_CE(p[1], p[2]); MEDIAN_CE(p[2], p[3]);
+    MEDIAN_CE(p[1], p[2]);
+    return p[2];
+}
+
+int medianOf7(int *p) {
+    MEDIAN_CE(p[0], p[5]); MEDIAN_CE(p[0], p[3]); MEDIAN_CE(p[1], p[6]);
+    MEDIAN_CE(p[2], p[4]); MEDIAN_CE(p[0], p[1]); MEDIAN_CE(p[3], p[5]);
+    MEDIAN_CE(p[2], p[6]); MEDIAN_CE(p[2], p[3]); MEDIAN_CE(p[3], p[6]);
+    MEDIAN_CE(p[4], p[5]); MEDIAN_CE(p[1], p[4]); MEDIAN_CE(p[1], p[3]);
+    MEDIAN_CE(p[3], p[4]);
+    return p[3];
+}
+
+void medianInit(medianFilter *f, int value) {
+    unsigned int k;
+    for (k = 0; k < BEMF_MEDIAN_WINDOW; k++) {
+        f->buf[k] = value;
+    }
+    f->head = 0;
+}
+
+int medianUpdate(medianFilter *f, int sample) {
+    int w[BEMF_MEDIAN_WINDOW];
+    unsigned int k;
+
+    f->buf[f->head] = sample;
+    if (++f->head == BEMF_MEDIAN_WINDOW) {
+        f->head = 0;
+    }
+    for (k = 0; k < BEMF_MEDIAN_WINDOW; k++) {
+        w[k] = f->buf[k];
+    }
+#if BEMF_MEDIAN_WINDOW == 3
+    return medianOf3(w);
+#elif BEMF_MEDIAN_WINDOW == 5
+    return medianOf5(w);
+#else
+    return medianOf7(w);
+#endif
+}
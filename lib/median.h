@@ -0,0 +1,41 @@
+/*
+ * Name: median.h
+ * Desc: Running median over a small ring buffer, for back EMF
+ *
+ * The window is fixed at compile time by BEMF_MEDIAN_WINDOW (3, 5 or 7),
+ * set per robot in settings.h. Longer windows reject the brush short
+ * dropouts at the cost of (window - 1) / 2 samples of delay on steps.
+ *
+ * The medians use the minimal compare-exchange networks (3, 7 and 13
+ * exchanges). Each exchange is a subtract, shift and mask, with no
+ * branches, so samples must stay within +-16383 for the difference to fit
+ * in a 16 bit int. Back EMF readings are within +-1023.
+ */
+#ifndef __MEDIAN_H
+#define __MEDIAN_H
+
+#include "settings.h"
+
+#ifndef BEMF_MEDIAN_WINDOW
+#define BEMF_MEDIAN_WINDOW  3
+#endif
+
+#if BEMF_MEDIAN_WINDOW != 3 && BEMF_MEDIAN_WINDOW != 5 && BEMF_MEDIAN_WINDOW != 7
+#error "BEMF_MEDIAN_WINDOW must be 3, 5 or 7"
+#endif
+
+typedef struct {
+    int buf[BEMF_MEDIAN_WINDOW];
+    unsigned char head;
+} medianFilter;
+
+void medianInit(medianFilter *f, int value);
+// Add a sample and return the median of the last BEMF_MEDIAN_WINDOW
+int medianUpdate(medianFilter *f, int sample);
+
+// Median of p[0..n-1], reorders p
+int medianOf3(int *p);
+int medianOf5(int *p);
+int medianOf7(int *p);
+
+#endif // __MEDIAN_H
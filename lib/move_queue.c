@@ -0,0 +1,104 @@
+/*
+ * Name: move_queue.c
+ * Desc: On-robot queue of timed gait segments
+ *
+ * moveQueueAdd and moveQueueClear run from the command handler,
+ * moveQueueNext from the Timer1 ISR. Indices run free and are masked on
+ * use; each leg keeps its own read index, and a slot is only reused once
+ * every leg has moved past it.
+ */
+#include <stddef.h>
+#include "move_queue.h"
+#include "utils.h"
+
+#if MOVE_QUEUE_LEN & (MOVE_QUEUE_LEN - 1) || MOVE_QUEUE_LEN > 128
+#error "MOVE_QUEUE_LEN must be a power of 2, at most 128"
+#endif
+#define MOVE_QUEUE_MASK     (MOVE_QUEUE_LEN - 1)
+
+static moveSegment moveRing[MOVE_QUEUE_LEN];
+static volatile unsigned char moveHead;             // next slot to write
+static volatile unsigned char moveTail[NUM_PIDS];   // segment each leg is on
+static volatile unsigned char moveRunning[NUM_PIDS];
+static uint16_t moveLeft[NUM_PIDS];                 // strides or ms to go
+
+void moveQueueSetup(void) {
+    moveQueueClear();
+}
+
+// Legs keep the table and period of the segment they were on
+void moveQueueClear(void) {
+    unsigned int j;
+    CRITICAL_SECTION_START;
+    moveHead = 0;
+    for (j = 0; j < NUM_PIDS; j++) {
+        moveTail[j] = 0;
+        moveRunning[j] = 0;
+    }
+    CRITICAL_SECTION_END;
+}
+
+static unsigned char moveQueueUsed(void) {
+    unsigned char used = 0, n;
+    unsigned int j;
+    for (j = 0; j < NUM_PIDS; j++) {
+        n = moveHead - moveTail[j];
+        if (n > used) {
+            used = n;
+        }
+    }
+    return used;
+}
+
+int moveQueueAdd(const int *period, int phase, unsigned int count,
+        unsigned char flags) {
+    moveSegment *seg;
+    unsigned int j;
+
+    if (flags & MOVE_FLUSH) {
+        moveQueueClear();
+    }
+    if (moveQueueUsed() >= MOVE_QUEUE_LEN) {
+        return -1;
+    }
+    seg = &moveRing[moveHead & MOVE_QUEUE_MASK];
+    for (j = 0; j < NUM_PIDS; j++) {
+        seg->period[j] = period[j] > 0 ? period[j] : 0;
+        pidGaitTiming(seg->period[j], &seg->phase_step[j], &seg->vel_q8[j]);
+    }
+    seg->phase = phase;
+    seg->count = count > 0 ? count : 1;
+    seg->flags = flags & ~MOVE_FLUSH;
+    moveHead++; // publish to the ISR only once the slot is written
+    return moveQueueUsed();
+}
+
+const moveSegment* moveQueueNext(unsigned int chan, unsigned int stride_ms) {
+    const moveSegment *seg;
+
+    if (moveRunning[chan]) {
+        seg = &moveRing[moveTail[chan] & MOVE_QUEUE_MASK];
+        if (seg->flags & MOVE_DURATION) {
+            moveLeft[chan] = moveLeft[chan] > stride_ms ?
+                    moveLeft[chan] - stride_ms : 0;
+        } else {
+            moveLeft[chan]--;
+        }
+        if (moveLeft[chan] > 0) {
+            return NULL;
+        }
+        moveTail[chan]++;
+        moveRunning[chan] = 0;
+    }
+    if (moveTail[chan] == moveHead) {
+        return NULL; // queue drained, the leg carries on as it is
+    }
+    seg = &moveRing[moveTail[chan] & MOVE_QUEUE_MASK];
+    moveLeft[chan] = seg->count;
+    moveRunning[chan] = 1;
+    return seg;
+}
+
+unsigned char moveQueueActive(unsigned int chan) {
+    return moveRunning[chan];
+}
@@ -0,0 +1,51 @@
+/*
+ * Name: move_queue.h
+ * Desc: On-robot queue of timed gait segments
+ *
+ * The host queues a whole maneuver up front. Each leg works through the
+ * segments on its own stride boundaries, from checkSwapBuff, so radio
+ * latency no longer shifts where a segment starts. A segment can swap to
+ * the standby gait table, set the stride period of each leg and re-phase
+ * the legs, and lasts a number of strides or at least a number of ms.
+ * While a leg runs the queue, profile swaps from CMD_SET_VEL_PROFILE and
+ * CMD_SET_GAIT_TABLE wait until it is done, so tables can be uploaded
+ * into the standby buffer ahead of the segment that swaps to them. A swap
+ * that comes while that upload is still arriving keeps the current table,
+ * and is counted in the next CMD_SET_MOVE_QUEUE reply.
+ */
+#ifndef __MOVE_QUEUE_H
+#define __MOVE_QUEUE_H
+
+#include <stdint.h>
+#include "pid-ip2.5.h"
+
+#ifndef MOVE_QUEUE_LEN
+#define MOVE_QUEUE_LEN      16      // segments, power of 2
+#endif
+
+// segment flags
+#define MOVE_SWAP_TABLE     0x01    // switch to the standby gait table
+#define MOVE_SET_PHASE      0x02    // set the left - right leg phase
+#define MOVE_DURATION       0x04    // count is ms rather than strides
+#define MOVE_FLUSH          0x80    // drop queued segments before this one
+
+typedef struct {
+    int16_t period[NUM_PIDS];       // ms per stride, 0 keeps the current
+    uint32_t phase_step[NUM_PIDS];  // precomputed by pidGaitTiming
+    int32_t vel_q8[NUM_PIDS];
+    int16_t phase;                  // left - right, 0x10000 per rev
+    uint16_t count;                 // strides, or ms with MOVE_DURATION
+    unsigned char flags;
+} moveSegment;
+
+void moveQueueSetup(void);
+void moveQueueClear(void);
+// Returns the number of segments queued, or -1 if the queue is full
+int moveQueueAdd(const int *period, int phase, unsigned int count,
+        unsigned char flags);
+// Called at each stride boundary of chan with the length of the stride
+// just finished; returns a segment to start now, or NULL
+const moveSegment* moveQueueNext(unsigned int chan, unsigned int stride_ms);
+unsigned char moveQueueActive(unsigned int chan);
+
+#endif // __MOVE_QUEUE_H
@@ -0,0 +1,58 @@
+/*
+ * Name: phase_lock.c
+ * Desc: Left/right leg phase locking loop
+ *
+ * phaseLockUpdate runs in the Timer1 ISR from pidUpdate; the setters run
+ * from the command handler.
+ */
+#include "phase_lock.h"
+#include "pid_kernel.h"
+
+static volatile unsigned char phaseLockOn;
+static volatile int16_t phaseLockTarget = 0x8000;  // alternating tripod
+static volatile int16_t phaseLockKp = PHASE_LOCK_KP;
+static volatile int16_t phaseLockKi = PHASE_LOCK_KI;
+static int32_t phaseLockSum;
+static int16_t phaseLockErr;
+
+void phaseLockSetup(void) {
+    phaseLockOn = 0;
+    phaseLockReset();
+}
+
+void phaseLockSet(unsigned char enable, int target, int Kp, int Ki) {
+    phaseLockOn = 0;
+    phaseLockTarget = target;
+    phaseLockKp = Kp;
+    phaseLockKi = Ki;
+    phaseLockReset();
+    phaseLockOn = enable;
+}
+
+void phaseLockSetTarget(int target) {
+    phaseLockTarget = target;
+}
+
+void phaseLockReset(void) {
+    phaseLockSum = 0;
+}
+
+int phaseLockUpdate(long posL, long posR) {
+    int32_t step, limited;
+
+    phaseLockErr = (int16_t) (phaseLockTarget - (int16_t) (posL - posR));
+    if (!phaseLockOn) {
+        return 0;
+    }
+    step = pidSatAdd(pidMulShr(phaseLockKp, phaseLockErr, 16),
+            pidMulShr(phaseLockKi, phaseLockSum >> 8, 16));
+    limited = pidClamp(step, -PHASE_LOCK_MAX_STEP, PHASE_LOCK_MAX_STEP);
+    if (limited == step) { // no integration while the step is limited
+        phaseLockSum = pidSatAdd(phaseLockSum, phaseLockErr);
+    }
+    return (int) limited;
+}
+
+int phaseLockGetError(void) {
+    return phaseLockErr;
+}
@@ -0,0 +1,32 @@
+/*
+ * Name: phase_lock.h
+ * Desc: Left/right leg phase locking loop
+ *
+ * Runs once per ms while both legs are on. The error is the target
+ * left - right offset minus the measured one, taken from the unwrapped
+ * leg positions modulo one revolution (0x10000), the short way round. A
+ * PI law turns it into a setpoint step per ms, split between the two
+ * p_inputs like CMD_SET_PHASE does. The loop acts on stride rate, so the
+ * proportional gain alone holds a constant offset; the integral removes
+ * the lag when the legs are commanded at slightly different rates.
+ *
+ *   step = Kp * err >> 16 + Ki * sum(err) >> 24, at most PHASE_LOCK_MAX_STEP
+ */
+#ifndef __PHASE_LOCK_H
+#define __PHASE_LOCK_H
+
+#include <stdint.h>
+
+#define PHASE_LOCK_KP           512     // ~128 ms time constant
+#define PHASE_LOCK_KI           512     // ~0.7 damping with the default Kp
+#define PHASE_LOCK_MAX_STEP     64      // p_state units per ms, ~1 rev/s
+
+void phaseLockSetup(void);
+void phaseLockSet(unsigned char enable, int target, int Kp, int Ki);
+void phaseLockSetTarget(int target);
+void phaseLockReset(void);
+// Returns the step to add to the left leg setpoint, less the right one
+int phaseLockUpdate(long posL, long posR);
+int phaseLockGetError(void);
+
+#endif // __PHASE_LOCK_H
@@ -18,6 +18,7 @@
 #include "led.h"
 #include "adc.h"
 #include "sclock.h"
+#include "timebase.h"
 #include "ams-enc.h"
 #include "tih.h"
 #include "mpu6000.h"
@@ -25,6 +26,20 @@
 #include "ppool.h"
 #include "dfmem.h"
 #include "telem.h"
+#include "telem_comp.h"
+#include "isr_stats.h"
+#include "sched.h"
+#include "pid_kernel.h"
+#include "adc_ring.h"
+#include "vel_obs.h"
+#include "median.h"
+#include "move_queue.h"
+#include "phase_lock.h"
+#include "steering.h"
+#include "gain_sched.h"
+#include "autotune.h"
+#include "excite.h"
+#include "ilc.h"
 
 #include <stdlib.h> // for malloc
 #include "init.h"  // for Timer1
@@ -46,28 +61,42 @@
 
 // PID control structure
 pidPos pidObjs[NUM_PIDS];
+static const pidChannelConfig pidChannels[NUM_PIDS] = PID_CHANNEL_CONFIG;
 
 // structure for reference velocity for leg
 pidVelLUT pidVel[NUM_PIDS*NUM_BUFF];
 pidVelLUT* activePID[NUM_PIDS]; //Pointer arrays for stride buffering
 pidVelLUT* nextPID[NUM_PIDS];
-
-#define T1_MAX 0xffffff  // max before rollover of 1 ms counter
-// may be glitch in longer missions at rollover
-volatile unsigned long t1_ticks;
-unsigned long lastMoveTime;
+static unsigned int gaitLoaded[NUM_PIDS]; // points received by pidLoadGaitTable
+// standby buffer part written by pidLoadGaitTable, not to be swapped in
+static volatile unsigned char gaitLoading[NUM_PIDS];
+static volatile unsigned int swapsHeld; // MOVE_SWAP_TABLE segments that found it so
+
+static unsigned char pidSubTick; // PID ticks into the current ms
+static unsigned char pidMsTick;  // this PID tick runs the 1 kHz outer loops
+static timebaseTime lastMoveTime; // end of the timed run, see pidStartTimedTrial
 int seqIndex;
 
 //for battery voltage:
-char calib_flag = 0; // flag is set if doing calibration
-long offsetAccumulatorL, offsetAccumulatorR;
-unsigned int offsetAccumulatorCounter;
-
-// 2 last readings for median filter
-int measLast1[NUM_PIDS];
-int measLast2[NUM_PIDS];
+#define PID_CALIB_SAMPLES_LOG2  7
+#define PID_CALIB_SAMPLES       (1 << PID_CALIB_SAMPLES_LOG2)
+volatile char calib_flag = 0; // flag is set if doing calibration
+long offsetAccumulator[NUM_PIDS];
+volatile unsigned int offsetAccumulatorCounter;
+static volatile unsigned int calibSpindown; // ticks left before sampling
+
+// back emf median filter history, BEMF_MEDIAN_WINDOW readings
+static medianFilter bemfMedian[NUM_PIDS];
 int bemf[NUM_PIDS];
 
+// sensor sample times and ages, see pidSetLatencyComp
+static volatile timebaseTime encReadTime, imuReadTime;
+static timebaseTime ctrlTime;               // this tick's control instant
+static uint16_t sampleAge[PID_NUM_SENSORS];
+static int bemfPrev[NUM_PIDS], gyroPrev;
+static volatile unsigned char latencyMask = PID_LATENCY_DEFAULT;
+static volatile uint16_t ctrlDelay = PID_CTRL_DELAY_US;
+
 
 // -------------------------------------------
 // called from main()
@@ -78,28 +107,32 @@ void pidSetup() {
         initPIDObjPos(&(pidObjs[i]), DEFAULT_KP, DEFAULT_KI, DEFAULT_KD, DEFAULT_KAW, DEFAULT_FF);
     }
     initPIDVelProfile();
+    isrStatsReset();
+    velObsSetup();
+    moveQueueSetup();
+    phaseLockSetup();
+    steeringSetup();
+    gainSchedSetup();
+    autotuneSetup();
+    exciteSetup();
+    ilcSetup();
+    schedSetup();
     SetupTimer1(); // main interrupt used for leg motor PID
 
-    lastMoveTime = 0;
+    lastMoveTime = timebaseNow();
 
-    //TODO: This should be generalized fo there is no sense of "left" and "right" here
-    pidObjs[LEFT_LEGS_PID_NUM].output_channel  = LEFT_LEGS_TIH_CHAN;
-    pidObjs[LEFT_LEGS_PID_NUM].p_state_flip    = LEFT_LEGS_ENC_FLIP;
-    pidObjs[LEFT_LEGS_PID_NUM].encoder_num     = LEFT_LEGS_ENC_NUM;
-    pidObjs[LEFT_LEGS_PID_NUM].pwm_flip        = LEFT_LEGS_PWM_FLIP;
-
-    pidObjs[RIGHT_LEGS_PID_NUM].output_channel = RIGHT_LEGS_TIH_CHAN;
-    pidObjs[RIGHT_LEGS_PID_NUM].p_state_flip   = RIGHT_LEGS_FLIP;
-    pidObjs[RIGHT_LEGS_PID_NUM].encoder_num    = RIGHT_LEGS_ENC_NUM;
-    pidObjs[RIGHT_LEGS_PID_NUM].pwm_flip       = RIGHT_LEGS_PWM_FLIP;
-
-    // Initialize PID structures before starting Timer1
-    pidSetInput(LEFT_LEGS_PID_NUM, 0);
-    pidSetInput(RIGHT_LEGS_PID_NUM, 0);
+    for (i = 0; i < NUM_PIDS; i++) {
+        pidObjs[i].output_channel = pidChannels[i].output_channel;
+        pidObjs[i].p_state_flip   = pidChannels[i].p_state_flip;
+        pidObjs[i].encoder_num    = pidChannels[i].encoder_num;
+        pidObjs[i].pwm_flip       = pidChannels[i].pwm_flip;
+        // Initialize PID structures before starting Timer1
+        pidSetInput(i, 0);
+    }
 
     EnableIntT1; // turn on pid interrupts
 
-    calibBatteryOffset(100); //???This is broken for 2.5
+    calibBatteryOffset(100);
 }
 
 
@@ -113,49 +146,135 @@ pidVelLUT* otherBuff(pidVelLUT* array, pidVelLUT* ptr) {
     }
 }
 
+// Phase step and velocity scale (per table point, Q8) for a stride period.
+// Does the divides, so only from command context; the ISR then needs one
+// multiply by num_points to retime a table, see pidStartSegment
+void pidGaitTiming(int period, uint32_t *phase_step, int32_t *vel_q8) {
+    if (period < 1) {
+        period = 1;
+    }
+    // wraps after exactly period ms for any period below 2^16 / PID_TICKS_PER_MS
+    *phase_step = 0xffffffffUL / ((unsigned long) period << PID_TICK_SHIFT) + 1;
+    *vel_q8 = ((long) K_EMF * 1024 * 256 + period / 2) / period;
+}
+
+static void gaitSetTiming(pidVelLUT *lut, int period, uint32_t phase_step,
+        int32_t vel_q8) {
+    lut->period = period;
+    lut->phase_step = phase_step;
+    lut->vel_scale = (int32_t) (((unsigned long) lut->num_points * (uint32_t) vel_q8) >> 8);
+}
+
+// Precompute the segment slopes and the phase and velocity scales once a
+// table is complete, so pidGetSetpoint does no division
+static void gaitFinish(pidVelLUT *lut, unsigned int num_points, int period,
+        int stride, int onceFlag) {
+    unsigned int k;
+    int16_t base = lut->pos[0];
+    uint32_t phase_step;
+    int32_t vel_q8;
+
+    if (period < 1) {
+        period = 1;
+    }
+    for (k = 0; k < num_points; k++) {
+        lut->pos[k] -= base;
+    }
+    for (k = 0; k + 1 < num_points; k++) {
+        lut->slope[k] = lut->pos[k + 1] - lut->pos[k];
+    }
+    lut->slope[num_points - 1] = stride - lut->pos[num_points - 1];
+    lut->num_points = num_points;
+    pidGaitTiming(period, &phase_step, &vel_q8);
+    gaitSetTiming(lut, period, phase_step, vel_q8);
+    lut->stride = (long) stride << 2;
+    lut->onceFlag = onceFlag;
+}
+
 // ----------   all the initializations  -------------------------
-// set expire time for first segment in pidSetInput - use start time from MoveClosedLoop
-// set points and velocities for one revolution of leg
+// gait tables start out standing still, with 400 ms strides
 // called from pidSetup()
 
 void initPIDVelProfile() {
     int i, j;
-    pidVelLUT* tempPID;
+    for (i = 0; i < NUM_PIDS * NUM_BUFF; i++) {
+        for (j = 0; j < NUM_VELS; j++) {
+            pidVel[i].pos[j] = 0;
+        }
+        gaitFinish(&pidVel[i], NUM_VELS, 400, 0, 0);
+    }
     for (j = 0; j < NUM_PIDS; j++) {
-        pidObjs[j].index = 0; // point to first velocity
+        pidObjs[j].index = 0; // point to first segment
+        pidObjs[j].phase = 0;
         pidObjs[j].interpolate = 0;
         pidObjs[j].leg_stride = 0; // set initial leg count
         activePID[j] = &(pidVel[j]); //Initialize buffer pointers
-        nextPID[j] = NULL;
-        tempPID = otherBuff(pidVel, activePID[j]);
-        for (i = 0; i < NUM_VELS; i++) {
-            tempPID->interval[i] = 100;
-            tempPID->delta[i] = 0;
-            tempPID->vel[i] = 0;
-        }
-        tempPID->onceFlag = 0;
-        nextPID[j] = tempPID;
+        nextPID[j] = otherBuff(pidVel, activePID[j]);
+        gaitLoaded[j] = 0;
+        gaitLoading[j] = 0;
         pidObjs[j].p_input = 0; // initialize first set point 
-        pidObjs[j].v_input = (int) (((long) pidVel[j].vel[0] * K_EMF) >> 8); //initialize first velocity, scaled
+        pidObjs[j].v_input = 0;
     }
 }
 
 
-// called from cmd.c
+/* called from cmd.c
+ * Loads points [start, start + count) of a num_points gait table into the
+ * inactive buffer. Chunks must arrive in order from start = 0; the table
+ * is queued for the next stride boundary once the last point is in.
+ * Returns the number of points loaded so far, or -1 if the chunk does not
+ * fit. A chunk out of order is ignored, and the return value says where
+ * to resume. */
 
-void setPIDVelProfile(int pid_num, int *interval, int *delta, int *vel, int onceFlag) {
+int pidLoadGaitTable(unsigned int pid_num, unsigned int num_points,
+        unsigned int start, unsigned int count, const int16_t *points,
+        int period, int stride, int onceFlag) {
     pidVelLUT* tempPID;
-    int i;
+    unsigned int i;
+
+    if (pid_num >= NUM_PIDS || num_points < 2 || num_points > GAIT_MAX_POINTS ||
+            start + count > num_points) {
+        return -1;
+    }
+    CRITICAL_SECTION_START;
     tempPID = otherBuff(pidVel, activePID[pid_num]);
-    for (i = 0; i < NUM_VELS; i++) {
-        tempPID->interval[i] = interval[i];
-        tempPID->delta[i] = delta[i];
-        tempPID->vel[i] = vel[i];
+    if (start == 0) {
+        // keep the ISR off it while it is written
+        if (nextPID[pid_num] == tempPID) {
+            nextPID[pid_num] = NULL;
+        }
+        gaitLoading[pid_num] = 1;
+    }
+    CRITICAL_SECTION_END;
+    if (start == 0) {
+        gaitLoaded[pid_num] = 0;
+    } else if (start != gaitLoaded[pid_num]) {
+        return gaitLoaded[pid_num];
+    }
+
+    for (i = 0; i < count; i++) {
+        tempPID->pos[start + i] = points[i];
     }
-    tempPID->onceFlag = onceFlag;
-    if (activePID[pid_num]->onceFlag == 0) {
+    gaitLoaded[pid_num] = start + count;
+    if (gaitLoaded[pid_num] == num_points) {
+        gaitFinish(tempPID, num_points, period, stride, onceFlag);
+        CRITICAL_SECTION_START;
         nextPID[pid_num] = tempPID;
+        gaitLoading[pid_num] = 0;
+        CRITICAL_SECTION_END;
     }
+    return gaitLoaded[pid_num];
+}
+
+// MOVE_SWAP_TABLE segments that kept the current table since the last call,
+// because the standby table was still being uploaded
+unsigned int pidGetSwapsHeld(void) {
+    unsigned int held;
+    CRITICAL_SECTION_START;
+    held = swapsHeld;
+    swapsHeld = 0;
+    CRITICAL_SECTION_END;
+    return held;
 }
 
 
@@ -172,12 +291,24 @@ void initPIDObjPos(pidPos *pid, int Kp, int Ki, int Kd, int Kaw, int ff) {
     pid->Kd = Kd;
     pid->Kaw = Kaw;
     pid->feedforward = 0;
+    pid->setGains[0] = Kp;
+    pid->setGains[1] = Ki;
+    pid->setGains[2] = Kd;
+    pid->setGains[3] = Kaw;
+    pid->setGains[4] = 0;
+    pid->ff_ilc = 0;
     pid->output = 0;
+    pid->minDC = -MAXTHROT;
+    pid->maxDC = MAXTHROT;
+    pid->slew = 0;
+    pid->satFlags = 0;
     pid->onoff = 0;
     pid->p_error = 0;
     pid->v_error = 0;
     pid->i_error = 0;
 
+    pid->rate_trim = 0;
+
     pid->p_state_flip = 0; //default to no flip
     pid->output_channel = 0;
 }
@@ -187,51 +318,54 @@ void initPIDObjPos(pidPos *pid, int Kp, int Ki, int Kd, int Kaw, int ff) {
 // called from set thrust closed loop, etc. Thrust
 
 void pidSetInput(int pid_num, int input_val) {
-    unsigned long temp;
     /*      ******   use velocity setpoint + throttle for compatibility between Hall and Pullin code *****/
     /* otherwise, miss first velocity set point */
-    pidObjs[pid_num].v_input = input_val + (int) (((long) pidVel[pid_num].vel[0] * K_EMF) >> 8); //initialize first velocity ;
-    pidObjs[pid_num].start_time = t1_ticks;
+    pidObjs[pid_num].v_input = input_val +
+            (int) pidMulShr(activePID[pid_num]->slope[0], activePID[pid_num]->vel_scale, 16); //initialize first velocity
     //zero out running PID values
     pidObjs[pid_num].i_error = 0;
     pidObjs[pid_num].p = 0;
     pidObjs[pid_num].i = 0;
     pidObjs[pid_num].d = 0;
     //Seed the median filter
-    measLast1[pid_num] = input_val;
-    measLast2[pid_num] = input_val;
-
-    // set initial time for next move set point
-    /*   need to set index =0 initial values */
-    /* position setpoints start at 0 (index=0), then interpolate until setpoint 1 (index =1), etc */
-    temp = 0;
-    pidObjs[pid_num].expire = temp + (long) pidVel[pid_num].interval[0]; // end of first interval
+    medianInit(&bemfMedian[pid_num], input_val);
+
+    // restart the stride at phase 0; p_input moves at the first wrap
+    pidObjs[pid_num].phase = 0;
     pidObjs[pid_num].interpolate = 0;
-    /*	pidObjs[pid_num].p_input += pidVel[pid_num].delta[0];	//update to first set point
-     ***  this should be set only after first .expire time to avoid initial transients */
     pidObjs[pid_num].index = 0; // reset setpoint index
-    // set first move at t = 0
-    //	pidVel[0].expire = temp;   // right side
-    //	pidVel[1].expire = temp;   // left side
-
 }
 
+// Call before the legs are turned on. A run started while another one is
+// still going extends it, if it ends later
 void pidStartTimedTrial(unsigned int run_time) {
-    unsigned long temp;
+    timebaseTime now = timebaseNow();
+    timebaseTime end = timebaseAddMs(now, run_time);
+    unsigned char running = 0;
+    int j;
 
-    temp = t1_ticks; // need atomic read due to interrupt
-    pidObjs[0].run_time = run_time;
-    pidObjs[1].run_time = run_time;
-    pidObjs[0].start_time = temp;
-    pidObjs[1].start_time = temp;
-    if ((temp + (unsigned long) run_time) > lastMoveTime) {
-        lastMoveTime = temp + (unsigned long) run_time;
-    } // set run time to max requested time
+    for (j = 0; j < NUM_PIDS; j++) {
+        running |= pidObjs[j].onoff && pidObjs[j].timeFlag;
+    }
+    CRITICAL_SECTION_START;
+    for (j = 0; j < NUM_PIDS; j++) {
+        pidObjs[j].end_time = end;
+    }
+    if (!running || timebaseAfter(end, lastMoveTime)) {
+        lastMoveTime = end; // set run time to max requested time
+    }
+    CRITICAL_SECTION_END;
 }
 
 // from cmd.c  PID set gains
 
+// Sets the commanded gains, in effect unless a gain table is enabled
 void pidSetGains(int pid_num, int Kp, int Ki, int Kd, int Kaw, int ff) {
+    pidObjs[pid_num].setGains[0] = Kp;
+    pidObjs[pid_num].setGains[1] = Ki;
+    pidObjs[pid_num].setGains[2] = Kd;
+    pidObjs[pid_num].setGains[3] = Kaw;
+    pidObjs[pid_num].setGains[4] = ff;
     pidObjs[pid_num].Kp = Kp;
     pidObjs[pid_num].Ki = Ki;
     pidObjs[pid_num].Kd = Kd;
@@ -239,14 +373,29 @@ void pidSetGains(int pid_num, int Kp, int Ki, int Kd, int Kaw, int ff) {
     pidObjs[pid_num].feedforward = ff;
 }
 
+// Output limits applied in UpdatePID, clamped to +-MAXTHROT; slew is per
+// ms, and 0 turns rate limiting off. Returns -1 for a bad channel or min
+// above max
+int pidSetLimits(unsigned int pid_num, int minDC, int maxDC, unsigned int slew) {
+    if (pid_num >= NUM_PIDS || minDC > maxDC) {
+        return -1;
+    }
+    CRITICAL_SECTION_START;
+    pidObjs[pid_num].minDC = pidClamp(minDC, -MAXTHROT, MAXTHROT);
+    pidObjs[pid_num].maxDC = pidClamp(maxDC, -MAXTHROT, MAXTHROT);
+    pidObjs[pid_num].slew = slew == 0 ? 0 :
+            slew < PID_TICKS_PER_MS ? 1 : slew >> PID_TICK_SHIFT;
+    CRITICAL_SECTION_END;
+    return 0;
+}
+
 void pidOn(int pid_num) {
+    autotuneStop(); // closed loop control takes the motors back
     pidObjs[pid_num].onoff = PID_ON;
-    t1_ticks = 0;
 }
 
 void pidOff(int pid_num) {
     pidObjs[pid_num].onoff = PID_OFF;
-    t1_ticks = 0;
 }
 
 // zero position setpoint for both motors (avoids big offset errors)
@@ -256,59 +405,61 @@ void pidZeroPos(int pid_num) {
     DisableIntT1; // turn off pid interrupts
     amsEncoderResetPos(); //  reinitialize rev count and relative zero encoder position for both motors
     pidObjs[pid_num].p_state = 0;
+    pidObjs[pid_num].p_meas = 0;
     // reset position setpoint as well
     pidObjs[pid_num].p_input = 0;
     pidObjs[pid_num].v_input = 0;
     pidObjs[pid_num].leg_stride = 0; // strides also reset
+    velObsReset(pid_num, 0);
     EnableIntT1; // turn on pid interrupts
 }
 
 
 // calibrate A/D offset, using PWM synchronized A/D reads inside 
-// timer 1 interrupt loop
-// BATTERY CHANGED FOR IP2.5 ***** need to fix
+// timer 1 interrupt loop. Returns straight away: the ISR holds the motors
+// off for spindown_ms, averages PID_CALIB_SAMPLES readings per channel and
+// then resumes control. pidCalibDone() tells when it has finished.
 
 void calibBatteryOffset(int spindown_ms) {
-    long temp; // could be + or -
-    unsigned int battery_voltage;
-    // save current PWM config
-    int tempPDC1 = PDC1;
-    int tempPDC2 = PDC2;
+    int j;
+
+    DisableIntT1;
     PDC1 = 0;
     PDC2 = 0; /* SFR for PWM? */
-
-    // save current PID status, and turn off PID control
-    short tempPidObjsOnOff[NUM_PIDS];
-    tempPidObjsOnOff[0] = pidObjs[0].onoff;
-    tempPidObjsOnOff[1] = pidObjs[1].onoff;
-    pidObjs[0].onoff = 0;
-    pidObjs[1].onoff = 0;
-
-    delay_ms(spindown_ms); //motor spin-down
-    LED_RED = 1;
-    offsetAccumulatorL = 0;
-    offsetAccumulatorR = 0;
+    PDC3 = 0;
+    PDC4 = 0;
+    for (j = 0; j < NUM_PIDS; j++) {
+        offsetAccumulator[j] = 0;
+    }
     offsetAccumulatorCounter = 0; // updated inside servo loop
+    calibSpindown = (unsigned int) spindown_ms << PID_TICK_SHIFT;
+    LED_RED = 1;
     calib_flag = 1; // enable calibration
-    while (offsetAccumulatorCounter < 100); // wait for 100 samples
-    calib_flag = 0; // turn off calibration
-    battery_voltage = adcGetVbatt();
-    //Left
-    temp = offsetAccumulatorL;
-    temp = temp / (long) offsetAccumulatorCounter;
-    pidObjs[0].inputOffset = (int) temp;
+    EnableIntT1;
+}
+
+unsigned char pidCalibDone(void) {
+    return !calib_flag;
+}
 
-    //Right
-    temp = offsetAccumulatorR;
-    temp = temp / (long) offsetAccumulatorCounter;
-    pidObjs[1].inputOffset = (int) temp;
+// One calibration step per PID tick, from pidGetState
+static void pidCalibStep(const unsigned int *adc) {
+    int j;
 
-    LED_RED = 0;
-    // restore PID values
-    PDC1 = tempPDC1;
-    PDC2 = tempPDC2;
-    pidObjs[0].onoff = tempPidObjsOnOff[0];
-    pidObjs[1].onoff = tempPidObjsOnOff[1];
+    if (calibSpindown > 0) { //motor spin-down
+        calibSpindown--;
+        return;
+    }
+    for (j = 0; j < NUM_PIDS; j++) {
+        offsetAccumulator[j] += adc[j];
+    }
+    if (++offsetAccumulatorCounter == PID_CALIB_SAMPLES) {
+        for (j = 0; j < NUM_PIDS; j++) {
+            pidObjs[j].inputOffset = (int) (offsetAccumulator[j] >> PID_CALIB_SAMPLES_LOG2);
+        }
+        LED_RED = 0;
+        calib_flag = 0; // turn off calibration
+    }
 }
 
 
@@ -319,11 +470,14 @@ void calibBatteryOffset(int spindown_ms) {
 
 /*****************************************************************************************/
 void EmergencyStop(void) {
-    pidSetInput(0, 0);
-    pidSetInput(1, 0);
+    int j;
+    for (j = 0; j < NUM_PIDS; j++) {
+        pidSetInput(j, 0);
+    }
     DisableIntT1; // turn off pid interrupts
-    SetDCMCPWM(MC_CHANNEL_PWM1, 0, 0); // set PWM to zero
-    SetDCMCPWM(MC_CHANNEL_PWM2, 0, 0);
+    for (j = MC_CHANNEL_PWM1; j <= MC_CHANNEL_PWM4; j++) {
+        SetDCMCPWM(j, 0, 0); // set PWM to zero
+    }
 }
 
 
@@ -333,93 +487,199 @@ void EmergencyStop(void) {
 /*****************************************************************************************/
 /*****************************************************************************************/
 
-/* update setpoint  only leg which has run_time + start_time > t1_ticks */
+/* update setpoint  only leg whose timed run has not ended */
 /* turn off when all PIDs have finished */
-static volatile unsigned char interrupt_count = 0;
-static volatile unsigned char telemetry_count = 0;
-extern volatile MacPacket uart_tx_packet;
-extern volatile unsigned char uart_tx_flag;
-
-void __attribute__((interrupt, no_auto_psv)) _T1Interrupt(void) {
+static void pidAllOff(void);
+static void pidAutotune(void);
+static void pidPassThrough(void);
+static void pidPhaseLock(void);
+static void pidSteer(void);
+static uint16_t pidSampleAge(timebaseTime sample_time);
+static int16_t pidAgeMs(uint16_t age);
+static int pidExtrapolate(int now, int prev, uint16_t age, unsigned char period_log2);
+
+// called from the Timer1 scheduler at PID_LOOP_HZ, see sched.c. The outer
+// loops run on the first PID tick of each ms
+void pidUpdate(void) {
     int j;
-    LED_3 = 1;
-    interrupt_count++;
-
-    //Telemetry save, at 1Khz
-    //TODO: Break coupling between PID module and telemetry triggering
-    if (interrupt_count == 3) {
-        telemSaveNow();
-    }
-    //Update IMU
-    //TODO: Break coupling between PID module and IMU update
-    if (interrupt_count == 4) {
-        mpuBeginUpdate();
-        amsEncoderStartAsyncRead();
-    }        //PID controller update
-    else if (interrupt_count == 5) {
-        interrupt_count = 0;
-
-        if (t1_ticks == T1_MAX) t1_ticks = 0;
-        t1_ticks++;
-        pidGetState(); // always update state, even if motor is coasting
-        for (j = 0; j < NUM_PIDS; j++) {
-            // only update tracking setpoint if time has not yet expired
-            if (pidObjs[j].onoff) {
-                if (pidObjs[j].timeFlag) {
-                    if (pidObjs[j].start_time + pidObjs[j].run_time >= t1_ticks) {
-                        pidGetSetpoint(j);
-                    }
-                    if (t1_ticks > lastMoveTime) { // turn off if done running all legs
-                        pidObjs[0].onoff = 0;
-                        pidObjs[1].onoff = 0;
-                    }
-                }
-                else {
+    timebaseTime now = timebaseNow();
+
+    pidMsTick = pidSubTick == 0;
+    pidSubTick = (pidSubTick + 1) & (PID_TICKS_PER_MS - 1);
+    pidGetState(); // always update state, even if motor is coasting
+    if (pidMsTick) {
+        gainSchedBattUpdate(adcGetVbatt());
+        pidSteer();
+    }
+    for (j = 0; j < NUM_PIDS; j++) {
+        // only update tracking setpoint if time has not yet expired
+        if (pidObjs[j].onoff) {
+            if (pidObjs[j].timeFlag) {
+                if (!timebaseAfter(now, pidObjs[j].end_time)) {
                     pidGetSetpoint(j);
                 }
+                if (timebaseAfter(now, lastMoveTime)) { // turn off if done running all legs
+                    pidAllOff();
+                }
+            }
+            else {
+                pidGetSetpoint(j);
             }
         }
-        if (pidObjs[0].mode == PID_MODE_CONTROLED) {
-            pidSetControl();
-        } else if (pidObjs[0].mode == PID_MODE_PWMPASS) {
-            tiHSetDC(pidObjs[0].output_channel, pidObjs[0].pwmDes);
-            tiHSetDC(pidObjs[1].output_channel, pidObjs[1].pwmDes);
+    }
+    if (pidObjs[LEFT_LEGS_PID_NUM].onoff && pidObjs[RIGHT_LEGS_PID_NUM].onoff) {
+        if (pidMsTick) {
+            pidPhaseLock();
         }
+    } else {
+        phaseLockReset();
+    }
+    if (calib_flag) {
+        // hold the motors off while the back emf offsets are measured
+        for (j = 0; j < NUM_PIDS; j++) {
+            tiHSetDC(pidObjs[j].output_channel, 0);
+        }
+    } else if (autotuneActive()) {
+        pidAutotune();
+    } else if (pidObjs[0].mode == PID_MODE_CONTROLED) {
+        pidSetControl();
+    } else if (pidObjs[0].mode == PID_MODE_PWMPASS) {
+        pidPassThrough();
+    }
+}
 
+static void pidAllOff(void) {
+    int j;
+    for (j = 0; j < NUM_PIDS; j++) {
+        pidObjs[j].onoff = 0;
     }
-    LED_3 = 0;
-    _T1IF = 0;
+}
+
+// relay drive of the channels being tuned, the rest held off
+static void pidAutotune(void) {
+    int j, dc;
+    for (j = 0; j < NUM_PIDS; j++) {
+        dc = pidClamp(autotuneUpdate(j, pidObjs[j].p_state), -MAXTHROT, MAXTHROT);
+        tiHSetDC(pidObjs[j].output_channel, pidObjs[j].pwm_flip ? -dc : dc);
+    }
+}
+
+// pwmDes, or the excitation sequence of channels running one. Sequences
+// start on a ms tick, so telemetry started here logs sample k with duty
+// k * PID_TICKS_PER_MS of the sequence in DCL/DCR
+static void pidPassThrough(void) {
+    unsigned long samples = pidMsTick ? exciteTick() : 0;
+    int j, dc;
+
+    if (samples) {
+        telemCompStart(samples);
+    }
+    for (j = 0; j < NUM_PIDS; j++) {
+        if (exciteActive(j)) {
+            dc = pidClamp(exciteUpdate(j), -MAXTHROT, MAXTHROT);
+            pidObjs[j].output = dc;
+            tiHSetDC(pidObjs[j].output_channel, pidObjs[j].pwm_flip ? -dc : dc);
+        } else {
+            tiHSetDC(pidObjs[j].output_channel, pidObjs[j].pwmDes);
+        }
+    }
+}
+
+// stride rate trims from the yaw rate loop, used by pidGetSetpoint
+static void pidSteer(void) {
+    int gyro[3];
+    int rate, trim = 0;
+
+    mpuGetGyro(gyro);
+    sampleAge[PID_SENSOR_GYRO] = pidSampleAge(imuReadTime + PID_IMU_LATCH_US);
+    rate = (latencyMask & PID_LATENCY_GYRO) ?
+            pidExtrapolate(gyro[2], gyroPrev, sampleAge[PID_SENSOR_GYRO], 0) : gyro[2];
+    gyroPrev = gyro[2];
+    if (pidObjs[LEFT_LEGS_PID_NUM].onoff && pidObjs[RIGHT_LEGS_PID_NUM].onoff) {
+        trim = steeringUpdate(rate);
+    } else {
+        steeringReset();
+    }
+    pidObjs[LEFT_LEGS_PID_NUM].rate_trim = -trim;
+    pidObjs[RIGHT_LEGS_PID_NUM].rate_trim = trim;
+}
+
+// nudge both leg setpoints toward the target phase, see phase_lock.h
+static void pidPhaseLock(void) {
+    int step = phaseLockUpdate(pidObjs[LEFT_LEGS_PID_NUM].p_state,
+            pidObjs[RIGHT_LEGS_PID_NUM].p_state);
+    pidObjs[LEFT_LEGS_PID_NUM].p_input += step / 2;
+    pidObjs[RIGHT_LEGS_PID_NUM].p_input -= step - step / 2;
 }
 
 // update desired velocity and position tracking setpoints for each leg
+// from the gait table at the current stride phase
 
 void pidGetSetpoint(int j) {
-    int index; 
-    long temp_v; // needed for velocity scaling to A/D units
-    index = pidObjs[j].index;
-    // update desired position between setpoints, scaled by 256
-    pidObjs[j].interpolate += (long) activePID[j]->vel[index];
+    pidVelLUT *lut = activePID[j];
+    uint32_t phase, seg;
+    unsigned int k;
+    int v;
+
+    // phase_step >> 1 keeps it in range for the signed multiply
+    phase = pidObjs[j].phase + lut->phase_step +
+            pidMulShr(pidObjs[j].rate_trim, lut->phase_step >> 1, 14);
+
+    if (phase < pidObjs[j].phase) { // phase wrapped, one full stride
+        pidObjs[j].p_input += lut->stride;
+        pidObjs[j].leg_stride++;
+        checkSwapBuff(j);
+        lut = activePID[j];
+    }
+    pidObjs[j].phase = phase;
+
+    // segment index and the fraction of it covered, from the top 16 phase bits
+    seg = PID_MULUU((uint16_t) (phase >> 16), lut->num_points);
+    k = (unsigned int) (seg >> 16);
+    pidObjs[j].index = k;
+    pidObjs[j].interpolate = ((long) lut->pos[k] << 2) +
+            pidMulShr(lut->slope[k], (uint16_t) seg, 14);
+    v = (int) pidMulShr(lut->slope[k], lut->vel_scale, 16); // A/D units
+    pidObjs[j].v_input = v + (int) pidMulShr(pidObjs[j].rate_trim, v, 15);
+}
 
-    if (t1_ticks >= pidObjs[j].expire) { // time to reach previous setpoint has passed
-        pidObjs[j].interpolate = 0;
-        pidObjs[j].p_input += activePID[j]->delta[index]; //update to next set point
-        pidObjs[j].index++;
-
-        if (pidObjs[j].index >= NUM_VELS) {
-            pidObjs[j].index = 0;
-            pidObjs[j].leg_stride++; // one full leg revolution
-            /**** maybe need to handle round off in position set point ***/
-            checkSwapBuff(j);
-        }
-        pidObjs[j].expire += activePID[j]->interval[pidObjs[j].index]; // expire time for next interval
-        // fix to make relative to back emf in A/D units
-        //pidObjs[j].v_input = (activePID[j]->vel[pidObjs[j].index]); //update to next velocity
-        temp_v = ((long)(activePID[j]->vel[pidObjs[j].index]) * K_EMF)>>8;  // scale velocity to A/D units
-		pidObjs[j].v_input = (int)(temp_v);	  //update to next velocity 		
+// Apply a move queue segment to leg j at its stride boundary
+static void pidStartSegment(int j, const moveSegment *seg) {
+    long diff, err;
+
+    if ((seg->flags & MOVE_SWAP_TABLE) && gaitLoading[j]) {
+        swapsHeld++;    // half a table; hold the current one
+    } else if (seg->flags & MOVE_SWAP_TABLE) {
+        // nextPID is only ever the standby table, which is now used up
+        activePID[j] = otherBuff(pidVel, activePID[j]);
+        nextPID[j] = NULL;
+    }
+    if (seg->period[j] > 0) {
+        gaitSetTiming(activePID[j], seg->period[j], seg->phase_step[j], seg->vel_q8[j]);
+    }
+    // re-phase once, when the left leg starts the segment; same split of
+    // the correction between the legs as CMD_SET_PHASE
+    if ((seg->flags & MOVE_SET_PHASE) && j == LEFT_LEGS_PID_NUM) {
+        diff = (pidObjs[LEFT_LEGS_PID_NUM].p_input + pidObjs[LEFT_LEGS_PID_NUM].interpolate) -
+                (pidObjs[RIGHT_LEGS_PID_NUM].p_input + pidObjs[RIGHT_LEGS_PID_NUM].interpolate);
+        err = (int16_t) (seg->phase - (int16_t) diff); // shortest way round
+        pidObjs[LEFT_LEGS_PID_NUM].p_input += err / 2;
+        pidObjs[RIGHT_LEGS_PID_NUM].p_input -= err - err / 2;
+        phaseLockSetTarget(seg->phase); // and hold it, if the lock is on
     }
 }
 
 void checkSwapBuff(int j) {
+    const moveSegment *seg;
+
+    seg = moveQueueNext(j, activePID[j]->period);
+    if (seg != NULL) {
+        pidStartSegment(j, seg);
+        return;
+    }
+    if (moveQueueActive(j)) {
+        return; // queued swaps wait for the queue to drain
+    }
     if (nextPID[j] != NULL) { //Swap pointer if not null
         if (nextPID[j]->onceFlag == 1) {
             pidVelLUT* tempPID;
@@ -437,9 +697,15 @@ void checkSwapBuff(int j) {
     }
 }
 
-// select either back emf or backwd diff for vel est
+// velocity estimate used at boot, PID_VEL_DIFF/BEMF/FUSED; see pidSetVelEstimator
+#ifndef VEL_BEMF
+#define VEL_BEMF PID_VEL_BEMF
+#endif
+static volatile unsigned char velEstimator = VEL_BEMF;
 
-#define VEL_BEMF 1
+void pidSetVelEstimator(unsigned char mode) {
+    velEstimator = mode;
+}
 
 /* update state variables including motor position and velocity */
 
@@ -449,27 +715,19 @@ void pidGetState() {
     int enc_num;
     int encPosition, encOticks;
     unsigned int encOffset;
+    long oldpos[NUM_PIDS], velocity;
+    int measurements[NUM_PIDS];
+    unsigned int adc[NUM_PIDS];
 
-    unsigned long time_start, time_end;
-    //	calib_flag = 0;  //BEMF disable
-    // get diff amp offset with motor off at startup time
-    if (calib_flag) {
-        offsetAccumulatorL += adcGetMotorA();
-        offsetAccumulatorR += adcGetMotorB();
-        offsetAccumulatorCounter++;
-    }
+    timebaseTime time_start, time_end;
+    uint16_t age;
 
-    // choose velocity estimate
-#if VEL_BEMF == 0    // use first difference on position for velocity estimate
-    long oldpos[NUM_PIDS], velocity;
     for (i = 0; i < NUM_PIDS; i++) {
-        oldpos[i] = pidObjs[i].p_state;
+        oldpos[i] = pidObjs[i].p_meas;
     }
-#endif
 
-    time_start = sclockGetTime();
-    bemf[0] = pidObjs[0].inputOffset - adcGetMotorA(); // watch sign for A/D? unsigned int -> signed?
-    bemf[1] = pidObjs[1].inputOffset - adcGetMotorB(); // MotorB
+    time_start = timebaseNow();
+    ctrlTime = time_start + ctrlDelay;
     // only works to +-32K revs- might reset after certain number of steps? Should wrap around properly
     for (i = 0; i < NUM_PIDS; i++) {
         enc_num = pidObjs[i].encoder_num;
@@ -482,149 +740,219 @@ void pidGetState() {
         p_state = p_state - ((long)encOffset << 2); // subtract offset to get zero position
         p_state = p_state + ((long)encOticks << 16);
 
-        pidObjs[i].p_state = p_state;
+        pidObjs[i].p_meas = p_state;
         
         if(pidObjs[i].p_state_flip){
-            pidObjs[i].p_state = -pidObjs[i].p_state;
+            pidObjs[i].p_meas = -pidObjs[i].p_meas;
         }
 
     }
 
-    time_end = sclockGetTime() - time_start;
-
+    time_end = timebaseNow() - time_start;
+    isrStatsRecord(ISR_STATS_STATE_READ, time_end);
 
-#if VEL_BEMF == 0    // use first difference on position for velocity estimate
+    // Battery: AN0, MotorA AN8, MotorB AN9, MotorC AN10, MotorD AN11
+    // Decimated DMA ring reads, see adc_ring.h; each channel is read once
     for (i = 0; i < NUM_PIDS; i++) {
-        velocity = pidObjs[i].p_state - oldpos[i]; // Encoder ticks per ms
-        if (velocity > 0x7fff) velocity = 0x7fff; // saturate to int
-        if (velocity < -0x7fff) velocity = -0x7fff;
-        pidObjs[i].v_state = (int) velocity;
+        adc[i] = pidChannels[i].bemf_adc();
+        measurements[i] = pidObjs[i].inputOffset - adc[i]; // watch sign for A/D? unsigned int -> signed?
+    }
+    // get diff amp offset with motor off at startup time
+    if (calib_flag) {
+        pidCalibStep(adc);
     }
-#endif
-
-    // choose velocity estimate
-
-#if VEL_BEMF == 1
-    int measurements[NUM_PIDS];
-    // Battery: AN0, MotorA AN8, MotorB AN9, MotorC AN10, MotorD AN11
-    measurements[0] = pidObjs[0].inputOffset - adcGetMotorA(); // watch sign for A/D? unsigned int -> signed?
-    measurements[1] = pidObjs[1].inputOffset - adcGetMotorB(); // MotorB
-
 
     //Get motor speed reading on every interrupt - A/D conversion triggered by PWM timer to read Vm when transistor is off
     // when motor is loaded, sometimes see motor short so that  bemf=offset voltage
     // get zero sometimes - open circuit brush? Hence try median filter
-    for (i = 0; i < 2; i++) // median filter
-    {
-        if (measurements[i] > measLast1[i]) {
-            if (measLast1[i] > measLast2[i]) {
-                bemf[i] = measLast1[i];
-            }// middle value is median
-            else // middle is smallest
-            {
-                if (measurements[i] > measLast2[i]) {
-                    bemf[i] = measLast2[i];
-                }// 3rd value is median
-                else {
-                    bemf[i] = measurements[i];
-                } // first value is median
-            }
-        }
-        else // first is not biggest
-        {
-            if (measLast1[i] < measLast2[i]) {
-                bemf[i] = measLast1[i];
-            }// middle value is median
-            else // middle is biggest
-            {
-                if (measurements[i] < measLast2[i]) {
-                    bemf[i] = measLast2[i];
-                }// 3rd value is median
-                else {
-                    bemf[i] = measurements[i]; // first value is median
-                }
-            }
-        }
-    } // end for
-    // store old values
-    measLast2[0] = measLast1[0];
-    measLast1[0] = measurements[0];
-    measLast2[1] = measLast1[1];
-    measLast1[1] = measurements[1];
-    pidObjs[0].v_state = bemf[0];
-    pidObjs[1].v_state = bemf[1]; //  might also estimate from deriv of pos data
+    for (i = 0; i < NUM_PIDS; i++) {
+        bemf[i] = medianUpdate(&bemfMedian[i], measurements[i]);
+    }
     //if((measurements[0] > 0) || (measurements[1] > 0)) {
     if ((measurements[0] > 0)) {
         LED_BLUE = 1;
     } else {
         LED_BLUE = 0;
     }
-#endif
+
+    // the median lags (window - 1) / 2 PID ticks behind the conversions
+    sampleAge[PID_SENSOR_BEMF] = pidSampleAge(adcRingGetSampleTime() -
+            (BEMF_MEDIAN_WINDOW - 1) / 2 * (timebaseTime) PID_TICK_US);
+
+    // choose velocity estimate. The observer always runs so that its
+    // estimate and innovation are in telemetry whichever one is in use.
+    for (i = 0; i < NUM_PIDS; i++) {
+        velObsUpdate(i, pidObjs[i].p_meas, bemf[i], pidObjs[i].output);
+        switch (velEstimator) {
+            case PID_VEL_DIFF: // first difference on position
+                // Encoder ticks per ms
+                velocity = (pidObjs[i].p_meas - oldpos[i]) << PID_TICK_SHIFT;
+                if (velocity > 0x7fff) velocity = 0x7fff; // saturate to int
+                if (velocity < -0x7fff) velocity = -0x7fff;
+                pidObjs[i].v_state = (int) velocity;
+                break;
+            case PID_VEL_FUSED:
+                pidObjs[i].v_state = velObsGetVel(i);
+                break;
+            default: // median filtered back emf
+                pidObjs[i].v_state = (latencyMask & PID_LATENCY_BEMF) ?
+                        pidExtrapolate(bemf[i], bemfPrev[i],
+                        sampleAge[PID_SENSOR_BEMF], PID_TICK_SHIFT) : bemf[i];
+                break;
+        }
+        bemfPrev[i] = bemf[i];
+    }
+
+    // move the encoder samples up to the control instant
+    for (i = 0; i < NUM_PIDS; i++) {
+        age = pidSampleAge(encReadTime + PID_ENC_LATCH_US(pidObjs[i].encoder_num));
+        if (i == LEFT_LEGS_PID_NUM) {
+            sampleAge[PID_SENSOR_ENC] = age;
+        }
+        pidObjs[i].p_state = pidObjs[i].p_meas;
+        if (latencyMask & PID_LATENCY_ENC) {
+            pidObjs[i].p_state += pidMulShr(pidAgeMs(age), velObsGetRate(i), 16) >> 2;
+        }
+    }
+}
+
+void pidStartEncoderRead(void) {
+    encReadTime = timebaseNow();
+    amsEncoderStartAsyncRead();
+}
+
+void pidStartImuRead(void) {
+    imuReadTime = timebaseNow();
+    mpuBeginUpdate();
+}
+
+void pidSetLatencyComp(unsigned char mask, unsigned int ctrl_delay_us) {
+    latencyMask = mask;
+    ctrlDelay = ctrl_delay_us;
+}
+
+unsigned int pidGetSampleAge(unsigned char sensor) {
+    return sensor < PID_NUM_SENSORS ? sampleAge[sensor] : 0;
+}
+
+// us from sample_time to the control instant, 0..PID_LATENCY_MAX_AGE
+static uint16_t pidSampleAge(timebaseTime sample_time) {
+    int32_t age = (int32_t) (ctrlTime - sample_time);
+    return pidClamp(age, 0, PID_LATENCY_MAX_AGE);
+}
+
+// age in ms, Q10 (us * 1.024)
+static int16_t pidAgeMs(uint16_t age) {
+    return PID_MULUU(age, 33554) >> 15;
+}
+
+// Linear extrapolation by age us of a sample taken every 2^-period_log2 ms
+static int pidExtrapolate(int now, int prev, uint16_t age, unsigned char period_log2) {
+    int16_t step = pidClamp((long) now - prev, -0x7fff, 0x7fff);
+    return pidClamp(now + (PID_MULSS(step, pidAgeMs(age)) >> (10 - period_log2)),
+            -0x7fff, 0x7fff);
 }
 
 void pidSetControl() {
     int j;
-    // 0 = right side
-    for (j = 0; j < NUM_PIDS; j++) { //pidobjs[0] : right side
+    char all_on = 1;
+    pidPos *pid;
+
+    for (j = 0; j < NUM_PIDS; j++) {
+        pid = &(pidObjs[j]);
         // p_input has scaled velocity interpolation to make smoother
         // p_state is [16].[16]
-        pidObjs[j].p_error = pidObjs[j].p_input + pidObjs[j].interpolate - pidObjs[j].p_state;
-        pidObjs[j].v_error = pidObjs[j].v_input - pidObjs[j].v_state; // v_input should be revs/sec
+        pid->p_error = pid->p_input + pid->interpolate - pid->p_state;
+        pid->v_error = pid->v_input - pid->v_state; // v_input should be revs/sec
+        if (pid->onoff) { // learn only from strides actually run
+            pid->ff_ilc = ilcUpdate(j, pid->phase, pid->p_error);
+        } else {
+            ilcHold(j);
+            pid->ff_ilc = 0;
+        }
+        gainSchedApply(j, pid);
         //Update values
-        UpdatePID(&(pidObjs[j]));
+        UpdatePID(pid);
+        all_on = all_on && pid->onoff;
     } // end of for(j)
 
-    if (pidObjs[0].onoff && pidObjs[1].onoff) // both motors on to run
-    {
-        if(pidObjs[0].pwm_flip){
-            tiHSetDC(pidObjs[0].output_channel, -pidObjs[0].output);
-        }
-        else{
-            tiHSetDC(pidObjs[0].output_channel, pidObjs[0].output);
-        }
-        
-        if(pidObjs[1].pwm_flip){
-            tiHSetDC(pidObjs[1].output_channel, -pidObjs[1].output);
-        }
-        else{
-            tiHSetDC(pidObjs[1].output_channel, pidObjs[1].output);
+    for (j = 0; j < NUM_PIDS; j++) {
+        pid = &(pidObjs[j]);
+        if (all_on) { // all motors on to run
+            tiHSetDC(pid->output_channel, pid->pwm_flip ? -pid->output : pid->output);
+        } else { // turn off motors if PID loop is off
+            pid->output = 0; // so the slew limit starts from rest
+            tiHSetDC(pid->output_channel, 0);
         }
     }
-    else // turn off motors if PID loop is off
-    {
-        tiHSetDC(pidObjs[0].output_channel, 0);
-        tiHSetDC(pidObjs[1].output_channel, 0);
-    }
 }
 
 void UpdatePID(pidPos *pid) {
-    pid->p = ((long) pid->Kp * pid->p_error) >> 12; // scale so doesn't over flow
-    pid->i = (long) pid->Ki * pid->i_error >> 12;
-    pid->d = (long) pid->Kd * (long) pid->v_error;
+    int32_t aw, out, step, slew;
+    uint32_t saturated;
+    unsigned char flags;
+
+    pid->p = pidMulShr(pid->Kp, pid->p_error, 12); // scale so doesn't over flow
+    pid->i = pidMulShr(pid->Ki, pid->i_error, 12);
+    pid->d = PID_MULSS(pid->Kd, pid->v_error);
     // better check scale factors
 
-    pid->preSat = pid->feedforward + pid->p +
-            ((pid->i) >> 4) + // divide by 16
-            (pid->d >> 4); // divide by 16
-    pid->output = pid->preSat;
+    // |i >> 4| < 2^27 and |d >> 4| < 2^26, so only adding p can overflow
+    pid->preSat = pidSatAdd(pid->p, (int32_t) pid->feedforward + pid->ff_ilc +
+            (pid->i >> 4) + // divide by 16
+            (pid->d >> 4)); // divide by 16
+    // battery compensation ahead of the limits, so they see the applied duty
+    pid->preSat = gainSchedBattScale(pid->preSat);
+    out = pidClamp(pid->preSat, pid->minDC, pid->maxDC);
+    flags = (PID_SAT_MAX & PID_MASK(pid->preSat > pid->maxDC)) |
+            (PID_SAT_MIN & PID_MASK(pid->preSat < pid->minDC));
+    // rate limit from last tick's output; no limit is one of the full
+    // range, since |out - output| < 0x10000
+    slew = PID_SELECT(PID_MASK(pid->slew == 0), pid->slew, 0x10000L);
+    step = pidClamp(out, (int32_t) pid->output - slew, (int32_t) pid->output + slew);
+    flags |= PID_SAT_SLEW & PID_MASK(step != out);
+    out = step;
+    pid->output = out;
+    pid->satFlags = flags;
 
     /* i_error say up to 1 rev error 0x10000, X 256 ms would be 0x1 00 00 00
         scale p_error by 16, so get 12 bit angle value*/
-    pid-> i_error = (long) pid-> i_error + ((long) pid->p_error >> 4); // integrate error
-    // saturate output - assume only worry about >0 for now
-    // apply anti-windup to integrator
-    if (pid->preSat > MAXTHROT) {
-        pid->output = MAXTHROT;
-        pid->i_error = (long) pid->i_error +
-                (long) (pid->Kaw) * ((long) (MAXTHROT) - (long) (pid->preSat))
-                / ((long) GAIN_SCALER);
-    }
-    if (pid->preSat < -MAXTHROT) {
-        pid->output = -MAXTHROT;
-        pid->i_error = (long) pid->i_error +
-                (long) (pid->Kaw) * ((long) (MAXTHROT) - (long) (pid->preSat))
-                / ((long) GAIN_SCALER);
+    // apply anti-windup to integrator while the output is limited, by
+    // back-calculation from the output actually applied
+    saturated = PID_MASK(out != pid->preSat);
+    aw = pidDivGain(pidMulShr(pid->Kaw, pidSatSub(out, pid->preSat), 0)) >> PID_TICK_SHIFT;
+    pid->i_error = pidSatAdd(pidSatAdd(pid->i_error, pid->p_error >> PID_I_SHIFT), // integrate error
+            PID_SELECT(saturated, 0, aw));
+}
+
+// Time UpdatePID on a scratch controller with the Timer1 ISR held off.
+// The error ramps through both saturation limits so every path is timed.
+// Returns timebase us for all iterations, or -1 without running if a
+// PID loop is on, since holding off Timer1 would stall it.
+long pidBenchKernel(unsigned int iterations) {
+    pidPos bench;
+    timebaseTime time_start, time_end;
+    unsigned int n;
+
+    for (n = 0; n < NUM_PIDS; n++) {
+        if (pidObjs[n].onoff) {
+            return -1;
+        }
     }
+    initPIDObjPos(&bench, 800, 40, 300, 20, 0);
+    bench.p_error = -0x20000;
+    bench.v_error = 100;
+
+    DisableIntT1;
+    time_start = timebaseNow();
+    for (n = 0; n < iterations; n++) {
+        UpdatePID(&bench);
+        bench.p_error += 0x40;
+    }
+    time_end = timebaseNow() - time_start;
+    EnableIntT1;
+
+    return time_end;
 }
 
 //TODO: Controller design, this function was created specifically to remove existing externs.
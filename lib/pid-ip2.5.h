@@ -1,6 +1,10 @@
 #ifndef __PID_H
 #define __PID_H
 
+#include <stdint.h>
+#include "settings.h"
+#include "loop_rate.h"
+
 // better to turn gains to zero until initialized by command
 #define DEFAULT_KP  0
 #define DEFAULT_KI  0
@@ -9,8 +13,17 @@
 #define DEFAULT_FF  0
 
 #define GAIN_SCALER         100
-#define NUM_PIDS	2
-#define NUM_VELS	4 // 8 velocity setpoints per cycle
+#define PID_NUM_GAINS       5       // Kp, Ki, Kd, Kaw, feedforward
+#ifndef NUM_PIDS
+#define NUM_PIDS	2       // motor channels, up to the 4 tiH channels
+#endif
+#define NUM_VELS	4 // setpoints per stride in CMD_SET_VEL_PROFILE
+#ifndef GAIT_MAX_POINTS
+#define GAIT_MAX_POINTS 128     // phase table size, 2 KB of RAM for 2 channels
+#endif
+#if GAIT_MAX_POINTS < NUM_VELS || GAIT_MAX_POINTS > 256
+#error "GAIT_MAX_POINTS must be between NUM_VELS and 256"
+#endif
 #define NUM_BUFF 	2 // Number of strides buffered in to get setpoint
 
 
@@ -22,8 +35,12 @@
 * scale by 256 to get resolution in constant */
 // A/D units per encoder change per ms scaled by >> 8 
 // K_EMF = ((256 * 140) / 834)  =43
+// Velocities stay per ms at any PID_LOOP_HZ, see loop_rate.h
 #define K_EMF 43
 
+// i_error gains p_error >> PID_I_SHIFT per tick, 1/16 per ms at any rate
+#define PID_I_SHIFT (4 + PID_TICK_SHIFT)
+
 //#ifndef ADC_MAX
 //#define ADC_MAX             1024
 //#endif
@@ -32,37 +49,83 @@
 #define PID_OFF     0
 #define PID_ON      1
 
+// saturation flags, pidPos.satFlags
+#define PID_SAT_MAX         0x01
+#define PID_SAT_MIN         0x02
+#define PID_SAT_SLEW        0x04
+
+/* Sensor latency compensation. Each sensor sample is stamped with the
+ * sclock time it was taken, and pidGetState moves it forward to the
+ * control instant, when the new duty is written: the encoder position by
+ * the observer velocity, back EMF and yaw rate by their change since the
+ * previous sample. Ages are in us, and are also logged in telemetry. */
+#define PID_SENSOR_ENC      0
+#define PID_SENSOR_BEMF     1
+#define PID_SENSOR_GYRO     2
+#define PID_NUM_SENSORS     3
+#define PID_LATENCY_ENC     (1 << PID_SENSOR_ENC)
+#define PID_LATENCY_BEMF    (1 << PID_SENSOR_BEMF)
+#define PID_LATENCY_GYRO    (1 << PID_SENSOR_GYRO)
+#ifndef PID_LATENCY_DEFAULT
+#define PID_LATENCY_DEFAULT PID_LATENCY_ENC
+#endif
+#define PID_LATENCY_MAX_AGE 4000    // us, older samples are not moved further
+// us from the async read kick off to the angle latch: each AMS read sends
+// the address and register before the sensor samples, ~110 us per encoder
+// at 400 kHz I2C
+#ifndef PID_ENC_LATCH_US
+#define PID_ENC_LATCH_US(num)   (70 + 110 * (num))
+#endif
+#ifndef PID_IMU_LATCH_US
+#define PID_IMU_LATCH_US    10      // SPI burst read start
+#endif
+#ifndef PID_CTRL_DELAY_US
+#define PID_CTRL_DELAY_US   60      // pidUpdate start to tiHSetDC
+#endif
+
 #define PID_MODE_CONTROLED  0
 #define PID_MODE_PWMPASS    1
 
+// velocity estimators, v_state in A/D units except for PID_VEL_DIFF
+#define PID_VEL_DIFF        0   // first difference of p_state
+#define PID_VEL_BEMF        1   // 3 tap median of back emf
+#define PID_VEL_FUSED       2   // encoder + back emf observer, vel_obs.h
+
 // pid type for leg control
 typedef struct
 {
 	long p_input;                   // reference position input - [16].[16]
-	long p_state;                   // current position
-	long p_error;                   // position error
+	long p_state;                   // current position, at the control instant
+	long p_meas;                    // encoder position, at its sample time
+	int32_t p_error;                // position error
 	int v_input;                    // reference velocity input
 	int v_state;                    // current velocity
-	int v_error;                    // velocity error
-	long i_error;                   // integral error
-	long  p, i, d;                  // control contributions from position, integral, and derivative gains respectively
-  	long preSat;                    // output value before saturations
-	int  output;                    //  control output u
+	int16_t v_error;                // velocity error
+	int32_t i_error;                // integral error
+	int32_t p, i, d;                // control contributions from position, integral, and derivative gains respectively
+  	int32_t preSat;                 // output value before saturations
+	int16_t output;                 //  control output u
+	int16_t minDC, maxDC;           // output limits, within +-MAXTHROT
+	uint16_t slew;                  // max output change per tick, 0 for none
+	unsigned char satFlags;         // PID_SAT_* limits hit this tick
  	char onoff;                     //boolean
         //TODO: Replace mode with 'bypass' bit?
  	char mode;                      //Motor mode: 1 iff PWM open loop control
  	int pwmDes;                     // Desired PWM
  	char timeFlag;
-	unsigned long run_time;
-	unsigned long start_time;
+	uint32_t end_time;              // end of the timed run, timebase us
 	int inputOffset;                // BEMF setpoint offset
-	int feedforward;
-        int Kp, Ki, Kd;
-	int Kaw;                        // anti-windup gain
+	int16_t feedforward;
+	int16_t ff_ilc;                 // learned feedforward, see ilc.h
+        int16_t Kp, Ki, Kd;
+	int16_t Kaw;                    // anti-windup gain
+	int16_t setGains[PID_NUM_GAINS]; // as commanded; the ones above are in
+	                                // effect, see gainSchedApply
 	//Leg control variables
-	long interpolate;  		// intermediate value between setpoints
-	unsigned long expire;		// end of current segment
-	int index;			// right index to moves
+	long interpolate;  		// table position at the current phase
+	uint32_t phase;                 // stride phase, 2^32 per stride
+	int index;			// current table segment
+	int16_t rate_trim;              // stride rate trim, Q15, see steering.h
 	int leg_stride;
         unsigned char p_state_flip;     //boolean; flip or do not flip
         unsigned char output_channel;
@@ -70,13 +133,19 @@ typedef struct
         unsigned char pwm_flip;
 } pidPos;
 
-// structure for velocity control of leg cycle
-
+/* Gait table for one leg stride. pos[k] is the leg position at phase
+ * k/num_points, relative to the start of the stride, 0x4000 per leg
+ * revolution. slope[k] runs to the next point, and from the last point to
+ * stride, so the ISR interpolates with one multiply and no divide. */
 typedef struct
 { 
-	int interval[NUM_VELS];	// number of ticks between intervals
-	int delta[NUM_VELS];   // increments for right setpoint
-	int vel[NUM_VELS];     // velocity increments to setpoint, >>8
+	int16_t pos[GAIT_MAX_POINTS];
+	int16_t slope[GAIT_MAX_POINTS];
+	unsigned int num_points;
+	unsigned int period;            // ms per stride
+	uint32_t phase_step;            // phase advance per PID tick
+	int32_t vel_scale;              // slope -> v_input A/D units, Q16
+	long stride;                    // p_input advance per stride, [16].[16]
 	int onceFlag;
 } pidVelLUT;
 
@@ -114,28 +183,75 @@ typedef struct
 #ifndef RIGHT_LEGS_TIH_CHAN
 #define RIGHT_LEGS_TIH_CHAN     1       //tiH module index is 1-4
 #endif
+//Back EMF A/D read for each side
+#ifndef LEFT_LEGS_BEMF_ADC
+#define LEFT_LEGS_BEMF_ADC      adcGetMotorA
+#endif
+#ifndef RIGHT_LEGS_BEMF_ADC
+#define RIGHT_LEGS_BEMF_ADC     adcGetMotorB
+#endif
+
+// Per channel wiring, one entry per PID channel
+typedef struct
+{
+        unsigned char output_channel;   // tiH channel 1-4
+        unsigned char encoder_num;      // amsEnc index 0-3
+        unsigned char p_state_flip;     // boolean; flip encoder direction
+        unsigned char pwm_flip;         // boolean; flip motor direction
+        unsigned int (*bemf_adc)(void); // A/D read of this motor's back EMF
+} pidChannelConfig;
+
+/* Default table is the two leg VelociRoACH. Robots with more motors define
+ * NUM_PIDS and PID_CHANNEL_CONFIG in settings.h, e.g. for four channels:
+ *   #define NUM_PIDS 4
+ *   #define PID_CHANNEL_CONFIG { {2, 0, 0, 1, adcGetMotorA}, \
+ *       {1, 1, 1, 0, adcGetMotorB}, {3, 2, 0, 1, adcGetMotorC}, \
+ *       {4, 3, 1, 0, adcGetMotorD} }
+ */
+#ifndef PID_CHANNEL_CONFIG
+#define PID_CHANNEL_CONFIG { \
+    [LEFT_LEGS_PID_NUM] = {LEFT_LEGS_TIH_CHAN, LEFT_LEGS_ENC_NUM, \
+        LEFT_LEGS_ENC_FLIP, LEFT_LEGS_PWM_FLIP, LEFT_LEGS_BEMF_ADC}, \
+    [RIGHT_LEGS_PID_NUM] = {RIGHT_LEGS_TIH_CHAN, RIGHT_LEGS_ENC_NUM, \
+        RIGHT_LEGS_FLIP, RIGHT_LEGS_PWM_FLIP, RIGHT_LEGS_BEMF_ADC} }
+#endif
 
 
 //Functions
 void UpdatePID(pidPos *pid);
+long pidBenchKernel(unsigned int iterations);
 void pidSetup();
 void initPIDVelProfile();
-void setPIDVelProfile(int pid_num, int *interval, int *delta, int *vel, int onceFlag);
+int pidLoadGaitTable(unsigned int pid_num, unsigned int num_points,
+        unsigned int start, unsigned int count, const int16_t *points,
+        int period, int stride, int onceFlag);
+unsigned int pidGetSwapsHeld(void);
+void pidGaitTiming(int period, uint32_t *phase_step, int32_t *vel_q8);
 void initPIDObjPos(pidPos *pid, int Kp, int Ki, int Kd, int Kaw, int ff);
 //void SetupTimer1(void);
 void pidStartTimedTrial(unsigned int run_time);
 void pidSetInput(int pid_num, int input_val);
 void pidSetGains(int pid_num, int Kp, int Ki, int Kd, int Kaw, int ff);
+int pidSetLimits(unsigned int pid_num, int minDC, int maxDC, unsigned int slew);
 void pidGetState(); // update state vector from bemf and Hall angle
+// scheduler tasks that start the sensor reads and stamp them, see sched.c
+void pidStartEncoderRead(void);
+void pidStartImuRead(void);
+void pidSetLatencyComp(unsigned char mask, unsigned int ctrl_delay_us);
+// us from the sensor sample to this tick's control instant
+unsigned int pidGetSampleAge(unsigned char sensor);
+void pidSetVelEstimator(unsigned char mode);
 void pidGetSetpoint(int j);
 void checkSwapBuff(int j);
 void pidSetControl();
+void pidUpdate(void);
 void EmergencyStop(void);
 unsigned char* pidGetTelemetry(void);
 void pidOn(int pid_num);
 void pidOff(int pid_num);
 void pidZeroPos(int pid_num);
 void calibBatteryOffset(int spindown_ms);
+unsigned char pidCalibDone(void);
 long pidGetPState(unsigned int channel);
 void pidSetPInput(unsigned int channel, long p_input);
 void pidStartMotor(unsigned int channel);
@@ -0,0 +1,87 @@
+/*
+ * Name: pid_kernel.h
+ * Desc: Saturating fixed-point helpers for UpdatePID
+ *
+ * All helpers are branch free and built from 16x16 multiplies, which the
+ * dsPIC does in a single cycle through the __builtin_mul* intrinsics.
+ * Wherever the old long arithmetic did not overflow the results are
+ * bit-exact with it; where it would have wrapped they saturate at
+ * INT32_MIN / INT32_MAX instead. sim/pidcheck.c verifies both claims.
+ */
+#ifndef __PID_KERNEL_H
+#define __PID_KERNEL_H
+
+#include <stdint.h>
+
+#if defined(__XC16__)
+#define PID_MULSS(a, b)     __builtin_mulss((a), (b))
+#define PID_MULSU(a, b)     __builtin_mulsu((a), (b))
+#define PID_MULUU(a, b)     __builtin_muluu((a), (b))
+#else
+#define PID_MULSS(a, b)     ((int32_t) (int16_t) (a) * (int16_t) (b))
+#define PID_MULSU(a, b)     ((int32_t) (int16_t) (a) * (int32_t) (uint16_t) (b))
+#define PID_MULUU(a, b)     ((uint32_t) (uint16_t) (a) * (uint16_t) (b))
+#endif
+
+// 0xffffffff if cond is nonzero, else 0
+#define PID_MASK(cond)      (-(uint32_t) ((cond) != 0))
+
+// Select between a and b with a PID_MASK, b where the mask is set
+#define PID_SELECT(mask, a, b) \
+    ((int32_t) (((uint32_t) (a) & ~(mask)) | ((uint32_t) (b) & (mask))))
+
+// GAIN_SCALER reciprocal: n / 100 == (mulhs(n, 0x51eb851f) >> 5) + (n < 0)
+#define PID_GAIN_RECIP_HI   0x51eb
+#define PID_GAIN_RECIP_LO   0x851f
+#define PID_GAIN_RECIP_SH   5
+
+// a + b, saturated
+static inline int32_t pidSatAdd(int32_t a, int32_t b) {
+    uint32_t s = (uint32_t) a + (uint32_t) b;
+    uint32_t ovf = PID_MASK(((s ^ (uint32_t) a) & (s ^ (uint32_t) b)) >> 31);
+    return PID_SELECT(ovf, s, ((uint32_t) a >> 31) + 0x7fffffffUL);
+}
+
+// a - b, saturated
+static inline int32_t pidSatSub(int32_t a, int32_t b) {
+    uint32_t s = (uint32_t) a - (uint32_t) b;
+    uint32_t ovf = PID_MASK((((uint32_t) a ^ (uint32_t) b) & (s ^ (uint32_t) a)) >> 31);
+    return PID_SELECT(ovf, s, ((uint32_t) a >> 31) + 0x7fffffffUL);
+}
+
+// lo <= x <= hi
+static inline int32_t pidClamp(int32_t x, int32_t lo, int32_t hi) {
+    x = PID_SELECT(PID_MASK(x > hi), x, hi);
+    return PID_SELECT(PID_MASK(x < lo), x, lo);
+}
+
+/*
+ * (k * x) >> shift for 0 <= shift <= 16, saturated.
+ * k * x = hi * 2^16 + lo with hi = k * (x >> 16) + (k * (x & 0xffff)) >> 16,
+ * so the result is hi << (16 - shift) plus the top bits of the low word,
+ * and it overflows exactly when hi << (16 - shift) does. shift should be a
+ * constant so the limits fold.
+ */
+static inline int32_t pidMulShr(int16_t k, int32_t x, unsigned char shift) {
+    unsigned char up = 16 - shift;
+    int32_t lo = PID_MULSU(k, (uint16_t) x);
+    int32_t hi = PID_MULSS(k, (int16_t) (x >> 16)) + (lo >> 16);
+    uint32_t frac = (uint16_t) lo >> shift;
+    int32_t r = (int32_t) (((uint32_t) hi << up) | frac);
+
+    r = PID_SELECT(PID_MASK(hi > (INT32_MAX >> up)), r, INT32_MAX);
+    return PID_SELECT(PID_MASK(hi < (INT32_MIN >> up)), r, INT32_MIN);
+}
+
+// n / GAIN_SCALER, truncated toward zero like the C divide it replaces
+static inline int32_t pidDivGain(int32_t n) {
+    uint16_t n0 = (uint16_t) n;
+    int16_t n1 = (int16_t) (n >> 16);
+    uint32_t w0 = PID_MULUU(n0, PID_GAIN_RECIP_LO);
+    int32_t t = PID_MULSU(n1, PID_GAIN_RECIP_LO) + (int32_t) (w0 >> 16);
+    int32_t w1 = (int32_t) PID_MULUU(n0, PID_GAIN_RECIP_HI) + (uint16_t) t;
+    int32_t hi = PID_MULSS(n1, PID_GAIN_RECIP_HI) + (t >> 16) + (w1 >> 16);
+    return (hi >> PID_GAIN_RECIP_SH) + (int32_t) ((uint32_t) n >> 31);
+}
+
+#endif // __PID_KERNEL_H
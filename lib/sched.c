@@ -0,0 +1,113 @@
+/*
+ * Name: sched.c
+ * Desc: Table driven rate group scheduler run from the Timer1 interrupt
+ *
+ * Replaces the hardcoded interrupt_count slots that used to live in the PID
+ * module. Each PID period is SCHED_SLOTS Timer1 ticks: the encoder read is
+ * kicked off on the second last and the PID runs on the last. The IMU read
+ * and telemetry run once per ms, the IMU read with the encoder read before
+ * the PID tick that runs the outer loops, and telemetry and the live
+ * stream sampler on a tick of their own in the next PID period. At 1 kHz
+ * this is the old timing: telemetry on tick 3, IMU and encoder reads
+ * kicked off on tick 4, PID on tick 5 of every 5. The read tasks stamp
+ * their start time, for pidGetState to correct the samples for their age.
+ *
+ * Overrun handling: a task that runs past its budget, or a tick that runs
+ * past SCHED_TICK_BUDGET_US, suspends all sheddable tasks for
+ * SCHED_SHED_HOLDOFF ticks. A sheddable task is also skipped if its budget
+ * no longer fits in what is left of the current tick. Tasks that are not
+ * sheddable always run: the PID update, and the telemetry save, so that
+ * sample k of the flash log is always ms k of the run.
+ */
+#include <xc.h>
+#include "sched.h"
+#include "isr_stats.h"
+#include "timebase.h"
+#include "led.h"
+#include "telem_comp.h"
+#include "telem_stream.h"
+#include "pid-ip2.5.h"
+
+#define SCHED_PHASE_PID     (SCHED_SLOTS - 1)
+#define SCHED_PHASE_READ    (SCHED_SLOTS - 2)
+// in the PID period after the one that runs the outer loops, so each sample
+// follows the same PID tick of its ms at every rate
+#define SCHED_PHASE_TELEM   ((SCHED_SLOTS + (SCHED_SLOTS > 2 ? SCHED_SLOTS - 3 : 0)) % \
+                             SCHED_TICKS_PER_MS)
+#define SCHED_PID_BUDGET_US (SCHED_TICK_BUDGET_US < 120 ? SCHED_TICK_BUDGET_US : 120)
+
+LOOP_STATIC_ASSERT(SCHED_SLOTS >= 2 && SCHED_TICKS_PER_MS % SCHED_SLOTS == 0, sched_slots);
+LOOP_STATIC_ASSERT(SCHED_PHASE_TELEM < SCHED_TICKS_PER_MS &&
+        SCHED_PHASE_TELEM % SCHED_SLOTS != SCHED_PHASE_PID, sched_telem_phase);
+LOOP_STATIC_ASSERT(SCHED_TICKS_PER_MS < 256, sched_divisor);
+
+static const schedTask schedTasks[] = {
+    // func                  divisor             phase              budget              sheddable
+    {telemCompSaveNow,       SCHED_TICKS_PER_MS, SCHED_PHASE_TELEM, 60,                 0},
+    {telemStreamSample,      SCHED_TICKS_PER_MS, SCHED_PHASE_TELEM, 20,                 1},
+    {pidStartImuRead,        SCHED_TICKS_PER_MS, SCHED_PHASE_READ,  30,                 1},
+    {pidStartEncoderRead,    SCHED_SLOTS,        SCHED_PHASE_READ,  30,                 0},
+    {pidUpdate,              SCHED_SLOTS,        SCHED_PHASE_PID,   SCHED_PID_BUDGET_US, 0},
+};
+
+#define SCHED_NUM_TASKS (sizeof(schedTasks) / sizeof(schedTasks[0]))
+
+static unsigned char schedCountdown[SCHED_NUM_TASKS];
+static volatile unsigned int schedShedTicks;
+
+void schedSetup(void) {
+    unsigned int i;
+    for (i = 0; i < SCHED_NUM_TASKS; i++) {
+        schedCountdown[i] = schedTasks[i].phase;
+    }
+    schedShedTicks = 0;
+}
+
+unsigned int schedNumTasks(void) {
+    return SCHED_NUM_TASKS;
+}
+
+void __attribute__((interrupt, no_auto_psv)) _T1Interrupt(void) {
+    unsigned int i;
+    timebaseTime tick_start, task_start, elapsed;
+    const schedTask *task;
+
+    tick_start = timebaseNow();
+    LED_3 = 1;
+
+    if (schedShedTicks != 0) {
+        schedShedTicks--;
+    }
+
+    for (i = 0; i < SCHED_NUM_TASKS; i++) {
+        if (schedCountdown[i] != 0) {
+            schedCountdown[i]--;
+            continue;
+        }
+        task = &schedTasks[i];
+        schedCountdown[i] = task->divisor - 1;
+
+        task_start = timebaseNow();
+        if (task->sheddable && (schedShedTicks != 0 ||
+                (task_start - tick_start) + task->budget > SCHED_TICK_BUDGET_US)) {
+            isrStatsShed(i);
+            continue;
+        }
+
+        task->func();
+
+        elapsed = timebaseNow() - task_start;
+        isrStatsRecord(i, elapsed);
+        if (elapsed > task->budget) {
+            isrStatsOverrun(i);
+            schedShedTicks = SCHED_SHED_HOLDOFF;
+        }
+    }
+
+    if (timebaseNow() - tick_start > SCHED_TICK_BUDGET_US) {
+        schedShedTicks = SCHED_SHED_HOLDOFF;
+    }
+
+    LED_3 = 0;
+    _T1IF = 0;
+}
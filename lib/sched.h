@@ -0,0 +1,33 @@
+/*
+ * Name: sched.h
+ * Desc: Table driven rate group scheduler run from the Timer1 interrupt
+ *
+ * Timer1 ticks at SCHED_TICK_HZ, set by PID_LOOP_HZ in loop_rate.h. Every
+ * task in the table in sched.c runs on the ticks where (tick % divisor) ==
+ * phase, so changing a task's rate or moving it to a quieter tick is an
+ * edit to its table entry.
+ *
+ * Times are in timebase ticks (microseconds), see timebase.h.
+ */
+#ifndef __SCHED_H
+#define __SCHED_H
+
+#include "loop_rate.h"
+
+// Time available to tasks in one tick, leaving room for ISR entry and exit
+#define SCHED_TICK_BUDGET_US    (SCHED_TICK_PERIOD_US - 20)
+// Ticks that sheddable tasks stay suspended after an overrun
+#define SCHED_SHED_HOLDOFF      (5 * SCHED_TICKS_PER_MS)
+
+typedef struct {
+    void (*func)(void);
+    unsigned char divisor;      // run every divisor Timer1 ticks
+    unsigned char phase;        // tick within the divisor period, < divisor
+    unsigned int budget;        // expected worst case execution time
+    unsigned char sheddable;    // may be skipped to protect other tasks
+} schedTask;
+
+void schedSetup(void);
+unsigned int schedNumTasks(void);
+
+#endif // __SCHED_H
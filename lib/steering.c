@@ -0,0 +1,69 @@
+/*
+ * Name: steering.c
+ * Desc: Yaw rate steering loop on top of the leg PIDs
+ *
+ * steeringUpdate runs in the Timer1 ISR from pidUpdate; the setters run
+ * from the command handler.
+ */
+#include "steering.h"
+#include "pid_kernel.h"
+
+static volatile unsigned char steerMode;
+static volatile int16_t steerRate;
+static volatile int16_t steerKp, steerKi, steerKd, steerKaw, steerKff;
+static int32_t steerSum;
+static int16_t steerLastErr;
+static int16_t steerTrim;
+
+void steeringSetup(void) {
+    steeringSetGains(0, 0, 0, 0, 0, STEER_MODE_OFF);
+    steerRate = 0;
+}
+
+void steeringSetGains(int Kp, int Ki, int Kd, int Kaw, int Kff, unsigned char mode) {
+    steerMode = STEER_MODE_OFF;
+    steerKp = Kp;
+    steerKi = Ki;
+    steerKd = Kd;
+    steerKaw = Kaw;
+    steerKff = Kff;
+    steeringReset();
+    steerMode = mode;
+}
+
+void steeringSetRate(int rate) {
+    steerRate = rate;
+}
+
+void steeringReset(void) {
+    steerSum = 0;
+    steerLastErr = 0;
+    steerTrim = 0;
+}
+
+int steeringUpdate(int gyroZ) {
+    int16_t err;
+    int32_t preSat;
+
+    if (steerMode != STEER_MODE_GYRO) {
+        steerTrim = 0;
+        return 0;
+    }
+    err = (int16_t) pidClamp((int32_t) steerRate - gyroZ, -0x7fff, 0x7fff);
+    preSat = pidSatAdd(pidSatAdd(PID_MULSS(steerKp, err) >> 8,
+            pidMulShr(steerKi, steerSum, 16)),
+            pidSatAdd(PID_MULSS(steerKd, (int16_t) pidClamp((int32_t) err - steerLastErr,
+            -0x7fff, 0x7fff)) >> 4, PID_MULSS(steerKff, steerRate) >> 8));
+    steerTrim = (int16_t) pidClamp(preSat, -STEER_MAX_TRIM, STEER_MAX_TRIM);
+    if (steerTrim == preSat) {
+        steerSum = pidSatAdd(steerSum, err);
+    } else { // limited: hold, or bleed back with Kaw
+        steerSum = pidSatAdd(steerSum, pidMulShr(steerKaw, pidSatSub(steerTrim, preSat), 8));
+    }
+    steerLastErr = err;
+    return steerTrim;
+}
+
+int steeringGetTrim(void) {
+    return steerTrim;
+}
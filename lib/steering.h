@@ -0,0 +1,34 @@
+/*
+ * Name: steering.h
+ * Desc: Yaw rate steering loop on top of the leg PIDs
+ *
+ * Runs once per ms while both legs are on. Tracks a commanded yaw rate
+ * from MPU gyro Z by trimming the stride rate of the two legs in opposite
+ * directions: a positive trim speeds the right legs and slows the left,
+ * which turns the robot toward positive gyro Z. The trim is a Q15
+ * fraction of the stride rate, applied to the phase step of each gait
+ * table in pidGetSetpoint, so stride shape and phase lock are unchanged.
+ *
+ *   err  = rate - gyroZ                           gyro LSB
+ *   trim = Kp*err >> 8 + Ki*sum(err) >> 16 + Kd*d(err) >> 4 + Kff*rate >> 8
+ *
+ * limited to STEER_MAX_TRIM. The integral holds while the trim is limited,
+ * and Kaw bleeds it back by the excess.
+ */
+#ifndef __STEERING_H
+#define __STEERING_H
+
+#define STEER_MODE_OFF      0
+#define STEER_MODE_GYRO     1
+
+#define STEER_MAX_TRIM      8192    // +-25% of the stride rate
+
+void steeringSetup(void);
+void steeringSetGains(int Kp, int Ki, int Kd, int Kaw, int Kff, unsigned char mode);
+void steeringSetRate(int rate);
+void steeringReset(void);
+// Returns the stride rate trim for the right legs; the left get minus it
+int steeringUpdate(int gyroZ);
+int steeringGetTrim(void);
+
+#endif // __STEERING_H
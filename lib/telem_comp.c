@@ -0,0 +1,270 @@
+/*
+ * Name: telem_comp.c
+ * Desc: Delta compressed telemetry in dataflash, CMD_SET_TELEM_COMP
+ *
+ * The ISR side only fills the ring; the encoder and the dataflash writes
+ * run in the main loop, so the telemetry task stays short either way.
+ */
+#include <string.h>
+#include "telem_comp.h"
+#include "telem_pack.h"
+#include "timebase.h"
+#include "loop_rate.h"
+#include "dfmem.h"
+#include "radio.h"
+#include "utils.h"
+#include "cmd.h"
+
+// timestamp and the selected fields, at most 28 of 16 bits
+#define TELEM_COMP_FIELDS   (1 + (TELEM_PACK_RECORD - sizeof (uint32_t)) / 2)
+// mask, then at most 5 varint bytes per 32 bit and 3 per 16 bit field
+#define TELEM_COMP_DELTA_MAX (4 + 5 + (TELEM_COMP_FIELDS - 1) * 3)
+
+LOOP_STATIC_ASSERT(TELEM_COMP_FIELDS <= 32, telem_comp_mask);
+LOOP_STATIC_ASSERT((TELEM_COMP_RING & (TELEM_COMP_RING - 1)) == 0, telem_comp_ring);
+
+// ISR to main loop
+static telemStruct_t telemCompRing[TELEM_COMP_RING];
+static volatile unsigned char telemCompHead, telemCompTail;
+static volatile unsigned char telemCompOn, telemCompSaving;
+static volatile unsigned long telemCompToSave;
+static unsigned long telemCompIndex;
+static timebaseTime telemCompStartTime;
+
+// Encoder, main loop only
+static unsigned char telemCompBuf[TELEM_COMP_PAGE_MAX];
+static unsigned char telemCompPrev[TELEM_PACK_RECORD], telemCompPrev2[TELEM_PACK_RECORD];
+static unsigned char telemCompSizes[TELEM_COMP_FIELDS];    // of the log
+static unsigned int telemCompNumFields, telemCompRecord;
+static unsigned long telemCompNext;         // sampleIndex that continues the page
+static unsigned int telemCompUsed, telemCompCount;
+static unsigned int telemCompPage, telemCompPages, telemCompPageLimit;
+static unsigned int telemCompPageBytes;
+
+static DfmemGeometryStruct telemCompGeo;
+
+void telemCompSetup(void) {
+    dfmemGetGeometryParams(&telemCompGeo);
+    telemCompPageBytes = telemCompGeo.bytes_per_page < TELEM_COMP_PAGE_MAX ?
+            telemCompGeo.bytes_per_page : TELEM_COMP_PAGE_MAX;
+    telemCompPageLimit = telemCompGeo.max_pages;
+    telemCompOn = 0;
+    telemCompSaving = 0;
+    telemCompToSave = 0;
+    telemCompHead = 0;
+    telemCompTail = 0;
+    telemCompUsed = 0;
+    telemCompPage = 0;
+    telemCompPages = 0;
+}
+
+int telemCompSetEnable(unsigned char enable) {
+    if (telemCompSaving) {
+        return -1;
+    }
+    telemCompOn = enable != 0;
+    return 0;
+}
+
+unsigned char telemCompEnabled(void) {
+    return telemCompOn;
+}
+
+unsigned char telemCompBusy(void) {
+    return telemCompSaving;
+}
+
+void telemCompStart(unsigned long samples) {
+    CRITICAL_SECTION_START;
+    if (!telemCompOn) {
+        telemSetStartTime();
+        telemSetSamplesToSave(samples);
+    }
+    telemCompStartTime = timebaseNow();
+    telemCompIndex = 0;
+    telemCompToSave = samples;
+    telemCompSaving = samples != 0;
+    CRITICAL_SECTION_END;
+}
+
+void telemCompSaveNow(void) {
+    telemStruct_t *sample;
+
+    if (telemCompToSave == 0) {
+        return;
+    }
+    if (!telemCompOn) {
+        // counted here as well, for telemCompBusy
+        telemSaveNow();
+    } else if ((unsigned char) (telemCompHead - telemCompTail) < TELEM_COMP_RING) {
+        // a full ring drops the sample; its index is skipped in the log
+        sample = &telemCompRing[telemCompHead & (TELEM_COMP_RING - 1)];
+        sample->sampleIndex = telemCompIndex;
+        sample->timestamp = timebaseNow() - telemCompStartTime;
+        TELEMPACKFUNC(&sample->telemData);
+        telemCompHead++;
+    }
+    telemCompIndex++;
+    if (--telemCompToSave == 0) {
+        telemCompSaving = 0;
+    }
+}
+
+static unsigned int telemCompVarint(unsigned char *out, uint32_t z) {
+    unsigned int n = 0;
+    while (z >= 0x80) {
+        out[n++] = (z & 0x7f) | 0x80;
+        z >>= 7;
+    }
+    out[n++] = z;
+    return n;
+}
+
+// Mask and residuals of record f against the prediction, returns the bytes used
+static unsigned int telemCompDelta(unsigned char *out, const unsigned char *f) {
+    uint32_t mask = 0, r, v, p, p2;
+    uint16_t r16, v16, p16;
+    unsigned int k, pos = 0, n = sizeof (mask);
+
+    for (k = 0; k < telemCompNumFields; k++) {
+        if (telemCompSizes[k] == 4) {
+            memcpy(&v, f + pos, 4);
+            memcpy(&p, telemCompPrev + pos, 4);
+            memcpy(&p2, telemCompPrev2 + pos, 4);
+            r = v - (2 * p - p2);
+            if (r != 0) {
+                mask |= 1UL << k;
+                n += telemCompVarint(out + n, (r << 1) ^ (0 - (r >> 31)));
+            }
+        } else {
+            memcpy(&v16, f + pos, 2);
+            memcpy(&p16, telemCompPrev + pos, 2);
+            r16 = v16 - p16;
+            if (r16 != 0) {
+                mask |= 1UL << k;
+                n += telemCompVarint(out + n, (uint16_t) ((r16 << 1) ^ (0 - (r16 >> 15))));
+            }
+        }
+        pos += telemCompSizes[k];
+    }
+    memcpy(out, &mask, sizeof (mask));
+    return n;
+}
+
+static void telemCompFlush(void) {
+    uint16_t count = telemCompCount, used = telemCompUsed;
+
+    memcpy(telemCompBuf + 4, &count, sizeof (count));
+    memcpy(telemCompBuf + 6, &used, sizeof (used));
+    memset(telemCompBuf + telemCompUsed, 0xff, telemCompPageBytes - telemCompUsed);
+    dfmemWrite(telemCompBuf, telemCompPageBytes, telemCompPage, 0, 0);
+    telemCompPages = ++telemCompPage;
+    telemCompUsed = 0;
+}
+
+static void telemCompEncode(const telemStruct_t *sample) {
+    const unsigned char *f = (const unsigned char *) &sample->timestamp;
+    unsigned char delta[TELEM_COMP_DELTA_MAX];
+    unsigned int n;
+    uint32_t first;
+
+    if (sample->sampleIndex == 0) {
+        // a new log, from page 0, with the fields selected now
+        telemCompUsed = 0;
+        telemCompPage = 0;
+        telemCompPages = 0;
+        telemCompSizes[0] = sizeof (sample->timestamp);
+        telemCompNumFields = 1 + vrTelemFieldSizes(telemCompSizes + 1);
+        telemCompRecord = sizeof (sample->timestamp) + vrTelemGetSize();
+    }
+    if (telemCompUsed != 0 && sample->sampleIndex == telemCompNext) {
+        n = telemCompDelta(delta, f);
+        if (telemCompUsed + n <= telemCompPageBytes) {
+            memcpy(telemCompBuf + telemCompUsed, delta, n);
+            telemCompUsed += n;
+            telemCompCount++;
+            memcpy(telemCompPrev2, telemCompPrev, telemCompRecord);
+            memcpy(telemCompPrev, f, telemCompRecord);
+            telemCompNext++;
+            return;
+        }
+    }
+    if (telemCompUsed != 0) {
+        telemCompFlush();
+    }
+    if (telemCompPage >= telemCompPageLimit) {
+        return;     // erased pages used up
+    }
+    first = sample->sampleIndex;
+    memcpy(telemCompBuf, &first, sizeof (first));
+    memcpy(telemCompBuf + TELEM_COMP_HEADER, f, telemCompRecord);
+    telemCompUsed = TELEM_COMP_HEADER + telemCompRecord;
+    telemCompCount = 1;
+    memcpy(telemCompPrev, f, telemCompRecord);
+    memcpy(telemCompPrev2, f, telemCompRecord);
+    telemCompNext = sample->sampleIndex + 1;
+}
+
+void telemCompProcess(void) {
+    // sampled first: once clear, nothing more can enter the ring
+    unsigned char saving = telemCompSaving;
+
+    while (telemCompTail != telemCompHead) {
+        telemCompEncode(&telemCompRing[telemCompTail & (TELEM_COMP_RING - 1)]);
+        telemCompTail++;
+    }
+    if (!saving && telemCompUsed != 0) {
+        telemCompFlush();
+    }
+}
+
+void telemCompErase(unsigned long numSamples) {
+    unsigned long pages;
+    unsigned int p;
+
+    if (!telemCompOn) {
+        telemErase(numSamples);
+        return;
+    }
+    // as many pages as the uncompressed log would take, so any log fits
+    // that compresses at all
+    pages = (numSamples + telemCompGeo.bytes_per_page / PACKETSIZE - 1) /
+            (telemCompGeo.bytes_per_page / PACKETSIZE);
+    if (pages > telemCompGeo.max_pages) {
+        pages = telemCompGeo.max_pages;
+    }
+    for (p = 0; p < pages; p += telemCompGeo.pages_per_sector) {
+        dfmemEraseSector(p);
+    }
+    telemCompPageLimit = pages;
+}
+
+void telemCompReadback(unsigned int start, unsigned int pages, unsigned int src_addr) {
+    unsigned char buf[TELEM_PACK_PAYLOAD];
+    uint16_t header[3], used;
+    unsigned int page, byte, n;
+
+    if (pages == 0) {
+        pages = telemCompPages;
+    }
+    for (page = start; page < start + pages && page < telemCompPages; page++) {
+        dfmemRead(page, 6, sizeof (used), (unsigned char *) &used);
+        if (used < TELEM_COMP_HEADER || used > telemCompPageBytes) {
+            used = TELEM_COMP_HEADER;   // send the header, the host skips the page
+        }
+        for (byte = 0; byte < used; byte += n) {
+            n = used - byte;
+            if (n > TELEM_PACK_PAYLOAD - TELEM_COMP_READ_HEADER) {
+                n = TELEM_PACK_PAYLOAD - TELEM_COMP_READ_HEADER;
+            }
+            header[0] = page;
+            header[1] = byte;
+            header[2] = telemCompPages;
+            memcpy(buf, header, sizeof (header));
+            dfmemRead(page, byte, n, buf + TELEM_COMP_READ_HEADER);
+            radioSendData(src_addr, 0, CMD_FLASH_READBACK_COMP,
+                    n + TELEM_COMP_READ_HEADER, buf, 0);
+            delay_ms(TELEM_PACK_DELAY_MS);
+        }
+    }
+}
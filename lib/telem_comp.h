@@ -0,0 +1,62 @@
+/*
+ * Name: telem_comp.h
+ * Desc: Delta compressed telemetry in dataflash, CMD_SET_TELEM_COMP
+ *
+ * Off, the default, telemetry is saved by imageproc-lib telem.c as before:
+ * one whole telemStruct_t per slot. On, telemCompSaveNow only copies each
+ * sample into a ring in the Timer1 ISR, and telemCompProcess, from the
+ * main loop, encodes it into the page being filled and writes the page out
+ * when the next sample would not fit. Each page stands alone:
+ *
+ *   uint32 first    sampleIndex of the keyframe, 0xffffffff erased
+ *   uint16 count    samples in the page
+ *   uint16 used     bytes written, this header included
+ *   keyframe        timestamp and the selected telemetry fields, as sent
+ *                   by CMD_FLASH_READBACK
+ *   count - 1 deltas, each
+ *     uint32 mask   bit k set if field k is not as predicted
+ *     varints       zigzag residual of each set field, 7 bits a byte, LSB first
+ *
+ * Fields are the timestamp and then the fields of the vr_telem.c schema
+ * (CMD_SET_TELEM_FIELDS) as of the start of the log. The timestamp and the
+ * 32 bit fields are predicted as 2 * prev - prev2 mod 2^32 (prev2 = prev
+ * after the keyframe), the 16 bit fields as prev mod 2^16. With the
+ * default fields a 1 kHz trial averages about 13 bytes a sample against
+ * 60, so a page holds 4 to 5 times the samples. A gap in sampleIndex, from
+ * a ring overrun, starts a new page.
+ *
+ * CMD_FLASH_READBACK_COMP sends the used bytes of each page in packets of
+ *
+ *   uint16 page, uint16 byte, uint16 pages (in the log), data
+ */
+#ifndef __TELEM_COMP_H
+#define __TELEM_COMP_H
+
+#include "telem.h"
+
+#define TELEM_COMP_RING         16      // samples, power of 2
+#define TELEM_COMP_PAGE_MAX     528     // AT45DB161D page
+#define TELEM_COMP_HEADER       8
+#define TELEM_COMP_READ_HEADER  6
+
+void telemCompSetup(void);
+// Returns 0, or -1 while samples are being saved
+int telemCompSetEnable(unsigned char enable);
+unsigned char telemCompEnabled(void);
+// Samples still to be saved, compressed or not
+unsigned char telemCompBusy(void);
+// In place of telemSetStartTime and telemSetSamplesToSave, from the ISR
+// or command context
+void telemCompStart(unsigned long samples);
+// Timer1 ISR telemetry task, telemSaveNow when off
+void telemCompSaveNow(void);
+// Main loop: encodes the samples captured since the last call
+void telemCompProcess(void);
+// Erases for numSamples samples, as telemErase; compressed logs then stop
+// at the erased pages
+void telemCompErase(unsigned long numSamples);
+// Sends pages [start, start + pages) of the last compressed log, all of
+// it for pages 0. Blocks until done, command context only
+void telemCompReadback(unsigned int start, unsigned int pages, unsigned int src_addr);
+
+#endif // __TELEM_COMP_H
@@ -0,0 +1,55 @@
+/*
+ * Name: telem_pack.c
+ * Desc: Packed telemetry readback, CMD_FLASH_READBACK_PACKED
+ */
+#include <string.h>
+#include "telem_pack.h"
+#include "dfmem.h"
+#include "radio.h"
+#include "utils.h"
+#include "cmd.h"
+
+static unsigned char telemPackBuf[TELEM_PACK_PAYLOAD];
+
+static void telemPackSend(unsigned int length, unsigned int src_addr) {
+    radioSendData(src_addr, 0, CMD_FLASH_READBACK_PACKED, length, telemPackBuf, 0);
+    delay_ms(TELEM_PACK_DELAY_MS);
+}
+
+void telemPackReadback(unsigned long start, unsigned long count, unsigned int src_addr) {
+    DfmemGeometryStruct geo;
+    telemStruct_t sample;
+    const unsigned char *record = (const unsigned char *) &sample.timestamp;
+    unsigned long index, per_page;
+    unsigned int record_size = sizeof (sample.timestamp) + vrTelemGetSize();
+    unsigned int used = 0, pos, n;
+    uint32_t first;
+
+    dfmemGetGeometryParams(&geo);
+    per_page = geo.bytes_per_page / PACKETSIZE;
+    for (index = start; index < start + count; index++) {
+        dfmemRead(index / per_page, (index % per_page) * PACKETSIZE, PACKETSIZE,
+                (unsigned char *) &sample);
+        for (pos = 0; pos < record_size; pos += n) {
+            if (used == 0) {
+                first = index;
+                memcpy(telemPackBuf, &first, sizeof (first));
+                telemPackBuf[4] = pos;
+                used = TELEM_PACK_HEADER;
+            }
+            n = record_size - pos;
+            if (n > TELEM_PACK_PAYLOAD - used) {
+                n = TELEM_PACK_PAYLOAD - used;
+            }
+            memcpy(telemPackBuf + used, record + pos, n);
+            used += n;
+            if (used == TELEM_PACK_PAYLOAD) {
+                telemPackSend(used, src_addr);
+                used = 0;
+            }
+        }
+    }
+    if (used != 0) {
+        telemPackSend(used, src_addr);
+    }
+}
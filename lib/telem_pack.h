@@ -0,0 +1,45 @@
+/*
+ * Name: telem_pack.h
+ * Desc: Packed telemetry readback, CMD_FLASH_READBACK_PACKED
+ *
+ * CMD_FLASH_READBACK sends one telemStruct_t per packet, 64 of the 114
+ * bytes a packet can carry. Packed readback streams the saved samples
+ * back to back instead, each without its sampleIndex, and fills every
+ * packet but the last:
+ *
+ *   uint32 start    index of the sample the first data byte belongs to
+ *   uint8  offset   bytes of that sample sent in the packet before
+ *   data            the sample stream, record bytes per sample
+ *
+ * where a record is the timestamp and the fields selected in vr_telem.c,
+ * at most TELEM_PACK_RECORD bytes; 60 with the default fields, fewer
+ * with a smaller schema. The host puts each packet at start * record +
+ * offset in its copy of the stream, and a sample is complete once all its
+ * bytes are in. A lost packet costs the samples it touches, which the host
+ * asks for again by index range with CMD_FLASH_READBACK_RANGES.
+ *
+ * Samples are read from dataflash in the layout telem.c writes them:
+ * whole samples per page from page 0, never straddling a page boundary.
+ */
+#ifndef __TELEM_PACK_H
+#define __TELEM_PACK_H
+
+#include "telem.h"
+
+// 127 byte 802.15.4 frame less the MAC header, FCS and payload header
+#ifndef TELEM_PACK_PAYLOAD
+#define TELEM_PACK_PAYLOAD  114
+#endif
+#ifndef TELEM_PACK_DELAY_MS
+#define TELEM_PACK_DELAY_MS 2       // between packets, as telem.c readback
+#endif
+#define TELEM_PACK_HEADER   5
+// sample bytes after sampleIndex: timestamp and telemData, the most a
+// record can take
+#define TELEM_PACK_RECORD   (PACKETSIZE - sizeof (uint32_t))
+
+// Sends samples [start, start + count) to src_addr. Blocks until done, so
+// only from command context, like telemReadbackSamples
+void telemPackReadback(unsigned long start, unsigned long count, unsigned int src_addr);
+
+#endif // __TELEM_PACK_H
@@ -0,0 +1,99 @@
+/*
+ * Name: telem_stream.c
+ * Desc: Live decimated telemetry over the radio, CMD_TELEM_STREAM
+ */
+#include "telem_stream.h"
+#include "timebase.h"
+#include "loop_rate.h"
+#include "radio.h"
+#include "utils.h"
+#include "cmd.h"
+
+typedef struct {
+    uint16_t first;
+    uint16_t count;
+    telemStreamSample_t samples[TELEM_STREAM_PER_PACKET];
+} telemStreamPacket;
+
+LOOP_STATIC_ASSERT(sizeof (telemStreamPacket) == TELEM_STREAM_HEADER +
+        TELEM_STREAM_PER_PACKET * sizeof (telemStreamSample_t), telem_stream_packed);
+LOOP_STATIC_ASSERT(sizeof (telemStreamPacket) <= 114, telem_stream_payload);
+LOOP_STATIC_ASSERT((TELEM_STREAM_RING & (TELEM_STREAM_RING - 1)) == 0, telem_stream_ring);
+
+// ISR fills ring[head], the main loop sends from tail
+static telemStreamPacket telemStreamRing[TELEM_STREAM_RING];
+static volatile unsigned char telemStreamHead, telemStreamTail;
+static unsigned char telemStreamFill;
+static uint16_t telemStreamNumber;
+static volatile unsigned int telemStreamPeriod;     // ms, 0 off
+static unsigned int telemStreamCountdown;
+static unsigned int telemStreamDest;
+
+void telemStreamSetup(void) {
+    telemStreamPeriod = 0;
+    telemStreamHead = 0;
+    telemStreamTail = 0;
+    telemStreamFill = 0;
+}
+
+unsigned int telemStreamSet(unsigned int rate_hz, unsigned int dest_addr) {
+    unsigned int period = 0;
+
+    if (rate_hz > TELEM_STREAM_MAX_HZ) {
+        rate_hz = TELEM_STREAM_MAX_HZ;
+    }
+    if (rate_hz != 0) {
+        period = 1000 / rate_hz;
+    }
+    CRITICAL_SECTION_START;
+    telemStreamPeriod = period;
+    telemStreamCountdown = 1;
+    telemStreamNumber = 0;
+    telemStreamFill = 0;
+    telemStreamTail = telemStreamHead;
+    telemStreamDest = dest_addr;
+    CRITICAL_SECTION_END;
+    return period ? 1000 / period : 0;
+}
+
+void telemStreamSample(void) {
+    telemStreamPacket *packet;
+    telemStreamSample_t *sample;
+
+    if (telemStreamPeriod == 0 || --telemStreamCountdown != 0) {
+        return;
+    }
+    telemStreamCountdown = telemStreamPeriod;
+    // only between packets: one started had a free slot, and still has
+    if ((unsigned char) (telemStreamHead - telemStreamTail) >= TELEM_STREAM_RING) {
+        // the radio is behind; numbered anyway, so the host sees the gap
+        telemStreamNumber++;
+        return;
+    }
+    packet = &telemStreamRing[telemStreamHead & (TELEM_STREAM_RING - 1)];
+    if (telemStreamFill == 0) {
+        packet->first = telemStreamNumber;
+    }
+    sample = &packet->samples[telemStreamFill];
+    sample->timestamp = timebaseNow();
+    vrTelemGetLive(&sample->data);
+    telemStreamNumber++;
+    if (++telemStreamFill == TELEM_STREAM_PER_PACKET) {
+        packet->count = TELEM_STREAM_PER_PACKET;
+        telemStreamFill = 0;
+        telemStreamHead++;
+    }
+}
+
+void telemStreamProcess(void) {
+    telemStreamPacket *packet;
+
+    while (telemStreamTail != telemStreamHead &&
+            radioGetTxQueueSize() < TELEM_STREAM_TXQ_MAX) {
+        packet = &telemStreamRing[telemStreamTail & (TELEM_STREAM_RING - 1)];
+        // fast fail: no packet buffer to spare means the sample set is lost
+        radioSendData(telemStreamDest, 0, CMD_TELEM_STREAM,
+                sizeof (telemStreamPacket), (unsigned char *) packet, 1);
+        telemStreamTail++;
+    }
+}
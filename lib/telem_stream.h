@@ -0,0 +1,49 @@
+/*
+ * Name: telem_stream.h
+ * Desc: Live decimated telemetry over the radio, CMD_TELEM_STREAM
+ *
+ * Alongside the 1 kHz flash log, telemStreamSample, a Timer1 task, takes a
+ * vrTelemLive_t sample every period ms and collects them into packets in a
+ * small ring. telemStreamProcess, from the main loop, hands finished
+ * packets to the radio only while its TX queue holds fewer than
+ * TELEM_STREAM_TXQ_MAX, and never waits for it. When the radio falls
+ * behind the ring fills and new samples are dropped, so neither the
+ * control loops nor command replies are held up. Each packet is
+ *
+ *   uint16 first    stream sample number of the first sample
+ *   uint16 count
+ *   count samples   uint32 timestamp (timebase us) and vrTelemLive_t
+ *
+ * Dropped samples are numbered too, so a gap in first is what was lost.
+ */
+#ifndef __TELEM_STREAM_H
+#define __TELEM_STREAM_H
+
+#include <stdint.h>
+#include "vr_telem.h"
+
+#define TELEM_STREAM_PER_PACKET 4
+#define TELEM_STREAM_RING       4       // packets, power of 2
+#define TELEM_STREAM_MAX_HZ     200
+// radio TX queue packets, the rest of RADIO_TXPQ_MAX_SIZE is left to
+// command replies
+#ifndef TELEM_STREAM_TXQ_MAX
+#define TELEM_STREAM_TXQ_MAX    4
+#endif
+#define TELEM_STREAM_HEADER     4
+
+typedef struct {
+    uint32_t timestamp;
+    vrTelemLive_t data;
+} telemStreamSample_t;
+
+void telemStreamSetup(void);
+// Streams at rate_hz, up to TELEM_STREAM_MAX_HZ, to dest_addr, or stops for
+// 0; returns the rate in effect, 1000 / period
+unsigned int telemStreamSet(unsigned int rate_hz, unsigned int dest_addr);
+// Timer1 ISR task, once per ms
+void telemStreamSample(void);
+// Main loop: sends the finished packets the radio has room for
+void telemStreamProcess(void);
+
+#endif // __TELEM_STREAM_H
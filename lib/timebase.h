@@ -0,0 +1,55 @@
+/*
+ * Name: timebase.h
+ * Desc: Shared monotonic timebase for the PID, telemetry and commands
+ *
+ * Everything that stamps or schedules reads the one free running 32 bit
+ * clock, sclock, in us since boot: timed run deadlines, the scheduler, the
+ * sensor sample stamps and telemetry, whose timestamps are sclock time
+ * since telemSetStartTime. Nothing resets it, so a telemetry timestamp and
+ * a control event stamp differ only by the telemetry start time.
+ *
+ * The count wraps every 2^32 us, about 71.6 minutes. Times are only ever
+ * compared through timebaseAfter and timebaseReached, which are right
+ * across the wrap for any two times less than 2^31 us (35.8 minutes)
+ * apart, so deadlines are limited to TIMEBASE_MAX_MS ahead.
+ *
+ * Every budget, age and deadline built on it counts one sclock tick as
+ * 1 us, so a build whose sclock runs at any other rate than 1 MHz fails
+ * on SCLOCK_TICKS_PER_MS rather than mis-timing the loop. Dividing the
+ * count down instead would break the wrap, since 2^32 ticks would no
+ * longer be 2^32 us.
+ */
+#ifndef __TIMEBASE_H
+#define __TIMEBASE_H
+
+#include <stdint.h>
+#include "sclock.h"
+#include "loop_rate.h"
+
+#define TIMEBASE_US_PER_MS  1000UL
+
+LOOP_STATIC_ASSERT(SCLOCK_TICKS_PER_MS == TIMEBASE_US_PER_MS, timebase_sclock_us);
+#define TIMEBASE_MAX_MS     (0x7fffffffUL / TIMEBASE_US_PER_MS)
+
+typedef uint32_t timebaseTime;      // us
+
+static inline timebaseTime timebaseNow(void) {
+    return sclockGetTime();
+}
+
+// t + ms, ms at most TIMEBASE_MAX_MS
+static inline timebaseTime timebaseAddMs(timebaseTime t, uint32_t ms) {
+    return t + (ms < TIMEBASE_MAX_MS ? ms : TIMEBASE_MAX_MS) * TIMEBASE_US_PER_MS;
+}
+
+// a is strictly later than b
+static inline unsigned char timebaseAfter(timebaseTime a, timebaseTime b) {
+    return (int32_t) (a - b) > 0;
+}
+
+// now is at or past deadline
+static inline unsigned char timebaseReached(timebaseTime now, timebaseTime deadline) {
+    return (int32_t) (now - deadline) >= 0;
+}
+
+#endif // __TIMEBASE_H
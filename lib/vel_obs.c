@@ -0,0 +1,94 @@
+/*
+ * Name: vel_obs.c
+ * Desc: Alpha-beta leg velocity observer fusing encoder and back EMF
+ *
+ * Called from pidGetState inside the Timer1 ISR; every multiply is 16x16
+ * or goes through the saturating helpers in pid_kernel.h.
+ */
+#include "vel_obs.h"
+#include "pid-ip2.5.h"
+#include "pid_kernel.h"
+
+// back EMF A/D units -> Q8 counts per ms, inverse of K_EMF
+#define VEL_OBS_BEMF_TO_Q8  ((int16_t) ((65536L + K_EMF / 2) / K_EMF))
+
+typedef struct {
+    int32_t pos;            // position estimate, p_state units
+    int32_t vel;            // velocity estimate, Q8 counts per ms
+    int16_t innovation;     // last position innovation, p_state units
+    int16_t estimate;       // vel in A/D units
+    unsigned char init;
+} velObsState;
+
+static velObsState velObs[NUM_PIDS];
+static int16_t velObsAlpha = VEL_OBS_ALPHA;
+static int16_t velObsBeta = VEL_OBS_BETA;
+static int16_t velObsGamma = VEL_OBS_GAMMA;
+
+void velObsSetup(void) {
+    unsigned int i;
+    for (i = 0; i < NUM_PIDS; i++) {
+        velObsReset(i, 0);
+    }
+}
+
+void velObsSetGains(int alpha, int beta, int gamma) {
+    velObsAlpha = alpha;
+    velObsBeta = beta;
+    velObsGamma = gamma;
+}
+
+// Restart the tracker at pos on the next update, e.g. after a zero
+void velObsReset(unsigned int chan, int32_t pos) {
+    velObs[chan].pos = pos;
+    velObs[chan].vel = 0;
+    velObs[chan].innovation = 0;
+    velObs[chan].estimate = 0;
+    velObs[chan].init = 0;
+}
+
+int velObsUpdate(unsigned int chan, int32_t pos, int bemf, int dc) {
+    velObsState *obs = &velObs[chan];
+    int32_t pred, r, rv;
+
+    if (!obs->init) {
+        obs->pos = pos;
+        obs->vel = (int32_t) bemf * VEL_OBS_BEMF_TO_Q8;
+        obs->init = 1;
+    }
+
+    // predict one PID tick ahead, then correct from the encoder
+    pred = obs->pos + ((obs->vel + (128 << PID_TICK_SHIFT)) >> (8 + PID_TICK_SHIFT));
+    r = pos - pred;
+    if (r > VEL_OBS_RESYNC || r < -VEL_OBS_RESYNC) {
+        obs->pos = pos;
+        obs->innovation = r > 0 ? VEL_OBS_RESYNC : -VEL_OBS_RESYNC;
+    } else {
+        obs->pos = pred + (PID_MULSS(velObsAlpha, r) >> 15);
+        obs->vel = pidSatAdd(obs->vel, PID_MULSS(velObsBeta, r) >> (7 - PID_TICK_SHIFT));
+        obs->innovation = r;
+    }
+
+    // back EMF is a direct, lag free speed reading when it can be sampled
+    rv = pidSatSub((int32_t) bemf * VEL_OBS_BEMF_TO_Q8, obs->vel);
+    if (dc < VEL_OBS_BEMF_MAX_DC && dc > -VEL_OBS_BEMF_MAX_DC &&
+            rv < (int32_t) VEL_OBS_BEMF_GATE * VEL_OBS_BEMF_TO_Q8 &&
+            rv > -(int32_t) VEL_OBS_BEMF_GATE * VEL_OBS_BEMF_TO_Q8) {
+        obs->vel = pidSatAdd(obs->vel, pidMulShr(velObsGamma, rv, 15));
+    }
+
+    obs->estimate = pidClamp(pidMulShr(K_EMF, obs->vel, 16), -0x7fff, 0x7fff);
+    return obs->estimate;
+}
+
+int velObsGetVel(unsigned int chan) {
+    return velObs[chan].estimate;
+}
+
+int32_t velObsGetRate(unsigned int chan) {
+    return velObs[chan].vel;
+}
+
+int velObsGetInnovation(unsigned int chan) {
+    return velObs[chan].innovation;
+}
@@ -0,0 +1,37 @@
+/*
+ * Name: vel_obs.h
+ * Desc: Alpha-beta leg velocity observer fusing encoder and back EMF
+ *
+ * Runs once per PID tick per channel. The encoder position drives a
+ * standard alpha-beta tracker; the median filtered back EMF then pulls the
+ * velocity toward the motor speed it measures, unless the duty cycle is too
+ * high to sample it or it disagrees by more than VEL_OBS_BEMF_GATE (brush
+ * shorts). Velocity is kept in [16].[16] counts per ms in Q8 and reported in
+ * back EMF A/D units, so v_input and Kd mean the same as with VEL_BEMF.
+ *
+ * Gains are Q15 fractions per PID tick: alpha and beta act on the position
+ * innovation, gamma on the back EMF velocity innovation.
+ */
+#ifndef __VEL_OBS_H
+#define __VEL_OBS_H
+
+#include <stdint.h>
+
+#define VEL_OBS_ALPHA           16384   // 0.5
+#define VEL_OBS_BETA            4096    // 0.125
+#define VEL_OBS_GAMMA           4096    // 0.125
+#define VEL_OBS_BEMF_MAX_DC     3860    // back EMF blind above ~96.7% duty, see SetupPWM
+#define VEL_OBS_BEMF_GATE       60      // A/D units
+#define VEL_OBS_RESYNC          0x4000  // larger position innovations restart the tracker
+
+void velObsSetup(void);
+void velObsSetGains(int alpha, int beta, int gamma);
+void velObsReset(unsigned int chan, int32_t pos);
+// Returns the velocity estimate in back EMF A/D units
+int velObsUpdate(unsigned int chan, int32_t pos, int bemf, int dc);
+int velObsGetVel(unsigned int chan);
+// The same estimate in p_state units per ms, Q8
+int32_t velObsGetRate(unsigned int chan);
+int velObsGetInnovation(unsigned int chan);
+
+#endif // __VEL_OBS_H
@@ -7,12 +7,17 @@
 
 
 #include <xc.h>
+#include <stddef.h>
+#include <string.h>
 #include "vr_telem.h"
 #include "ams-enc.h"
 #include "mpu6000.h"
 #include "adc_pid.h"
 #include "tih.h"
 #include "pid-ip2.5.h"
+#include "vel_obs.h"
+#include "phase_lock.h"
+#include "utils.h"
 
 // TODO (apullin) : Remove externs by adding getters to other modules
 //extern pidObj motor_pidObjs[NUM_MOTOR_PIDS];
@@ -22,11 +27,124 @@
 extern int bemf[NUM_PIDS];
 extern pidPos pidObjs[NUM_PIDS];
 
+// Every field that can be logged; vrTelemGetData copies the selected ones
+typedef struct {
+    vrTelemStruct_t base;
+    int32_t pL, pR, iL, iR, dL, dR;
+    int16_t vStateL, vStateR, strideL, strideR;
+} vrTelemAll;
+
+typedef struct {
+    vrTelemFieldDesc desc;
+    uint32_t group;                 // VR_TELEM_*
+    unsigned char offset;           // in vrTelemAll
+} vrTelemField;
+
+#define VR_FIELD(type, name, group, member) \
+    {{type, name}, group, offsetof(vrTelemAll, member)}
+
+static const vrTelemField vrTelemFields[VR_TELEM_MAX_FIELDS] = {
+    VR_FIELD('l', "posL",    VR_TELEM_POS,     base.posL),
+    VR_FIELD('l', "posR",    VR_TELEM_POS,     base.posR),
+    VR_FIELD('l', "composL", VR_TELEM_COMPOS,  base.composL),
+    VR_FIELD('l', "composR", VR_TELEM_COMPOS,  base.composR),
+    VR_FIELD('h', "dcL",     VR_TELEM_DC,      base.dcL),
+    VR_FIELD('h', "dcR",     VR_TELEM_DC,      base.dcR),
+    VR_FIELD('h', "gyroX",   VR_TELEM_GYRO,    base.gyroX),
+    VR_FIELD('h', "gyroY",   VR_TELEM_GYRO,    base.gyroY),
+    VR_FIELD('h', "gyroZ",   VR_TELEM_GYRO,    base.gyroZ),
+    VR_FIELD('h', "accelX",  VR_TELEM_ACCEL,   base.accelX),
+    VR_FIELD('h', "accelY",  VR_TELEM_ACCEL,   base.accelY),
+    VR_FIELD('h', "accelZ",  VR_TELEM_ACCEL,   base.accelZ),
+    VR_FIELD('h', "bemfL",   VR_TELEM_BEMF,    base.bemfL),
+    VR_FIELD('h', "bemfR",   VR_TELEM_BEMF,    base.bemfR),
+    VR_FIELD('h', "Vbatt",   VR_TELEM_VBATT,   base.Vbatt),
+    VR_FIELD('h', "velL",    VR_TELEM_VEL,     base.velL),
+    VR_FIELD('h', "velR",    VR_TELEM_VEL,     base.velR),
+    VR_FIELD('h', "innovL",  VR_TELEM_INNOV,   base.innovL),
+    VR_FIELD('h', "innovR",  VR_TELEM_INNOV,   base.innovR),
+    VR_FIELD('h', "phseErr", VR_TELEM_PHASE,   base.phaseErr),
+    VR_FIELD('h', "sat",     VR_TELEM_SAT,     base.sat),
+    VR_FIELD('H', "encAge",  VR_TELEM_AGE,     base.encAge),
+    VR_FIELD('H', "bemfAge", VR_TELEM_AGE,     base.bemfAge),
+    VR_FIELD('H', "gyroAge", VR_TELEM_AGE,     base.gyroAge),
+    VR_FIELD('l', "pL",      VR_TELEM_PID_P,   pL),
+    VR_FIELD('l', "pR",      VR_TELEM_PID_P,   pR),
+    VR_FIELD('l', "iL",      VR_TELEM_PID_I,   iL),
+    VR_FIELD('l', "iR",      VR_TELEM_PID_I,   iR),
+    VR_FIELD('l', "dL",      VR_TELEM_PID_D,   dL),
+    VR_FIELD('l', "dR",      VR_TELEM_PID_D,   dR),
+    VR_FIELD('h', "vStateL", VR_TELEM_V_STATE, vStateL),
+    VR_FIELD('h', "vStateR", VR_TELEM_V_STATE, vStateR),
+    VR_FIELD('h', "strideL", VR_TELEM_STRIDE,  strideL),
+    VR_FIELD('h', "strideR", VR_TELEM_STRIDE,  strideR),
+};
+
+#define VR_FIELD_SIZE(f) ((f)->desc.type == 'l' ? 4 : 2)
+
+// Selected fields, indices into vrTelemFields in record order
+static uint32_t vrTelemMask = VR_TELEM_DEFAULT;
+static unsigned char vrTelemSel[VR_TELEM_MAX_FIELDS] = {
+    0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11,
+    12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23
+};
+static unsigned char vrTelemNumSel = 24;
+static unsigned int vrTelemBytes = sizeof (vrTelemStruct_t);
+
+int vrTelemSetFields(uint32_t mask) {
+    unsigned char sel[VR_TELEM_MAX_FIELDS];
+    unsigned int i, n = 0, bytes = 0;
+
+    for (i = 0; i < VR_TELEM_MAX_FIELDS; i++) {
+        if (vrTelemFields[i].group & mask) {
+            sel[n++] = i;
+            bytes += VR_FIELD_SIZE(&vrTelemFields[i]);
+        }
+    }
+    if (n == 0 || bytes > sizeof (vrTelemStruct_t)) {
+        return -1;
+    }
+    CRITICAL_SECTION_START;
+    memcpy(vrTelemSel, sel, n);
+    vrTelemNumSel = n;
+    vrTelemBytes = bytes;
+    vrTelemMask = mask;
+    CRITICAL_SECTION_END;
+    return 0;
+}
+
+uint32_t vrTelemGetFields(void) {
+    return vrTelemMask;
+}
+
+unsigned int vrTelemNumFields(void) {
+    return vrTelemNumSel;
+}
+
+unsigned int vrTelemDescribe(unsigned int first, vrTelemFieldDesc *desc, unsigned int max) {
+    unsigned int n;
+    for (n = 0; n < max && first + n < vrTelemNumSel; n++) {
+        desc[n] = vrTelemFields[vrTelemSel[first + n]].desc;
+    }
+    return n;
+}
+
+unsigned int vrTelemFieldSizes(unsigned char *sizes) {
+    unsigned int i;
+    for (i = 0; i < vrTelemNumSel; i++) {
+        sizes[i] = VR_FIELD_SIZE(&vrTelemFields[vrTelemSel[i]]);
+    }
+    return vrTelemNumSel;
+}
+
 //void vrTelemGetData(unsigned char* ptr) {
-void vrTelemGetData(vrTelemStruct_t* ptr) {
+void vrTelemGetData(vrTelemStruct_t* out) {
     
-    //vrTelemStruct_t* tptr;
-    //tptr = (vrTelemStruct_t*) ptr;
+    vrTelemAll all;
+    vrTelemStruct_t* ptr = &all.base;
+    unsigned char* dst = (unsigned char*) out;
+    const vrTelemField* f;
+    unsigned int i, size;
 
     int gdata[3];   //gyrodata
     int xldata[3];  // accelerometer data
@@ -35,14 +153,24 @@ void vrTelemGetData(vrTelemStruct_t* ptr) {
     mpuGetXl(xldata);
 
     //Motion control
-    ptr->posL = pidObjs[0].p_state;
-    ptr->posR = pidObjs[1].p_state;
-    ptr->composL = pidObjs[0].p_input + pidObjs[0].interpolate;
-    ptr->composR = pidObjs[1].p_input + pidObjs[1].interpolate;
-    ptr->dcL = pidObjs[0].output; // left
-    ptr->dcR = pidObjs[1].output; // right
-    ptr->bemfL = bemf[0];
-    ptr->bemfR = bemf[1];
+    ptr->posL = pidObjs[LEFT_LEGS_PID_NUM].p_state;
+    ptr->posR = pidObjs[RIGHT_LEGS_PID_NUM].p_state;
+    ptr->composL = pidObjs[LEFT_LEGS_PID_NUM].p_input + pidObjs[LEFT_LEGS_PID_NUM].interpolate;
+    ptr->composR = pidObjs[RIGHT_LEGS_PID_NUM].p_input + pidObjs[RIGHT_LEGS_PID_NUM].interpolate;
+    ptr->dcL = pidObjs[LEFT_LEGS_PID_NUM].output; // left
+    ptr->dcR = pidObjs[RIGHT_LEGS_PID_NUM].output; // right
+    ptr->bemfL = bemf[LEFT_LEGS_PID_NUM];
+    ptr->bemfR = bemf[RIGHT_LEGS_PID_NUM];
+    ptr->velL = velObsGetVel(LEFT_LEGS_PID_NUM);
+    ptr->velR = velObsGetVel(RIGHT_LEGS_PID_NUM);
+    ptr->innovL = velObsGetInnovation(LEFT_LEGS_PID_NUM);
+    ptr->innovR = velObsGetInnovation(RIGHT_LEGS_PID_NUM);
+    ptr->phaseErr = phaseLockGetError();
+    ptr->sat = pidObjs[LEFT_LEGS_PID_NUM].satFlags |
+            (pidObjs[RIGHT_LEGS_PID_NUM].satFlags << 4);
+    ptr->encAge = pidGetSampleAge(PID_SENSOR_ENC);
+    ptr->bemfAge = pidGetSampleAge(PID_SENSOR_BEMF);
+    ptr->gyroAge = pidGetSampleAge(PID_SENSOR_GYRO);
 
     //gyro and XL
     ptr->gyroX = gdata[0];
@@ -54,10 +182,51 @@ void vrTelemGetData(vrTelemStruct_t* ptr) {
 
     //Battery
     ptr->Vbatt = (int) adcGetVbatt();
+
+    if (vrTelemMask == VR_TELEM_DEFAULT) {
+        *out = all.base;
+        return;
+    }
+
+    //Extras
+    all.pL = pidObjs[LEFT_LEGS_PID_NUM].p;
+    all.pR = pidObjs[RIGHT_LEGS_PID_NUM].p;
+    all.iL = pidObjs[LEFT_LEGS_PID_NUM].i;
+    all.iR = pidObjs[RIGHT_LEGS_PID_NUM].i;
+    all.dL = pidObjs[LEFT_LEGS_PID_NUM].d;
+    all.dR = pidObjs[RIGHT_LEGS_PID_NUM].d;
+    all.vStateL = pidObjs[LEFT_LEGS_PID_NUM].v_state;
+    all.vStateR = pidObjs[RIGHT_LEGS_PID_NUM].v_state;
+    all.strideL = pidObjs[LEFT_LEGS_PID_NUM].leg_stride;
+    all.strideR = pidObjs[RIGHT_LEGS_PID_NUM].leg_stride;
+
+    //Selected fields, packed
+    for (i = 0; i < vrTelemNumSel; i++) {
+        f = &vrTelemFields[vrTelemSel[i]];
+        size = VR_FIELD_SIZE(f);
+        memcpy(dst, (unsigned char*) &all + f->offset, size);
+        dst += size;
+    }
+    memset(dst, 0, (unsigned char*) (out + 1) - dst);
+}
+
+void vrTelemGetLive(vrTelemLive_t* ptr) {
+    int gdata[3];
+    mpuGetGyro(gdata);
+
+    ptr->posL = pidObjs[LEFT_LEGS_PID_NUM].p_state;
+    ptr->posR = pidObjs[RIGHT_LEGS_PID_NUM].p_state;
+    ptr->dcL = pidObjs[LEFT_LEGS_PID_NUM].output;
+    ptr->dcR = pidObjs[RIGHT_LEGS_PID_NUM].output;
+    ptr->gyroZ = gdata[2];
+    ptr->Vbatt = (int) adcGetVbatt();
+    ptr->phaseErr = phaseLockGetError();
+    ptr->sat = pidObjs[LEFT_LEGS_PID_NUM].satFlags |
+            (pidObjs[RIGHT_LEGS_PID_NUM].satFlags << 4);
 }
 
 //This may be unneccesary, since the telemtry type isn't totally anonymous
 
-unsigned int orTelemGetSize() {
-    return sizeof (vrTelemStruct_t);
+unsigned int vrTelemGetSize() {
+    return vrTelemBytes;
 }
\ No newline at end of file
@@ -1,4 +1,6 @@
 //vr_telem.h , VelociRoACH specific telemetry packet format header
+#ifndef __VR_TELEM_H
+#define __VR_TELEM_H
 
 #include <stdint.h>
 
@@ -20,9 +22,79 @@ typedef struct {
     int16_t bemfL;
     int16_t bemfR;
     int16_t Vbatt; // battery voltage
+    int16_t velL; // velocity observer estimate, A/D units
+    int16_t velR;
+    int16_t innovL; // velocity observer position innovation
+    int16_t innovR;
+    int16_t phaseErr; // left/right phase lock error, 0x10000 per rev
+    int16_t sat; // PID_SAT_* output limits hit, left bits 0-3, right 4-7
+    uint16_t encAge; // us from sensor sample to control instant, PID_SENSOR_*
+    uint16_t bemfAge;
+    uint16_t gyroAge;
 } vrTelemStruct_t;
 
+// Field groups logged, CMD_SET_TELEM_FIELDS. Selected fields are packed
+// from the start of the record in the order of the table in vr_telem.c,
+// which is vrTelemStruct_t order and then the extras; the default is
+// exactly vrTelemStruct_t. The selection must fit in vrTelemStruct_t.
+#define VR_TELEM_POS        0x00001UL   // posL, posR
+#define VR_TELEM_COMPOS     0x00002UL   // composL, composR
+#define VR_TELEM_DC         0x00004UL   // dcL, dcR
+#define VR_TELEM_GYRO       0x00008UL   // gyroX, gyroY, gyroZ
+#define VR_TELEM_ACCEL      0x00010UL   // accelX, accelY, accelZ
+#define VR_TELEM_BEMF       0x00020UL   // bemfL, bemfR
+#define VR_TELEM_VBATT      0x00040UL
+#define VR_TELEM_VEL        0x00080UL   // velL, velR
+#define VR_TELEM_INNOV      0x00100UL   // innovL, innovR
+#define VR_TELEM_PHASE      0x00200UL   // phaseErr
+#define VR_TELEM_SAT        0x00400UL
+#define VR_TELEM_AGE        0x00800UL   // encAge, bemfAge, gyroAge
+#define VR_TELEM_DEFAULT    0x00fffUL
+// extras, pidPos per leg
+#define VR_TELEM_PID_P      0x01000UL   // pL, pR: p terms, int32
+#define VR_TELEM_PID_I      0x02000UL   // iL, iR
+#define VR_TELEM_PID_D      0x04000UL   // dL, dR
+#define VR_TELEM_V_STATE    0x08000UL   // vStateL, vStateR
+#define VR_TELEM_STRIDE     0x10000UL   // strideL, strideR: leg_stride
+
+#define VR_TELEM_MAX_FIELDS 34
+#define VR_TELEM_NAME_LEN   7
+
+// Schema entry: struct module format character ('l', 'h' or 'H') and the
+// NUL padded column name
+typedef struct {
+    char type;
+    char name[VR_TELEM_NAME_LEN];
+} vrTelemFieldDesc;
+
+// Live stream subset, CMD_TELEM_STREAM, whatever the logged fields
+typedef struct {
+    int32_t posL;
+    int32_t posR;
+    int16_t dcL;
+    int16_t dcR;
+    int16_t gyroZ;
+    int16_t Vbatt;
+    int16_t phaseErr;
+    int16_t sat;
+} vrTelemLive_t;
+
 //void vrTelemGetData(unsigned char* ptr);
 void vrTelemGetData(vrTelemStruct_t* ptr);
 
-unsigned int vrTelemGetSize();
\ No newline at end of file
+void vrTelemGetLive(vrTelemLive_t* ptr);
+
+// Bytes of the selected fields
+unsigned int vrTelemGetSize();
+
+// Returns 0, or -1 for an empty selection or one that does not fit; only
+// while no samples are being saved
+int vrTelemSetFields(uint32_t mask);
+uint32_t vrTelemGetFields(void);
+unsigned int vrTelemNumFields(void);
+// Descriptors of selected fields first.., at most max; returns how many
+unsigned int vrTelemDescribe(unsigned int first, vrTelemFieldDesc *desc, unsigned int max);
+// Byte size, 2 or 4, of each selected field; returns the number of fields
+unsigned int vrTelemFieldSizes(unsigned char *sizes);
+
+#endif // __VR_TELEM_H
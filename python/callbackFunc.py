@@ -18,11 +18,11 @@ pktFormat = { \
     command.GET_PID_TELEMETRY:      '', \
     command.GET_AMS_POS:            '=2l', \
     command.GET_IMU_LOOP_ZGYRO:     '='+2*'Lhhh', \
-    command.SET_MOVE_QUEUE:         '', \
+    command.SET_MOVE_QUEUE:         '3h', \
     command.SET_STEERING_GAINS:     '6h', \
     command.SOFTWARE_RESET:         '', \
     command.ERASE_SECTORS:          'L', \
-    command.FLASH_READBACK:         '=LL' +'4l'+'11h', \
+    command.FLASH_READBACK:         '=LL' +'4l'+'17h'+'3H', \
     command.SLEEP:                  'b', \
     command.ECHO:                   'c' ,\
     command.SET_VEL_PROFILE:        '8h' ,\
@@ -122,6 +122,19 @@ def xbee_received(packet):
             print 'Hall zeros established; Previous motor positions:',
             motor = unpack(pattern,data)
             print motor
+        # SET_STEERING_GAINS
+        elif (type == command.SET_STEERING_GAINS):
+            gains = unpack(pattern, data)
+            print "Steering gains set to",gains[:5],"mode",gains[5]
+        # SET_MOVE_QUEUE
+        elif (type == command.SET_MOVE_QUEUE):
+            (accepted, queued, held) = unpack(pattern, data)
+            if queued < 0:
+                print "Move queue full,",accepted,"segments accepted"
+            else:
+                print "Move queue:",accepted,"segments accepted,",queued,"queued"
+            if held > 0:
+                print "Move queue:",held,"table swaps held, the table upload was not complete"
         # SET_VEL_PROFILE
         elif (type == command.SET_VEL_PROFILE):
             print "Set Velocity Profile readback:"
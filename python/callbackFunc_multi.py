@@ -1,5 +1,5 @@
 from lib import command
-from struct import pack,unpack
+from struct import pack,unpack,calcsize
 import time,sys,os,traceback
 
 # Path to imageproc-settings repo must be added
@@ -18,18 +18,166 @@ pktFormat = { \
     command.GET_PID_TELEMETRY:      '', \
     command.GET_AMS_POS:            '=2l', \
     command.GET_IMU_LOOP_ZGYRO:     '='+2*'Lhhh', \
-    command.SET_MOVE_QUEUE:         '', \
+    command.SET_MOVE_QUEUE:         '3h', \
     command.SET_STEERING_GAINS:     '6h', \
     command.SOFTWARE_RESET:         '', \
     command.ERASE_SECTORS:          'L', \
-    command.FLASH_READBACK:         '=LL' +'4l'+'11h', \
+    command.FLASH_READBACK:         '=L', \
     command.SLEEP:                  'b', \
     command.ECHO:                   'c' ,\
     command.SET_VEL_PROFILE:        '8h' ,\
     command.WHO_AM_I:               '', \
     command.ZERO_POS:               '=2l', \
+    command.GET_ISR_STATS:          '=6HL16H', \
+    command.BENCH_PID:              '=Ll', \
+    command.SET_VEL_ESTIMATOR:      '4h', \
+    command.SET_GAIT_TABLE:         '3h', \
+    command.SET_PHASE_LOCK:         '4h', \
+    command.SET_OUTPUT_LIMITS:      '2h', \
+    command.SET_GAIN_TABLE:         '2h', \
+    command.SET_BATT_COMP:          '=hH', \
+    command.AUTOTUNE:               '=3h2H3h', \
+    command.SET_EXCITATION:         '=4h6HhL', \
+    command.SET_ILC:                '=2h2H', \
+    command.RESET_ILC:              '', \
+    command.SET_LATENCY_COMP:       '2H', \
+    command.FLASH_READBACK_PACKED:  '=LB', \
+    command.SET_TELEM_COMP:         'h', \
+    command.FLASH_READBACK_COMP:    '=3H', \
+    command.SET_TELEM_FIELDS:       '=LBB', \
+    command.TELEM_STREAM:           '=2H', \
     }
                
+#Timer1 scheduler tasks, in the order of the table in lib/sched.c
+ISR_TASK_NAMES = ['telemetry', 'stream', 'imu', 'encoder', 'pid']
+
+#Velocity estimators, PID_VEL_* in lib/pid-ip2.5.h
+VEL_ESTIMATOR_NAMES = {0: 'diff', 1: 'bemf', 2: 'fused'}
+
+#Telemetry schema, see lib/vr_telem.h: (struct type, name) of each field
+# after the timestamp, as SET_TELEM_FIELDS reports them. The default is
+# what the firmware logs until told otherwise
+TELEM_DEFAULT_FIELDS = [('l', 'posL'), ('l', 'posR'), ('l', 'composL'),
+    ('l', 'composR'), ('h', 'dcL'), ('h', 'dcR'), ('h', 'gyroX'),
+    ('h', 'gyroY'), ('h', 'gyroZ'), ('h', 'accelX'), ('h', 'accelY'),
+    ('h', 'accelZ'), ('h', 'bemfL'), ('h', 'bemfR'), ('h', 'Vbatt'),
+    ('h', 'velL'), ('h', 'velR'), ('h', 'innovL'), ('h', 'innovR'),
+    ('h', 'phseErr'), ('h', 'sat'), ('H', 'encAge'), ('H', 'bemfAge'),
+    ('H', 'gyroAge')]
+TELEM_FIELD_DESC = '=c7s'
+
+#A saved sample without its index: timestamp and the schema fields
+def telemFormat(r):
+    return '=L' + ''.join(t for (t, name) in r.telemFields)
+
+#FLASH_READBACK_PACKED sample stream, see lib/telem_pack.h: samples back
+# to back, telemRecord(r) bytes each
+def telemRecord(r):
+    return calcsize(telemFormat(r))
+
+#Place one packed readback packet in the robot's copy of the stream and
+# decode the samples it completes into telemtryData
+def telemUnpackStream(r, start, offset, data):
+    record = telemRecord(r)
+    pos = start*record + offset
+    end = min(pos + len(data), len(r.packStream))
+    if pos >= end:
+        print "Got out of range packed readback start =",start
+        return
+    r.packStream[pos:end] = data[:end - pos]
+    r.packMask[pos:end] = '\x01' * (end - pos)
+    for index in range(start, (end - 1) // record + 1):
+        lo = index*record
+        if r.telemtryData[index] == [] and '\x00' not in r.packMask[lo:lo + record]:
+            r.telemtryData[index] = list(unpack(telemFormat(r),
+                str(r.packStream[lo:lo + record])))
+
+#Live telemetry, see lib/telem_stream.h: timestamp (us), posL, posR, dcL,
+# dcR, gyroZ, Vbatt, phaseErr, sat
+TELEM_STREAM_SAMPLE = '=L2l6h'
+
+#Samples of one TELEM_STREAM packet into streamData, and a status line of
+# stride frequency, phase error and battery over the packet
+def telemStreamPacket(r, first, count, data):
+    size = calcsize(TELEM_STREAM_SAMPLE)
+    if r.streamNext is not None:
+        r.streamLost += (first - r.streamNext) & 0xffff
+    r.streamNext = (first + count) & 0xffff
+    samples = [unpack(TELEM_STREAM_SAMPLE, data[k*size:(k + 1)*size])
+        for k in range(min(count, len(data) // size))]
+    r.streamData.extend(samples)
+    if len(samples) < 2 or not r.streamPrint:
+        return
+    dt = ((samples[-1][0] - samples[0][0]) & 0xffffffff) / 1e6
+    freqL = (samples[-1][1] - samples[0][1]) / 65536.0 / dt
+    freqR = (samples[-1][2] - samples[0][2]) / 65536.0 / dt
+    print "\rlive: freq %.2f/%.2f Hz  phase err 0x%04X  Vbatt %d  lost %d   " % \
+        (freqL, freqR, samples[-1][7] & 0xffff, samples[-1][6], r.streamLost),
+    sys.stdout.flush()
+
+#Compressed telemetry pages, see lib/telem_comp.h: header, keyframe, deltas
+TELEM_COMP_PAGE = 528           #AT45DB161D page bytes
+TELEM_COMP_HEADER = '<LHH'
+
+def telemDecodePage(r, page):
+    # [(sampleIndex, datum)] of one whole page; the record as 32 and 16 bit
+    # unsigned fields, 32 bit ones predicted linearly
+    fmt = telemFormat(r)
+    fields = '<' + ''.join('L' if t in 'lL' else 'H' for t in fmt[1:])
+    (first, count, used) = unpack(TELEM_COMP_HEADER, str(page[:8]))
+    if first == 0xffffffff:
+        return []
+    pos = 8 + calcsize(fields)
+    cur = list(unpack(fields, str(page[8:pos])))
+    prev2 = prev = cur
+    samples = []
+    for i in range(count):
+        if i > 0:
+            (mask,) = unpack('<L', str(page[pos:pos + 4]))
+            pos += 4
+            cur = []
+            for k in range(len(prev)):
+                r = 0
+                if mask & (1 << k):
+                    z = shift = 0
+                    while True:
+                        b = page[pos]
+                        pos += 1
+                        z |= (b & 0x7f) << shift
+                        shift += 7
+                        if b < 0x80:
+                            break
+                    r = (z >> 1) ^ -(z & 1)
+                if fields[k + 1] == 'L':
+                    cur.append((2*prev[k] - prev2[k] + r) & 0xffffffff)
+                else:
+                    cur.append((prev[k] + r) & 0xffff)
+            prev2, prev = prev, cur
+        samples.append((first + i, list(unpack(fmt, pack(fields, *cur)))))
+    return samples
+
+#Place one compressed readback packet in the robot's copy of the page and
+# decode the page into telemtryData once its used bytes are all in
+def telemUnpackPage(r, page, byte, pages, data):
+    r.compPageCount = pages
+    if page not in r.compPages:
+        r.compPages[page] = (bytearray(TELEM_COMP_PAGE), bytearray(TELEM_COMP_PAGE))
+    (image, mask) = r.compPages[page]
+    end = min(byte + len(data), TELEM_COMP_PAGE)
+    r.compBytes += mask[byte:end].count('\x00')
+    image[byte:end] = data[:end - byte]
+    mask[byte:end] = '\x01' * (end - byte)
+    if page in r.compDone or '\x00' in mask[:8]:
+        return
+    (used,) = unpack('<H', str(image[6:8]))
+    if used > TELEM_COMP_PAGE or used < 8 + telemRecord(r):
+        r.compDone.add(page)        #erased
+    elif '\x00' not in mask[:used]:
+        r.compDone.add(page)
+        for (index, datum) in telemDecodePage(r, image):
+            if index < r.numSamples and r.telemtryData[index] == []:
+                r.telemtryData[index] = datum
+               
 #XBee callback function, called every time a packet is recieved
 def xbee_received(packet):
     rf_data = packet.get('rf_data')
@@ -93,19 +241,66 @@ def xbee_received(packet):
         elif type == command.FLASH_READBACK:
             #shared.pkts = shared.pkts + 1
             #print "Special Telemetry Data Packet, ",shared.pkts
-            datum = unpack(pattern, data)
-            datum = list(datum)
-            telem_index = datum.pop(0) #pop removes this from data array
-            #print "Special Telemetry Data Packet #",telem_index
-            #print datum
-            if (datum[0] != -1) and (telem_index) >= 0:
-                for r in shared.ROBOTS:
-                    if r.DEST_ADDR_int == src_addr:
+            for r in shared.ROBOTS:
+                if r.DEST_ADDR_int == src_addr:
+                    #sampleIndex, then the schema fields padded to a whole
+                    # telemStruct_t
+                    fmt = pattern + telemFormat(r)[1:]
+                    datum = list(unpack(fmt, data[:calcsize(fmt)]))
+                    telem_index = datum.pop(0) #pop removes this from data array
+                    #print "Special Telemetry Data Packet #",telem_index
+                    #print datum
+                    if (datum[0] != -1) and (telem_index) >= 0:
                         if telem_index <= r.numSamples:
                             r.telemtryData[telem_index] = datum
                         else:
                             print "Got out of range telem_index =",telem_index
         
+        # FLASH_READBACK_PACKED
+        elif type == command.FLASH_READBACK_PACKED:
+            (start, offset) = unpack(pattern, data[:calcsize(pattern)])
+            for r in shared.ROBOTS:
+                if r.DEST_ADDR_int == src_addr and r.packStream is not None:
+                    telemUnpackStream(r, start, offset, data[calcsize(pattern):])
+
+        # FLASH_READBACK_COMP
+        elif type == command.FLASH_READBACK_COMP:
+            (page, byte, pages) = unpack(pattern, data[:calcsize(pattern)])
+            for r in shared.ROBOTS:
+                if r.DEST_ADDR_int == src_addr and r.compPages is not None:
+                    telemUnpackPage(r, page, byte, pages, data[calcsize(pattern):])
+
+        # SET_TELEM_FIELDS
+        elif type == command.SET_TELEM_FIELDS:
+            (mask, first, total) = unpack(pattern, data[:calcsize(pattern)])
+            size = calcsize(TELEM_FIELD_DESC)
+            desc = data[calcsize(pattern):]
+            for r in shared.ROBOTS:
+                if r.DEST_ADDR_int == src_addr:
+                    if first == 0:
+                        r.telemSchema = []
+                    if r.telemSchema is None or len(r.telemSchema) != first:
+                        continue    #a lost reply, ask again
+                    for pos in range(0, len(desc) - size + 1, size):
+                        (t, name) = unpack(TELEM_FIELD_DESC, desc[pos:pos + size])
+                        r.telemSchema.append((t, name.rstrip('\x00')))
+                    if len(r.telemSchema) == total:
+                        r.telemFields = r.telemSchema
+                        r.telemFieldMask = mask
+                        print "Telemetry fields 0x%05X:" % mask, \
+                            ' '.join(name for (t, name) in r.telemFields)
+
+        # TELEM_STREAM
+        elif type == command.TELEM_STREAM:
+            for r in shared.ROBOTS:
+                if r.DEST_ADDR_int == src_addr:
+                    if len(data) == 2:
+                        (rate,) = unpack('=H', data)
+                        print "Telemetry stream", "at %d Hz" % rate if rate else "off"
+                    else:
+                        (first, count) = unpack(pattern, data[:calcsize(pattern)])
+                        telemStreamPacket(r, first, count, data[calcsize(pattern):])
+
         # ERASE_SECTORS
         elif type == command.ERASE_SECTORS:
             datum = unpack(pattern, data)
@@ -127,12 +322,131 @@ def xbee_received(packet):
             motor = unpack(pattern,data)
             print motor
             
+        # SET_STEERING_GAINS
+        elif (type == command.SET_STEERING_GAINS):
+            gains = unpack(pattern, data)
+            print "Steering gains set to",gains[:5],"mode",gains[5]
+
+        # SET_OUTPUT_LIMITS
+        elif (type == command.SET_OUTPUT_LIMITS):
+            (channel, result) = unpack(pattern, data)
+            if result < 0:
+                print "Output limits rejected, channel",channel
+            else:
+                print "Output limits set for channel",channel
+
+        # SET_GAIN_TABLE
+        elif (type == command.SET_GAIN_TABLE):
+            (channel, result) = unpack(pattern, data)
+            if result < 0:
+                print "Gain table rejected, channel",channel
+            else:
+                print "Gain table set for channel",channel
+
+        # SET_BATT_COMP
+        elif (type == command.SET_BATT_COMP):
+            (enable, nominal) = unpack(pattern, data)
+            print "Battery compensation enable",enable,"nominal",nominal
+
+        # SET_MOVE_QUEUE
+        elif (type == command.SET_MOVE_QUEUE):
+            (accepted, queued, held) = unpack(pattern, data)
+            if queued < 0:
+                print "Move queue full,",accepted,"segments accepted"
+            else:
+                print "Move queue:",accepted,"segments accepted,",queued,"queued"
+            if held > 0:
+                print "Move queue:",held,"table swaps held, the table upload was not complete"
+
         # SET_VEL_PROFILE
         elif (type == command.SET_VEL_PROFILE):
             print "Set Velocity Profile readback:"
             temp = unpack(pattern, data)
             print temp
             
+        # GET_ISR_STATS
+        elif (type == command.GET_ISR_STATS):
+            stats = unpack(pattern, data)
+            slot = stats[0]
+            if slot < len(ISR_TASK_NAMES):
+                name = ISR_TASK_NAMES[slot]
+            else:
+                name = "state read"
+            print "ISR %s: n = %d, min/mean/max = %d/%d/%d us, overruns = %d, shed = %d" % \
+                (name, stats[6], stats[1], stats[3], stats[2], stats[4], stats[5])
+            print "    log2 hist:", list(stats[7:])
+
+        # SET_VEL_ESTIMATOR
+        elif (type == command.SET_VEL_ESTIMATOR):
+            est = unpack(pattern, data)
+            print "Set velocity estimator to", VEL_ESTIMATOR_NAMES.get(est[0], est[0]), \
+                "alpha/beta/gamma =", est[1:]
+
+        # SET_PHASE_LOCK
+        elif (type == command.SET_PHASE_LOCK):
+            lock = unpack(pattern, data)
+            print "Phase lock", "on" if lock[0] else "off", \
+                "target = 0x%04X, Kp/Ki =" % (lock[1] & 0xffff), lock[2:]
+
+        # SET_GAIT_TABLE
+        elif (type == command.SET_GAIT_TABLE):
+            (channel, loaded, num_points) = unpack(pattern, data)
+            if loaded < 0:
+                print "Gait table chunk rejected, channel",channel
+            else:
+                print "Gait table channel %d: %d/%d points" % (channel, loaded, num_points)
+
+        # BENCH_PID
+        elif (type == command.BENCH_PID):
+            (iterations, us) = unpack(pattern, data)
+            if us < 0:
+                print "UpdatePID timing refused, stop the motors first"
+            elif iterations > 0:
+                print "UpdatePID: %d calls in %d us, %.2f us per call" % \
+                    (iterations, us, float(us) / iterations)
+            
+        # AUTOTUNE
+        elif (type == command.AUTOTUNE):
+            (channel, tuneStatus, Ku, Pu, swing, Kp, Ki, Kd) = unpack(pattern, data)
+            if tuneStatus == command.AUTOTUNE_DONE:
+                print "Autotune channel %d: Ku %d Pu %d ms swing 0x%04X, gains [%d,%d,%d]" % \
+                    (channel, Ku, Pu, swing, Kp, Ki, Kd)
+            elif tuneStatus != command.AUTOTUNE_RUNNING:
+                print "Autotune channel",channel,"failed, status",tuneStatus
+            for r in shared.ROBOTS:
+                if r.DEST_ADDR_int == src_addr:
+                    r.autotune_result[channel] = (tuneStatus, Kp, Ki, Kd)
+
+        # SET_EXCITATION
+        elif (type == command.SET_EXCITATION):
+            datum = unpack(pattern, data)
+            print "Excitation channel",datum[0],"type",datum[1],"offset",datum[2], \
+                "amplitude",datum[3],"for",datum[4],"ms"
+            if datum[10] & command.EXCITE_FLAG_START:
+                print "Excitation started, logging",datum[11],"samples"
+
+        # SET_ILC
+        elif (type == command.SET_ILC):
+            (enable, gain, lead, forget) = unpack(pattern, data)
+            print "ILC enable",enable,"gain",gain,"lead",lead,"forget",forget
+
+        # RESET_ILC
+        elif (type == command.RESET_ILC):
+            print "ILC corrections cleared"
+
+        # SET_LATENCY_COMP
+        elif (type == command.SET_LATENCY_COMP):
+            (mask, ctrlDelay) = unpack(pattern, data)
+            print "Latency compensation mask",mask,"control delay",ctrlDelay,"us"
+
+        # SET_TELEM_COMP
+        elif (type == command.SET_TELEM_COMP):
+            (enabled,) = unpack(pattern, data)
+            print "Compressed telemetry", "on" if enabled else "off"
+            for r in shared.ROBOTS:
+                if r.DEST_ADDR_int == src_addr:
+                    r.telemCompress = enabled != 0
+
         # WHO_AM_I
         elif (type == command.WHO_AM_I):
             print "query : ",data
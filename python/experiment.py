@@ -32,6 +32,7 @@ def main():
 
     params = hallParams(motorgains, duration, rightFreq, leftFreq, phase, telemetry, repeat)
     setMotorGains(motorgains)
+    setPhaseLock(True)
 
     leadIn = 10
     leadOut = 10
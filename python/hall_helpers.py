@@ -195,17 +195,23 @@ def setVelProfile(params, manParams, manFlag):
     print temp
     xb_send(0,command.SET_VEL_PROFILE, pack('12h',*temp))
 
+# The robot sequences the maneuver from its move queue: lead in strides on
+# the tripod profile, one stride of the maneuver profile, then back to the
+# tripod. The maneuver only has to arrive during the lead in.
 def runManeuver(params, manParams):
     p = 1.0/manParams.strideFreq
-    temp = [100,0,0,0,0,0,100,0,0,0,0,0]
-    xb_send(0,command.SET_VEL_PROFILE, pack('12h',*temp))
+    setVelProfile(params,manParams,False)
+    time.sleep(0.01)
+    swap = command.MOVE_SWAP_TABLE
+    temp = [3, 0, 0, 0, manParams.leadIn, command.MOVE_FLUSH | swap,
+            0, 0, 0, 1, swap,
+            0, 0, 0, manParams.leadOut, swap] + [0] * 25
+    xb_send(0, command.SET_MOVE_QUEUE, pack('h' + 8 * 'hhhHh', *temp))
     time.sleep(0.01)
     xb_send(0, command.START_TIMED_RUN, pack('h',int(1000*p*(manParams.leadOut+manParams.leadIn+1))))
     time.sleep(0.01)
-    setVelProfile(params,manParams,False)
-    time.sleep(p*(manParams.leadIn - 0.5))
     setVelProfile(params,manParams,True)
-    time.sleep(manParams.leadOut * p)
+    time.sleep(p*(manParams.leadIn + manParams.leadOut + 1))
 
 
 # rVel = 1043*vel + 80*turn_rate
@@ -254,6 +260,11 @@ def getVelProfile(params):
         
     
 # set robot control gains
+# Hold the leg phase on the robot; SET_PHASE before each run moves the target
+def setPhaseLock(enable, kp = 512, ki = 512):
+    xb_send(0, command.SET_PHASE_LOCK, pack('4h', int(enable), -0x8000, kp, ki))
+    time.sleep(0.01)
+
 def setMotorGains(motorgains):
     count = 0
     while not(shared.motor_gains_set):
@@ -388,7 +399,7 @@ def writeFileHeader(dataFileName, params, manParams):
     fileout.write('"%  Motor Gains    = ' + repr(params.motorgains) + '\n')
     fileout.write('"% Columns: "\n')
     # order for wiring on RF Turner
-    fileout.write('"% time | Right Leg Pos | Left Leg Pos | Commanded Right Leg Pos | Commanded Left Leg Pos | DCR | DCL | GyroX | GryoY | GryoZ | AX | AY | AZ | RBEMF | LBEMF | VBatt "\n')
+    fileout.write('"% time | Right Leg Pos | Left Leg Pos | Commanded Right Leg Pos | Commanded Left Leg Pos | DCR | DCL | GyroX | GryoY | GryoZ | AX | AY | AZ | RBEMF | LBEMF | VBatt | LVelEst | RVelEst | LInnov | RInnov | PhaseErr | Sat | EncAge | BemfAge | GyroAge "\n')
     fileout.close()
 
 def eraseFlashMem(numSamples):
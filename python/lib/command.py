@@ -57,6 +57,12 @@ GET_PID_TELEMETRY       =   0x83
 GET_AMS_POS		        =   0x84
 GET_IMU_LOOP_ZGYRO      =   0x85
 SET_MOVE_QUEUE          =   0x86
+
+#Move queue segment flags, MOVE_* in lib/move_queue.h
+MOVE_SWAP_TABLE         =   0x01
+MOVE_SET_PHASE          =   0x02
+MOVE_DURATION           =   0x04
+MOVE_FLUSH              =   0x80
 SET_STEERING_GAINS      =   0x87
 SOFTWARE_RESET          =   0x88
 ERASE_SECTORS           =   0x8A
@@ -70,5 +76,64 @@ START_TIMED_RUN         =   0x91
 PID_STOP_MOTORS         =   0x92
 SET_PHASE               =   0x93
 SET_MOTOR_MODE      =   0x94
+GET_ISR_STATS           =   0x95
+BENCH_PID               =   0x96
+SET_VEL_ESTIMATOR       =   0x97
+SET_GAIT_TABLE          =   0x98
+SET_PHASE_LOCK          =   0x99
+SET_YAW_RATE            =   0x9A
+SET_GAIN_TABLE          =   0x9B
+SET_BATT_COMP           =   0x9C
+AUTOTUNE                =   0x9D
+SET_EXCITATION          =   0x9E
+SET_OUTPUT_LIMITS       =   0x9F
+SET_ILC                 =   0xA0
+RESET_ILC               =   0xA1
+SET_LATENCY_COMP        =   0xA2
+FLASH_READBACK_PACKED   =   0xA3
+FLASH_READBACK_RANGES   =   0xA4
+SET_TELEM_COMP          =   0xA5
+FLASH_READBACK_COMP     =   0xA6
+SET_TELEM_FIELDS        =   0xA7
+TELEM_STREAM            =   0xA8
+
+#Autotune tuning rules and status, AUTOTUNE_* in lib/autotune.h
+AUTOTUNE_RULE_ZN        =   0
+AUTOTUNE_RULE_OVERSHOOT =   1
+AUTOTUNE_RULE_NO_OVERSHOOT = 2
+AUTOTUNE_RUNNING        =   1
+AUTOTUNE_DONE           =   2
+
+#Sensors for SET_LATENCY_COMP, PID_LATENCY_* in lib/pid-ip2.5.h
+LATENCY_ENC             =   0x01
+LATENCY_BEMF            =   0x02
+LATENCY_GYRO            =   0x04
+
+#Telemetry field groups for SET_TELEM_FIELDS, VR_TELEM_* in lib/vr_telem.h
+TELEM_POS               =   0x00001
+TELEM_COMPOS            =   0x00002
+TELEM_DC                =   0x00004
+TELEM_GYRO              =   0x00008
+TELEM_ACCEL             =   0x00010
+TELEM_BEMF              =   0x00020
+TELEM_VBATT             =   0x00040
+TELEM_VEL               =   0x00080
+TELEM_INNOV             =   0x00100
+TELEM_PHASE             =   0x00200
+TELEM_SAT               =   0x00400
+TELEM_AGE               =   0x00800
+TELEM_DEFAULT           =   0x00fff
+TELEM_PID_P             =   0x01000
+TELEM_PID_I             =   0x02000
+TELEM_PID_D             =   0x04000
+TELEM_V_STATE           =   0x08000
+TELEM_STRIDE            =   0x10000
+
+#Excitation signals for SET_EXCITATION, EXCITE_* in lib/excite.h
+EXCITE_OFF              =   0
+EXCITE_PRBS             =   1
+EXCITE_MULTISINE        =   2
+EXCITE_CHIRP            =   3
+EXCITE_FLAG_START       =   0x01
 
 # CMD values of 0xF0(240) - 0xFF(255) are reserved for future use
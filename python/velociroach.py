@@ -2,7 +2,7 @@ import glob
 import time
 import sys
 from lib import command
-from callbackFunc_multi import xbee_received
+from callbackFunc_multi import xbee_received, telemRecord, TELEM_DEFAULT_FIELDS
 import datetime
 import serial
 import shared_multi as shared
@@ -41,11 +41,26 @@ class Velociroach:
     motor_gains_set = False
     robot_queried = False
     flash_erased = False
+    autotune_result = None
     
     currentGait = GaitConfig()
 
     dataFileName = ''
     telemtryData = [ [] ]
+    packStream = None       # FLASH_READBACK_PACKED reassembly, see callbackFunc_multi
+    packMask = None
+    telemCompress = False   # SET_TELEM_COMP, pages reassembled in callbackFunc_multi
+    compPages = None
+    compDone = None
+    compPageCount = 0
+    compBytes = 0
+    telemFields = TELEM_DEFAULT_FIELDS  # SET_TELEM_FIELDS schema, (type, name)
+    telemFieldMask = command.TELEM_DEFAULT
+    telemSchema = None
+    streamData = []         # TELEM_STREAM samples, see callbackFunc_multi
+    streamNext = None
+    streamLost = 0
+    streamPrint = True
     numSamples = 0
     telemSampleFreq = 1000
     VERBOSE = True
@@ -105,6 +120,229 @@ class Velociroach:
         self.tx( 0, command.SET_PHASE, pack('l', phase))
         time.sleep(0.05)        
     
+    def setSteeringGains(self, gains, mode = 1):
+        # gains: [Kp, Ki, Kd, Kaw, Kff] of the yaw rate loop in lib/steering.h
+        # mode: 0 = off, 1 = gyro Z feedback
+        self.clAnnounce()
+        print "Setting steering gains to",gains,"mode",mode
+        self.tx( 0, command.SET_STEERING_GAINS, pack('6h', *(list(gains) + [mode])))
+        time.sleep(0.1)
+
+    def setYawRate(self, dps):
+        # MPU6000 gyro at +-2000 deg/s, 16.4 LSB per deg/s
+        self.clAnnounce()
+        print "Setting yaw rate to",dps,"deg/s"
+        self.tx( 0, command.SET_YAW_RATE, pack('h', int(round(dps * 16.4))))
+        time.sleep(0.05)
+
+    def setOutputLimits(self, channel, minDC = -3800, maxDC = 3800, slew = 0):
+        # Duty limits after the PID, within +-3800 (MAXTHROT), and the max
+        # duty change per ms, 0 for none. The Sat telemetry column
+        # flags which limit acted: 1 max, 2 min, 4 slew; right leg << 4
+        self.clAnnounce()
+        print "Setting output limits for channel",channel,"to",minDC,"..",maxDC,"slew",slew
+        self.tx( 0, command.SET_OUTPUT_LIMITS, pack('=3hH', channel, minDC, maxDC, slew))
+        time.sleep(0.05)
+
+    def setGainTable(self, channel, table, shift, enable = True):
+        # table: 8 rows of [Kp, Ki, Kd, Kaw, Kff], row k at |v_input| of
+        # k << shift A/D units, see lib/gain_sched.h. Resend setMotorGains
+        # after disabling, the robot keeps the last scheduled gains.
+        self.clAnnounce()
+        print "Setting gain table for channel",channel,"shift",shift,"enable",enable
+        flat = [int(g) for row in table for g in row]
+        self.tx( 0, command.SET_GAIN_TABLE, pack('43h', channel, int(enable), shift, *flat))
+        time.sleep(0.1)
+
+    def setBatteryComp(self, nominal, enable = True):
+        # nominal: VBatt telemetry reading the gains were tuned at; PWM is
+        # scaled by nominal / filtered VBatt
+        self.clAnnounce()
+        print "Setting battery compensation to",nominal,"enable",enable
+        self.tx( 0, command.SET_BATT_COMP, pack('=hH', int(enable), nominal))
+        time.sleep(0.05)
+
+    def setPhaseLock(self, enable = True, phase = PHASE_180_DEG, kp = 512, ki = 512):
+        # Hold the left - right leg phase every ms; SET_PHASE also
+        # moves the target. Gains as in lib/phase_lock.h
+        self.clAnnounce()
+        print "Phase lock", "on, holding 0x%04X" % phase if enable else "off"
+        self.tx( 0, command.SET_PHASE_LOCK, pack('4h', int(enable), phase - 0x10000 if phase > 0x7fff else phase, kp, ki))
+        time.sleep(0.05)
+
+    def getIsrStats(self):
+        self.clAnnounce()
+        print "Requesting ISR timing stats"
+        self.tx( 0, command.GET_ISR_STATS, 'stats') #sent data is unimportant
+        time.sleep(0.1)
+
+    def setVelEstimator(self, mode, alpha = 16384, beta = 4096, gamma = 4096):
+        # mode: 0 = position difference, 1 = back emf, 2 = fused observer
+        # alpha, beta, gamma: Q15 observer gains, see lib/vel_obs.h
+        self.clAnnounce()
+        print "Setting velocity estimator to",mode
+        self.tx( 0, command.SET_VEL_ESTIMATOR, pack('4h', mode, alpha, beta, gamma))
+        time.sleep(0.1)
+
+    def setMoveQueue(self, segments, flush = True):
+        # segments: (leftFreq, rightFreq, phase, count, flags) per segment,
+        # run by the robot at stride boundaries; a frequency of 0 keeps the
+        # current one, phase is left - right with 0x10000 per rev, and count
+        # is strides, or ms with command.MOVE_DURATION. See lib/move_queue.h
+        chunk = 8
+        self.clAnnounce()
+        print "Queueing",len(segments),"gait segments"
+        for start in range(0, len(segments), chunk):
+            part = segments[start:start + chunk]
+            temp = [len(part)]
+            for (leftFreq, rightFreq, phase, count, flags) in part:
+                if flush and start == 0 and len(temp) == 1:
+                    flags = flags | command.MOVE_FLUSH
+                temp += [int(1000.0 / leftFreq) if leftFreq > 0 else 0,
+                         int(1000.0 / rightFreq) if rightFreq > 0 else 0,
+                         phase, count, flags]
+            temp += [0] * (5 * (chunk - len(part)))
+            self.tx( 0, command.SET_MOVE_QUEUE, pack('h' + chunk * 'hhhHh', *temp))
+            time.sleep(0.1)
+
+    def setGaitTable(self, channel, positions, period, stride = 1.0, onceFlag = 0):
+        # positions: leg position at equally spaced phases over one stride,
+        # in revolutions; stride: revolutions per stride; period in ms
+        # Sent GAIT_CHUNK_POINTS (cmd.h) points per packet
+        chunk = 32
+        revConv = 0x4000
+        points = [int(p * revConv) for p in positions]
+        self.clAnnounce()
+        print "Setting",len(points),"point gait table on channel",channel
+        for start in range(0, len(points), chunk):
+            part = points[start:start + chunk]
+            temp = [channel, len(points), start, len(part), int(period),
+                    int(stride * revConv), onceFlag] + part + [0] * (chunk - len(part))
+            self.tx( 0, command.SET_GAIT_TABLE, pack('%dh' % (7 + chunk), *temp))
+            time.sleep(0.1)
+
+    def benchPID(self, iterations = 1000):
+        self.clAnnounce()
+        print "Timing",iterations,"UpdatePID calls, motors must be stopped"
+        self.tx( 0, command.BENCH_PID, pack('H', iterations))
+        time.sleep(0.1)
+    
+    def autotune(self, channels = (0, 1), amplitude = 1500, hysteresis = 64,
+                 cycles = 4, rule = command.AUTOTUNE_RULE_OVERSHOOT, timeout = 5000):
+        # Relay experiment on each channel, robot held with legs free; see
+        # lib/autotune.h. Returns {channel: [Kp, Ki, Kd]} for the channels
+        # that found a limit cycle, to go into motorgains with Kaw and ff.
+        self.clAnnounce()
+        print "Autotuning channels",list(channels),"at duty",amplitude
+        self.autotune_result = {}
+        for chan in channels:
+            self.autotune_result[chan] = (command.AUTOTUNE_RUNNING, 0, 0, 0)
+            self.tx( 0, command.AUTOTUNE, pack('=6hH', chan, 1, amplitude,
+                hysteresis, cycles, rule, timeout))
+            time.sleep(0.05)
+        deadline = time.time() + timeout / 1000.0 + 1.0
+        while time.time() < deadline and \
+                any(r[0] == command.AUTOTUNE_RUNNING for r in self.autotune_result.values()):
+            time.sleep(0.2)
+            for chan in channels:
+                self.tx( 0, command.AUTOTUNE, pack('=6hH', chan, 0, 0, 0, 0, 0, 0))
+                time.sleep(0.05)
+        return dict((chan, list(r[1:])) for chan, r in self.autotune_result.items()
+                    if r[0] == command.AUTOTUNE_DONE)
+
+    def setExcitation(self, channel, kind, offset, amplitude, duration,
+                      period = 0, order = 0, f0 = 0.5, f1 = 50.0, start = False,
+                      telemSamples = 0):
+        # System identification duty in PWMPASS mode, see lib/excite.h.
+        # kind: command.EXCITE_PRBS (order bits, period ms per bit),
+        # EXCITE_MULTISINE (order harmonics of a period ms fundamental) or
+        # EXCITE_CHIRP (log sweep f0 to f1 Hz over duration ms).
+        # Configure each channel, then start = True on the last one starts
+        # them all together with telemetry, aligned sample for sample.
+        step = growth = 0
+        if kind == command.EXCITE_CHIRP:
+            step = int(round(f0 * 2**32 / 1000.0))
+            growth = int(round(np.log(float(f1) / f0) / duration * 2**24))
+            if growth > 0xffff:
+                print "Chirp too fast, sweeping at most",np.exp(0xffff * duration / 2.0**24),"x"
+                growth = 0xffff
+        self.clAnnounce()
+        print "Setting excitation",kind,"on channel",channel
+        flags = command.EXCITE_FLAG_START if start else 0
+        self.tx( 0, command.SET_EXCITATION, pack('=4h6HhL', channel, kind, offset,
+            amplitude, duration, period, order, step & 0xffff, step >> 16, growth,
+            flags, telemSamples))
+        time.sleep(0.05)
+
+    def setILC(self, enable = True, gain = 1024, lead = 4, forget = 0.99):
+        # Learns a feedforward correction per 1/64 of stride from the
+        # position error of earlier strides, see lib/ilc.h. gain is Q12
+        # like Kp, lead in 1/64 strides; use about 6 above 10 Hz. Call
+        # resetILC after changing gait
+        self.clAnnounce()
+        print "Setting ILC enable",enable,"gain",gain,"lead",lead,"forget",forget
+        self.tx( 0, command.SET_ILC, pack('=2h2H', enable, gain, lead,
+            min(int(round(forget * 32768)), 0x7fff)))
+        time.sleep(0.05)
+
+    def resetILC(self):
+        self.clAnnounce()
+        print "Clearing ILC corrections"
+        self.tx( 0, command.RESET_ILC, '')
+        time.sleep(0.05)
+
+    def setTelemCompression(self, enable = True):
+        # Delta compressed telemetry in flash, lib/telem_comp.h; set before
+        # eraseFlashMem and startTelemetrySave, downloadTelemetry follows it
+        self.clAnnounce()
+        print "Setting compressed telemetry", "on" if enable else "off"
+        self.tx( 0, command.SET_TELEM_COMP, pack('h', 1 if enable else 0))
+        time.sleep(0.05)
+
+    def setTelemFields(self, mask = command.TELEM_DEFAULT, retries = 8):
+        # Field groups logged, command.TELEM_*; set before startTelemetrySave.
+        # Mask 0 only asks for the schema, which FLASH_READBACK* is decoded
+        # with, so the log in flash is read back as it was saved
+        self.clAnnounce()
+        if mask:
+            print "Setting telemetry fields 0x%05X" % mask
+        else:
+            print "Querying telemetry fields"
+        self.telemSchema = None
+        tries = 0
+        while tries < retries:
+            self.tx( 0, command.SET_TELEM_FIELDS, pack('=L', mask))
+            time.sleep(0.3)
+            if self.telemSchema is not None and self.telemFields is self.telemSchema:
+                break
+            tries = tries + 1
+        if mask and self.telemFieldMask != mask:
+            self.clAnnounce()
+            print "Telemetry fields not changed, busy saving or too many fields"
+
+    def setTelemStream(self, rate = 50, show = True):
+        # Live decimated telemetry during a run, alongside the flash log;
+        # rate 0 stops it. Samples collect in streamData, and with show a
+        # status line of stride frequency, phase error and battery is kept
+        # up to date, to stop a bad trial early
+        self.clAnnounce()
+        print "Setting telemetry stream to", rate, "Hz"
+        self.streamData = []
+        self.streamNext = None
+        self.streamLost = 0
+        self.streamPrint = show
+        self.tx( 0, command.TELEM_STREAM, pack('=H', rate))
+        time.sleep(0.05)
+
+    def setLatencyComp(self, mask = command.LATENCY_ENC, ctrlDelay = 60):
+        # Sensors whose samples are extrapolated to the control instant,
+        # ctrlDelay us after the PID tick starts. Sample ages are logged in
+        # the encAge, bemfAge and gyroAge telemetry columns
+        self.clAnnounce()
+        print "Setting latency compensation mask",mask,"control delay",ctrlDelay,"us"
+        self.tx( 0, command.SET_LATENCY_COMP, pack('2H', mask, ctrlDelay))
+        time.sleep(0.05)
+
     def startTimedRun(self, duration):
         self.clAnnounce()
         print "Starting timed run of",duration," ms"
@@ -158,49 +396,115 @@ class Velociroach:
             time.sleep(0.1)
     
     ######TODO : sort out this function and flashReadback below
-    def downloadTelemetry(self, timeout = 5, retry = True):
+    def requestReadback(self, packed):
+        if self.telemCompress:
+            #Whole pages of the compressed log
+            self.compPages = {}
+            self.compDone = set()
+            self.compPageCount = 0
+            self.compBytes = 0
+            self.tx( 0, command.FLASH_READBACK_COMP, pack('=2H', 0, 0))
+        elif packed:
+            #Samples are streamed back to back, several per packet
+            size = self.numSamples * telemRecord(self)
+            self.packStream = bytearray(size)
+            self.packMask = bytearray(size)
+            self.tx( 0, command.FLASH_READBACK_PACKED, pack('=LL', 0, self.numSamples))
+        else:
+            self.packStream = None
+            self.tx( 0, command.FLASH_READBACK, pack('=L',self.numSamples))
+
+    def telemetryHoles(self):
+        # (start, count) runs of samples not received yet
+        holes = []
+        for index, item in enumerate(self.telemtryData):
+            if item != []:
+                continue
+            if holes and holes[-1][0] + holes[-1][1] == index:
+                holes[-1] = (holes[-1][0], holes[-1][1] + 1)
+            else:
+                holes.append((index, 1))
+        return holes
+
+    def requestRanges(self, ranges):
+        # Replies are packed readback packets, also after an unpacked download
+        if self.packStream is None:
+            size = self.numSamples * telemRecord(self)
+            self.packStream = bytearray(size)
+            self.packMask = bytearray(size)
+        # Sent READBACK_CHUNK_RANGES (cmd.h) ranges per packet
+        chunk = 14
+        for start in range(0, len(ranges), chunk):
+            part = ranges[start:start + chunk]
+            temp = [n for r in part for n in r]
+            self.tx( 0, command.FLASH_READBACK_RANGES, pack('=%dL' % len(temp), *temp))
+            time.sleep(0.05)
+
+    def requestPages(self):
+        # Pages of a compressed log not complete yet, as ranges
+        if self.compPageCount == 0:
+            self.tx( 0, command.FLASH_READBACK_COMP, pack('=2H', 0, 0))
+            return
+        page = 0
+        while page < self.compPageCount:
+            if page in self.compDone:
+                page += 1
+                continue
+            start = page
+            while page < self.compPageCount and page not in self.compDone:
+                page += 1
+            self.tx( 0, command.FLASH_READBACK_COMP, pack('=2H', start, page - start))
+            time.sleep(0.05)
+
+    def downloadTelemetry(self, timeout = 5, retry = True, packed = True):
         #suppress callback output messages for the duration of download
         self.VERBOSE = False
+        self.setTelemFields(0)
         self.clAnnounce()
         print "Started telemetry download"
-        self.tx( 0, command.FLASH_READBACK, pack('=L',self.numSamples))
+        self.requestReadback(packed)
                 
         dlStart = time.time()
         shared.last_packet_time = dlStart
+        lastProgress = None
+        stalls = 0
         #bytesIn = 0
         while self.telemtryData.count([]) > 0:
             time.sleep(0.02)
             dlProgress(self.numSamples - self.telemtryData.count([]) , self.numSamples)
             if (time.time() - shared.last_packet_time) > timeout:
                 print ""
-                #Terminal message about missed packets
+                #Terminal message about missed samples
+                missed = self.telemtryData.count([])
                 self.clAnnounce()
                 print "Readback timeout exceeded"
-                print "Missed", self.telemtryData.count([]), "packets."
-                #print "Didn't get packets:"
-                #for index,item in enumerate(self.telemtryData):
-                #    if item == []:
-                #        print "#",index+1,
-                print "" 
-                break
-                # Retry telem download            
-                if retry == True:
-                    raw_input("Press Enter to restart telemetry readback ...")
-                    self.telemtryData = [ [] ] * self.numSamples
+                print "Missed", missed, "samples."
+                # Ask again for only the missing ranges, until 3 tries in a
+                # row bring nothing new
+                progress = (missed, self.compBytes)
+                stalls = stalls + 1 if progress == lastProgress else 0
+                lastProgress = progress
+                if retry == True and stalls < 3:
                     self.clAnnounce()
-                    print "Started telemetry download"
-                    dlStart = time.time()
-                    shared.last_packet_time = dlStart
-                    self.tx( 0, command.FLASH_READBACK, pack('=L',self.numSamples))
-                else: #retry == false
-                    print "Not trying telemetry download."          
+                    shared.last_packet_time = time.time()
+                    if self.telemCompress:
+                        print "Requesting",self.compPageCount-len(self.compDone),"pages again"
+                        self.requestPages()
+                    else:
+                        holes = self.telemetryHoles()
+                        print "Requesting",len(holes),"missing ranges again"
+                        self.requestRanges(holes)
+                else:
+                    print "Not trying telemetry download."
+                    print ""
+                    break
 
         dlEnd = time.time()
         dlTime = dlEnd - dlStart
         #Final update to download progress bar to make it show 100%
         dlProgress(self.numSamples-self.telemtryData.count([]) , self.numSamples)
         #totBytes = 52*self.numSamples
-        totBytes = 52*(self.numSamples - self.telemtryData.count([]))
+        totBytes = telemRecord(self)*(self.numSamples - self.telemtryData.count([]))
         datarate = totBytes / dlTime / 1000.0
         print '\n'
         #self.clAnnounce()
@@ -248,8 +552,8 @@ class Velociroach:
         fileout.write('%  Motor Gains    = ' + repr(self.currentGait.motorgains) + '\n')
         fileout.write('% Columns: \n')
     
-        # order for wiring on RF Turner
-        fileout.write('% time | Right Leg Pos | Left Leg Pos | Commanded Right Leg Pos | Commanded Left Leg Pos | DCR | DCL | GyroX | GryoY | GryoZ | AX | AY | AZ | RBEMF | LBEMF | VBatt\n')
+        # as the SET_TELEM_FIELDS schema the data was decoded with
+        fileout.write('% time | ' + ' | '.join(name for (t, name) in self.telemFields) + '\n')
         fileout.close()
 
     def setupTelemetryDataTime(self, runtime):
@@ -0,0 +1,8 @@
+/*
+ * Host stand-in for the XC16 ADC peripheral library.
+ * Conversions are served by adc_pid.h in the simulator.
+ */
+#ifndef __SIM_ADC_H
+#define __SIM_ADC_H
+
+#endif // __SIM_ADC_H
@@ -0,0 +1,15 @@
+/*
+ * Host stand-in for imageproc-lib/adc_pid.h.
+ * Back EMF and battery readings come from the motor plant model.
+ */
+#ifndef __SIM_ADC_PID_H
+#define __SIM_ADC_PID_H
+
+void adcSetup(void);
+unsigned int adcGetVbatt(void);
+unsigned int adcGetMotorA(void);
+unsigned int adcGetMotorB(void);
+unsigned int adcGetMotorC(void);
+unsigned int adcGetMotorD(void);
+
+#endif // __SIM_ADC_PID_H
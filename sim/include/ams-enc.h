@@ -0,0 +1,17 @@
+/*
+ * Host stand-in for imageproc-lib/ams-enc.h.
+ * Angles come from the leg plant model in plant.c.
+ */
+#ifndef __SIM_AMS_ENC_H
+#define __SIM_AMS_ENC_H
+
+#define NUM_ENC     2
+
+void amsEncoderSetup(void);
+void amsEncoderStartAsyncRead(void);
+int amsEncoderGetPos(unsigned char num);
+int amsEncoderGetOticks(unsigned char num);
+unsigned int amsEncoderGetOffset(unsigned char num);
+void amsEncoderResetPos(void);
+
+#endif // __SIM_AMS_ENC_H
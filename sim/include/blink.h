@@ -0,0 +1,8 @@
+/*
+ * Host stand-in for imageproc-lib/blink.h.
+ * Not used by the simulated modules; present so includes resolve.
+ */
+#ifndef __SIM_BLINK_H
+#define __SIM_BLINK_H
+
+#endif // __SIM_BLINK_H
@@ -0,0 +1,8 @@
+/*
+ * Host stand-in for imageproc-lib/carray.h.
+ * Not used by the simulated modules; present so includes resolve.
+ */
+#ifndef __SIM_CARRAY_H
+#define __SIM_CARRAY_H
+
+#endif // __SIM_CARRAY_H
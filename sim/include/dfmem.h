@@ -0,0 +1,26 @@
+/*
+ * Host stand-in for imageproc-lib/dfmem.h.
+ * The dataflash is a RAM image with AT45DB161D geometry.
+ */
+#ifndef __SIM_DFMEM_H
+#define __SIM_DFMEM_H
+
+typedef struct {
+    unsigned int max_pages;
+    unsigned int bytes_per_page;
+    unsigned int pages_per_block;
+    unsigned int blocks_per_sector;
+    unsigned int pages_per_sector;
+} DfmemGeometryStruct;
+
+typedef DfmemGeometryStruct* DfmemGeometry;
+
+void dfmemSetup(void);
+void dfmemWrite(unsigned char *data, unsigned int length, unsigned int page,
+        unsigned int byte, unsigned char buffer);
+void dfmemRead(unsigned int page, unsigned int byte, unsigned int length,
+        unsigned char *data);
+void dfmemEraseSector(unsigned int page);
+void dfmemGetGeometryParams(DfmemGeometry geo);
+
+#endif // __SIM_DFMEM_H
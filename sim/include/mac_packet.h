@@ -0,0 +1,24 @@
+/*
+ * Host stand-in for imageproc-lib/mac_packet.h.
+ */
+#ifndef __SIM_MAC_PACKET_H
+#define __SIM_MAC_PACKET_H
+
+#include "payload.h"
+
+typedef union {
+    unsigned int val;
+    unsigned char byte[2];
+} WordVal;
+
+typedef struct {
+    WordVal src_addr;
+    WordVal dest_addr;
+    PayloadStruct payload;
+} MacPacketStruct;
+
+typedef MacPacketStruct* MacPacket;
+
+Payload macGetPayload(MacPacket packet);
+
+#endif // __SIM_MAC_PACKET_H
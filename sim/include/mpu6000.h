@@ -0,0 +1,12 @@
+/*
+ * Host stand-in for imageproc-lib/mpu6000.h.
+ */
+#ifndef __SIM_MPU6000_H
+#define __SIM_MPU6000_H
+
+void mpuSetup(void);
+void mpuBeginUpdate(void);
+void mpuGetGyro(int* buff);
+void mpuGetXl(int* buff);
+
+#endif // __SIM_MPU6000_H
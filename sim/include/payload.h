@@ -0,0 +1,25 @@
+/*
+ * Host stand-in for imageproc-lib/payload.h.
+ */
+#ifndef __SIM_PAYLOAD_H
+#define __SIM_PAYLOAD_H
+
+#define PAYLOAD_HEADER_LENGTH   2
+#define PAYLOAD_MAX_DATA        114
+
+// data is first so the argument structs cmd.c overlays on it are aligned
+typedef struct {
+    unsigned char data[PAYLOAD_MAX_DATA];
+    unsigned char status;
+    unsigned char type;
+    unsigned char data_length;
+} PayloadStruct;
+
+typedef PayloadStruct* Payload;
+
+unsigned char payGetStatus(Payload pld);
+unsigned char payGetType(Payload pld);
+unsigned char* payGetData(Payload pld);
+unsigned char payGetDataLength(Payload pld);
+
+#endif // __SIM_PAYLOAD_H
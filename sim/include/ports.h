@@ -0,0 +1,8 @@
+/*
+ * Host stand-in for imageproc-lib/ports.h.
+ * Not used by the simulated modules; present so includes resolve.
+ */
+#ifndef __SIM_PORTS_H
+#define __SIM_PORTS_H
+
+#endif // __SIM_PORTS_H
@@ -0,0 +1,8 @@
+/*
+ * Host stand-in for imageproc-lib/ppool.h.
+ * Not used by the simulated modules; present so includes resolve.
+ */
+#ifndef __SIM_PPOOL_H
+#define __SIM_PPOOL_H
+
+#endif // __SIM_PPOOL_H
@@ -0,0 +1,13 @@
+/*
+ * Host stand-in for the XC16 motor control PWM library.
+ */
+#ifndef __SIM_PWM_H
+#define __SIM_PWM_H
+
+#include <xc.h>
+
+#define PWM_DIS     0x7fff
+
+void SetDCMCPWM(unsigned int dutycyclereg, unsigned int dutycycle, char updatedisable);
+
+#endif // __SIM_PWM_H
@@ -0,0 +1,27 @@
+/*
+ * Host stand-in for imageproc-lib/radio.h.
+ *
+ * Received packets are queued by simSendCommand(); transmitted packets are
+ * handed to the callback registered with simSetRadioTxCallback(), and
+ * count in the TX queue for SIM_RADIO_PACKET_US each, as on air.
+ */
+#ifndef __SIM_RADIO_H
+#define __SIM_RADIO_H
+
+#include "mac_packet.h"
+
+void radioInit(unsigned int rx_queue_length, unsigned int tx_queue_length);
+void radioSetChannel(unsigned char channel);
+void radioSetSrcAddr(unsigned int addr);
+void radioSetSrcPanID(unsigned int pan_id);
+unsigned int radioSendData(unsigned int dest_addr, unsigned char status,
+        unsigned char type, unsigned int datalen, unsigned char* dataptr,
+        unsigned char fast_fail);
+MacPacket radioDequeueRxPacket(void);
+void radioReturnPacket(MacPacket packet);
+void radioProcess(void);
+unsigned int radioRxQueueEmpty(void);
+unsigned int radioTxQueueEmpty(void);
+unsigned int radioGetTxQueueSize(void);
+
+#endif // __SIM_RADIO_H
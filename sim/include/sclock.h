@@ -0,0 +1,13 @@
+/*
+ * Host stand-in for imageproc-lib/sclock.h.
+ * sclock ticks are virtual microseconds since boot.
+ */
+#ifndef __SIM_SCLOCK_H
+#define __SIM_SCLOCK_H
+
+#define SCLOCK_TICKS_PER_MS     1000
+
+void sclockSetup(void);
+unsigned long sclockGetTime(void);
+
+#endif // __SIM_SCLOCK_H
@@ -0,0 +1,28 @@
+/*
+ * Host stand-in for imageproc-settings/settings.h.
+ *
+ * Robot specific leg wiring is left to the defaults in pid-ip2.5.h, so the
+ * simulator runs the same configuration as a stock VelociRoACH.
+ */
+#ifndef __SIM_SETTINGS_H
+#define __SIM_SETTINGS_H
+
+#define RADIO_CHANNEL           0x0E
+#define RADIO_SRC_ADDR          0x2052
+#define RADIO_PAN_ID            0x2050
+#define RADIO_DST_ADDR          0x2011
+#define RADIO_RXPQ_MAX_SIZE     16
+#define RADIO_TXPQ_MAX_SIZE     16
+
+// The encoder and IMU stand-ins latch on the read kick off, and duty takes
+// effect as soon as it is written
+#define PID_ENC_LATCH_US(num)   0
+#define PID_IMU_LATCH_US        0
+#define PID_CTRL_DELAY_US       0
+
+// Telemetry type used by telem.c
+#define TELEM_TYPE              vrTelemStruct_t
+#define TELEM_INCLUDE           "vr_telem.h"
+#define TELEMPACKFUNC(x)        vrTelemGetData(x)
+
+#endif // __SIM_SETTINGS_H
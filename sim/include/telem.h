@@ -0,0 +1,30 @@
+/*
+ * Host stand-in for imageproc-lib/telem.h.
+ * Same sample layout and API as the target module; see sim/telem.c.
+ */
+#ifndef __SIM_TELEM_H
+#define __SIM_TELEM_H
+
+#include <stdint.h>
+#include "settings.h"
+#include TELEM_INCLUDE
+
+typedef struct {
+    uint32_t sampleIndex;
+    uint32_t timestamp;
+    TELEM_TYPE telemData;
+} telemStruct_t;
+
+#define PACKETSIZE sizeof(telemStruct_t)
+
+void telemSetup(void);
+void telemSaveNow(void);
+void telemSaveData(telemStruct_t *data);
+void telemSetSamplesToSave(unsigned long n);
+void telemSetStartTime(void);
+void telemSetSkip(unsigned int skipnum);
+void telemErase(unsigned long numSamples);
+void telemReadbackSamples(unsigned long numSamples, unsigned int src_addr);
+void telemSendDataDelay(telemStruct_t* sample, int delaytime_ms, unsigned int src_addr);
+
+#endif // __SIM_TELEM_H
@@ -0,0 +1,13 @@
+/*
+ * Host stand-in for imageproc-lib/tih.h.
+ * Duty cycles are forwarded to the motor plant model.
+ */
+#ifndef __SIM_TIH_H
+#define __SIM_TIH_H
+
+#define TIH_NUM_CHANNELS    4
+
+void tiHSetup(void);
+void tiHSetDC(unsigned char channel, int dc);
+
+#endif // __SIM_TIH_H
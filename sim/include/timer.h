@@ -0,0 +1,15 @@
+/*
+ * Host stand-in for the XC16 timer peripheral library.
+ * Timer1 is the virtual clock owned by the simulator, see sim.c.
+ */
+#ifndef __SIM_TIMER_H
+#define __SIM_TIMER_H
+
+#include <xc.h>
+
+extern volatile unsigned char sim_t1_enabled;
+
+#define EnableIntT1     (sim_t1_enabled = 1)
+#define DisableIntT1    (sim_t1_enabled = 0)
+
+#endif // __SIM_TIMER_H
@@ -0,0 +1,10 @@
+/*
+ * Host stand-in for imageproc-lib/uart_driver.h.
+ * The UART link is not simulated.
+ */
+#ifndef __SIM_UART_DRIVER_H
+#define __SIM_UART_DRIVER_H
+
+#include "mac_packet.h"
+
+#endif // __SIM_UART_DRIVER_H
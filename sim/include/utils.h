@@ -0,0 +1,19 @@
+/*
+ * Host stand-in for imageproc-lib/utils.h.
+ */
+#ifndef __SIM_UTILS_H
+#define __SIM_UTILS_H
+
+#include <xc.h>
+
+extern volatile unsigned char LED_1, LED_2, LED_3;
+
+// The simulator is single threaded; the virtual ISR never preempts a
+// critical section.
+#define CRITICAL_SECTION_START
+#define CRITICAL_SECTION_END
+
+void delay_ms(unsigned int ms);
+void delay_us(unsigned int us);
+
+#endif // __SIM_UTILS_H
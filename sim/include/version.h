@@ -0,0 +1,9 @@
+/*
+ * Host stand-in for imageproc-lib/version.h.
+ */
+#ifndef __SIM_VERSION_H
+#define __SIM_VERSION_H
+
+char* versionGetString(void);
+
+#endif // __SIM_VERSION_H
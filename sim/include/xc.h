@@ -0,0 +1,64 @@
+/*
+ * Host stand-in for the XC16 device header.
+ *
+ * Only the special function registers and intrinsics touched by the roach
+ * firmware modules are provided. The dsPIC interrupt attributes are defined
+ * away so that ISRs compile as ordinary functions on the host.
+ */
+#ifndef __SIM_XC_H
+#define __SIM_XC_H
+
+#define interrupt
+#define no_auto_psv
+
+// Motor PWM duty cycle and control registers
+extern volatile unsigned int PDC1, PDC2, PDC3, PDC4;
+extern volatile unsigned int PTCON;
+
+// Timer1 interrupt flag
+extern volatile unsigned char _T1IF;
+
+// ADC1 and DMA0, as set up by lib/adc_ring.c. sim.c converts on each PWM
+// period from the plant and raises the ADC interrupt the way they would.
+typedef struct {
+    unsigned ADON, ADSIDL, AD12B, FORM, SSRC, SIMSAM, ASAM, ADDMABM;
+} simAD1CON1bits;
+typedef struct {
+    unsigned VCFG, CSCNA, CHPS, SMPI, BUFM, ALTS;
+} simAD1CON2bits;
+typedef struct {
+    unsigned ADRC, ADCS;
+} simAD1CON3bits;
+typedef struct {
+    unsigned DMABL;
+} simAD1CON4bits;
+typedef struct {
+    unsigned CH0SA, CH0NA;
+} simAD1CHS0bits;
+typedef struct {
+    unsigned CH123SA, CH123NA;
+} simAD1CHS123bits;
+typedef struct {
+    unsigned CHEN, SIZE, DIR, AMODE, MODE;
+} simDMA0CONbits;
+
+extern volatile simAD1CON1bits AD1CON1bits;
+extern volatile simAD1CON2bits AD1CON2bits;
+extern volatile simAD1CON3bits AD1CON3bits;
+extern volatile simAD1CON4bits AD1CON4bits;
+extern volatile simAD1CHS0bits AD1CHS0bits;
+extern volatile simAD1CHS123bits AD1CHS123bits;
+extern volatile unsigned int AD1PCFGL, AD1CSSL, ADC1BUF0;
+extern volatile unsigned char _AD1IF, _AD1IE, _AD1IP, _DMA0IE;
+extern volatile simDMA0CONbits DMA0CONbits;
+extern volatile unsigned int DMA0PAD, DMA0REQ, DMA0STA, DMA0CNT;
+
+// DMA RAM is ordinary memory here; the offset call tells sim.c where it is
+#define space(x)
+#define __builtin_dmaoffset(p)  simDmaOffset(p)
+unsigned int simDmaOffset(volatile void *p);
+
+#define Nop()
+#define Idle()
+
+#endif // __SIM_XC_H
@@ -0,0 +1,916 @@
+/*
+ * Name: main.c
+ * Desc: Host simulator entry point, runs one timed trial like experiment.py
+ *
+ * The same command sequence the python host sends over the radio is queued
+ * into the firmware command handler: gains, velocity profile, zero position,
+ * phase, telemetry start, timed run, and optionally packed flash readback. A one
+ * line summary is printed so parameter sweeps can be scripted around it.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <math.h>
+
+#include "sim.h"
+#include "cmd.h"
+#include "telem.h"
+#include "telem_pack.h"
+#include "telem_comp.h"
+#include "telem_stream.h"
+#include "dfmem.h"
+#include "pid-ip2.5.h"
+#include "vel_obs.h"
+#include "move_queue.h"
+#include "phase_lock.h"
+#include "steering.h"
+#include "gain_sched.h"
+#include "autotune.h"
+#include "excite.h"
+#include "ilc.h"
+
+extern pidPos pidObjs[NUM_PIDS];
+
+static telemStruct_t *telem_samples;
+static unsigned long telem_num, telem_received, telem_packets;
+static unsigned char *telem_mask, *telem_have;  // packed readback bytes and samples in
+static double telem_loss;
+static int telem_comp;
+// schema of the log, from CMD_SET_TELEM_FIELDS; records are stored from
+// the timestamp of telem_samples, schema_record bytes each
+static vrTelemFieldDesc schema[VR_TELEM_MAX_FIELDS];
+static unsigned int schema_fields, schema_record;
+// compressed readback: page images, bytes in, pages decoded
+static unsigned char *comp_image, *comp_mask, *comp_done;
+static unsigned int comp_pages, comp_page_bytes, comp_max_pages;
+static unsigned long comp_bytes;      // page bytes in so far
+static unsigned long loss_rng = 0x2545f491UL;
+// live stream: rate in effect, samples and packets in, numbers missed
+static unsigned int stream_rate;
+static unsigned long stream_samples, stream_packets, stream_lost;
+static uint16_t stream_next;
+static telemStreamSample_t stream_first, stream_last;
+static double stream_sq_phase;
+static autotuneResult tune_results[NUM_PIDS];
+
+static void usage(const char *name) {
+    fprintf(stderr,
+        "usage: %s [options]\n"
+        "  -g Kp,Ki,Kd,Kaw,Kff  leg PID gains, both legs  (1800,200,100,0,0)\n"
+        "  -f left,right        stride frequency in Hz     (5,5)\n"
+        "  -p phase             left/right phase offset    (0x8000)\n"
+        "  -t ms                timed run length           (10000)\n"
+        "  -o file              download telemetry to file\n"
+        "  -b volts             battery open circuit voltage\n"
+        "  -d prob              back EMF brush dropout probability\n"
+        "  -v mode              velocity estimate, 0 diff 1 bemf 2 fused (1)\n"
+        "  -n points            upload an n point gait table in chunks\n"
+        "                       instead of the 4 point velocity profile\n"
+        "  -m left,right,n      after n strides switch to these frequencies\n"
+        "                       through the on-robot move queue\n"
+        "  -l Kp,Ki             hold the -p phase with the phase lock loop\n"
+        "  -y dps,Kp,Ki         track a yaw rate with the gyro steering loop\n"
+        "  -c volts             compensate duty for battery sag, nominal volts\n"
+        "  -a duty              relay autotune both legs first, run on the\n"
+        "                       identified gains instead of -g\n"
+        "  -s slew[,max]        limit leg duty change per ms, and duty\n"
+        "  -x type,offset,amp   log -t ms of prbs, sine or chirp duty in\n"
+        "                       PWMPASS mode instead of the gait trial\n"
+        "  -i gain[,lead]       learn feedforward across strides with ILC\n"
+        "  -k mask[,delay]      sensors extrapolated to the control instant,\n"
+        "                       1 encoder 2 back EMF 4 gyro, and its delay us\n"
+        "  -w ms                start the timebase ms before its 32 bit wrap\n"
+        "  -r prob              readback packet loss probability\n"
+        "  -z                   save telemetry delta compressed\n"
+        "  -e mask              telemetry field groups, VR_TELEM_* (0xfff)\n"
+        "  -u hz                stream live telemetry during the run\n",
+        name);
+}
+
+static double lossRand(void) {
+    // xorshift32, deterministic between runs
+    loss_rng ^= (loss_rng << 13) & 0xffffffffUL;
+    loss_rng ^= loss_rng >> 17;
+    loss_rng ^= (loss_rng << 5) & 0xffffffffUL;
+    return (loss_rng & 0xffff) / 65536.0;
+}
+
+#define READ_STALLS 3       // readback rounds in a row with nothing new, to give up
+
+#define SCHEMA_SIZE(k)  ((k) == 0 || schema[(k) - 1].type == 'l' ? 4 : 2)
+
+// Sets the field groups logged, or only asks for the schema with mask 0;
+// the reply comes in with the next simRunMs
+static void setTelemFields(uint32_t mask) {
+    _args_cmdSetTelemFields args = {mask};
+    simSendCommand(CMD_SET_TELEM_FIELDS, &args, sizeof (args));
+}
+
+// Field name of sample i as a long, 0 if it is not logged
+static long fieldValue(unsigned long i, const char *name) {
+    const unsigned char *p = (const unsigned char *) &telem_samples[i].telemData;
+    unsigned int k;
+    int32_t l;
+    int16_t h;
+
+    for (k = 0; k < schema_fields; k++) {
+        if (strncmp(schema[k].name, name, VR_TELEM_NAME_LEN) == 0) {
+            if (schema[k].type == 'l') {
+                memcpy(&l, p, sizeof (l));
+                return l;
+            }
+            memcpy(&h, p, sizeof (h));
+            return schema[k].type == 'H' ? (uint16_t) h : h;
+        }
+        p += SCHEMA_SIZE(k + 1);
+    }
+    return 0;
+}
+
+static uint32_t compVarint(const unsigned char **p) {
+    uint32_t z = 0;
+    unsigned int shift = 0;
+    do {
+        z |= (uint32_t) (**p & 0x7f) << shift;
+        shift += 7;
+    } while (*(*p)++ & 0x80);
+    return z;
+}
+
+// Samples of one compressed page into telem_samples, as velociroach.py
+static void compDecodePage(const unsigned char *page) {
+    const unsigned char *p = page + TELEM_COMP_HEADER, *end;
+    unsigned char f[TELEM_PACK_RECORD], prev[TELEM_PACK_RECORD], prev2[TELEM_PACK_RECORD];
+    uint32_t first, mask, z, v, p1, p2;
+    uint16_t count, used, v16;
+    unsigned long index;
+    unsigned int i, k, pos;
+
+    memcpy(&first, page, sizeof (first));
+    memcpy(&count, page + 4, sizeof (count));
+    memcpy(&used, page + 6, sizeof (used));
+    end = page + used;
+    memcpy(f, p, schema_record);
+    memcpy(prev, f, schema_record);
+    memcpy(prev2, f, schema_record);
+    p += schema_record;
+    for (i = 0; i < count; i++) {
+        if (i > 0) {
+            if (p + sizeof (mask) > end) {
+                break;
+            }
+            memcpy(&mask, p, sizeof (mask));
+            p += sizeof (mask);
+            for (k = 0, pos = 0; k <= schema_fields; pos += SCHEMA_SIZE(k), k++) {
+                z = mask & (1UL << k) ? compVarint(&p) : 0;
+                z = (z >> 1) ^ (0 - (z & 1));
+                if (SCHEMA_SIZE(k) == 4) {
+                    memcpy(&p1, prev + pos, 4);
+                    memcpy(&p2, prev2 + pos, 4);
+                    v = 2 * p1 - p2 + z;
+                    memcpy(f + pos, &v, 4);
+                } else {
+                    memcpy(&v16, f + pos, 2);
+                    v16 += z;
+                    memcpy(f + pos, &v16, 2);
+                }
+            }
+            memcpy(prev2, prev, schema_record);
+            memcpy(prev, f, schema_record);
+        }
+        index = first + i;
+        if (index < telem_num && !telem_have[index]) {
+            telem_samples[index].sampleIndex = index;
+            memcpy(&telem_samples[index].timestamp, f, schema_record);
+            telem_have[index] = 1;
+            telem_received++;
+        }
+    }
+}
+
+// Decodes the page once its header and used bytes are all in
+static void compCheckPage(unsigned int page) {
+    unsigned char *image = comp_image + (unsigned long) page * comp_page_bytes;
+    unsigned char *mask = comp_mask + (unsigned long) page * comp_page_bytes;
+    uint32_t first;
+    uint16_t used;
+
+    if (comp_done[page] || memchr(mask, 0, TELEM_COMP_HEADER) != NULL) {
+        return;
+    }
+    memcpy(&first, image, sizeof (first));
+    memcpy(&used, image + 6, sizeof (used));
+    if (first == 0xffffffffUL || used < TELEM_COMP_HEADER + schema_record ||
+            used > comp_page_bytes) {
+        comp_done[page] = 1;        // erased
+    } else if (memchr(mask, 0, used) == NULL) {
+        compDecodePage(image);
+        comp_done[page] = 1;
+    }
+}
+
+static void radioRx(unsigned char status, unsigned char type,
+        unsigned char *data, unsigned int length) {
+    telemStruct_t *sample;
+    (void) status;
+
+    if (type == CMD_FLASH_READBACK && length == sizeof (telemStruct_t)) {
+        sample = (telemStruct_t *) data;
+        if (sample->sampleIndex < telem_num) {
+            telem_samples[sample->sampleIndex] = *sample;
+            telem_received++;
+        }
+    } else if (type == CMD_FLASH_READBACK_PACKED && length > TELEM_PACK_HEADER) {
+        // placed by start and offset like callbackFunc_multi.py, so lost
+        // packets leave holes for readTelemetry to ask for again
+        uint32_t start;
+        unsigned long pos, end, index, b;
+        unsigned int i;
+        telem_packets++;
+        if (telem_mask == NULL || lossRand() < telem_loss) {
+            return;
+        }
+        memcpy(&start, data, sizeof (start));
+        pos = start * schema_record + data[4];
+        end = pos + length - TELEM_PACK_HEADER;
+        if (end > telem_num * schema_record) {
+            end = telem_num * schema_record;
+        }
+        for (i = TELEM_PACK_HEADER, b = pos; b < end; i++, b++) {
+            index = b / schema_record;
+            ((unsigned char *) &telem_samples[index].timestamp)[b % schema_record] = data[i];
+            telem_mask[b] = 1;
+        }
+        for (index = start; index * schema_record < end; index++) {
+            if (!telem_have[index] && memchr(telem_mask + index * schema_record,
+                    0, schema_record) == NULL) {
+                telem_samples[index].sampleIndex = index;
+                telem_have[index] = 1;
+                telem_received++;
+            }
+        }
+    } else if (type == CMD_FLASH_READBACK_COMP && length > TELEM_COMP_READ_HEADER) {
+        uint16_t header[3];
+        unsigned long at;
+        telem_packets++;
+        if (comp_image == NULL || lossRand() < telem_loss) {
+            return;
+        }
+        memcpy(header, data, sizeof (header));
+        length -= TELEM_COMP_READ_HEADER;
+        if (header[0] >= comp_max_pages || header[1] + length > comp_page_bytes) {
+            return;
+        }
+        comp_pages = header[2];
+        at = (unsigned long) header[0] * comp_page_bytes + header[1];
+        memcpy(comp_image + at, data + TELEM_COMP_READ_HEADER, length);
+        for (; length > 0; length--, at++) {
+            comp_bytes += !comp_mask[at];
+            comp_mask[at] = 1;
+        }
+        compCheckPage(header[0]);
+    } else if (type == CMD_SET_TELEM_FIELDS && length >= 6) {
+        // descriptors first.., of total, as setTelemFields() in velociroach.py
+        unsigned int k, first = data[4], n = (length - 6) / sizeof (vrTelemFieldDesc);
+        if (first == 0) {
+            schema_fields = 0;
+            schema_record = sizeof (uint32_t);
+        }
+        for (k = 0; k < n && first + k < VR_TELEM_MAX_FIELDS && first + k == schema_fields; k++) {
+            memcpy(&schema[schema_fields], data + 6 + k * sizeof (vrTelemFieldDesc),
+                    sizeof (vrTelemFieldDesc));
+            schema_fields++;
+            schema_record += SCHEMA_SIZE(schema_fields);
+        }
+    } else if (type == CMD_TELEM_STREAM && length == sizeof (uint16_t)) {
+        uint16_t rate;
+        memcpy(&rate, data, sizeof (rate));
+        if (rate != 0) {
+            stream_rate = rate;
+        }
+    } else if (type == CMD_TELEM_STREAM && length >= TELEM_STREAM_HEADER) {
+        // as the stream handler in callbackFunc_multi.py
+        uint16_t header[2];
+        telemStreamSample_t sample;
+        unsigned int k;
+        memcpy(header, data, sizeof (header));
+        if (stream_samples == 0) {
+            stream_next = header[0];
+        }
+        stream_lost += (uint16_t) (header[0] - stream_next);
+        stream_next = header[0] + header[1];
+        stream_packets++;
+        for (k = 0; k < header[1] && TELEM_STREAM_HEADER + (k + 1) * sizeof (sample) <= length; k++) {
+            memcpy(&sample, data + TELEM_STREAM_HEADER + k * sizeof (sample), sizeof (sample));
+            if (stream_samples++ == 0) {
+                stream_first = sample;
+            }
+            stream_last = sample;
+            stream_sq_phase += (double) sample.data.phaseErr * sample.data.phaseErr;
+        }
+    } else if (type == CMD_AUTOTUNE && length == sizeof (int16_t) + sizeof (autotuneResult)) {
+        int16_t chan = *(int16_t *) data;
+        if (chan >= 0 && chan < NUM_PIDS) {
+            memcpy(&tune_results[chan], data + sizeof (int16_t), sizeof (autotuneResult));
+        }
+    }
+}
+
+static void requestRanges(_args_cmdFlashReadbackRanges *ranges, unsigned int n) {
+    if (n > 0) {
+        simSendCommand(CMD_FLASH_READBACK_RANGES, ranges, n * sizeof (_args_readbackRange));
+        simRunMs(1);
+    }
+}
+
+// Packed readback of the telem_num samples, then the holes left by lost
+// packets, by sample range, until READ_STALLS rounds bring nothing; returns
+// the first pass packets
+static unsigned long readPacked(void) {
+    _args_cmdFlashReadbackPacked readback = {0, 0};
+    _args_cmdFlashReadbackRanges ranges;
+    _args_readbackRange *r = ranges.ranges;
+    unsigned long i, first, missed = telem_num;
+    unsigned int n, stalls = 0;
+
+    readback.samples = telem_num;
+    simSendCommand(CMD_FLASH_READBACK_PACKED, &readback, sizeof (readback));
+    simRunMs(1);
+    first = telem_packets;
+    while (telem_received < telem_num && stalls < READ_STALLS) {
+        stalls = telem_num - telem_received < missed ? 0 : stalls + 1;
+        missed = telem_num - telem_received;
+        for (i = 0, n = 0; i < telem_num; i++) {
+            if (telem_have[i]) {
+                continue;
+            }
+            if (n > 0 && r[n - 1].start + r[n - 1].samples == i) {
+                r[n - 1].samples++;
+                continue;
+            }
+            if (n == READBACK_CHUNK_RANGES) {
+                requestRanges(&ranges, n);
+                n = 0;
+            }
+            r[n].start = i;
+            r[n].samples = 1;
+            n++;
+        }
+        requestRanges(&ranges, n);
+    }
+    return first;
+}
+
+// Compressed log pages, then the pages not complete, by page range, until
+// READ_STALLS rounds bring no bytes; returns the first pass packets
+static unsigned long readCompressed(void) {
+    _args_cmdFlashReadbackComp readback = {0, 0};
+    DfmemGeometryStruct geo;
+    unsigned long first, got;
+    unsigned int page, missing, stalls = 0;
+
+    dfmemGetGeometryParams(&geo);
+    comp_page_bytes = geo.bytes_per_page;
+    comp_max_pages = geo.max_pages;
+    comp_image = calloc((unsigned long) comp_max_pages * comp_page_bytes, 1);
+    comp_mask = calloc((unsigned long) comp_max_pages * comp_page_bytes, 1);
+    comp_done = calloc(comp_max_pages, 1);
+    comp_pages = 0;
+    comp_bytes = 0;
+    simSendCommand(CMD_FLASH_READBACK_COMP, &readback, sizeof (readback));
+    simRunMs(1);
+    first = telem_packets;
+    do {
+        got = comp_bytes;
+        for (page = 0, missing = 0; page < comp_pages; page++) {
+            if (comp_done[page]) {
+                continue;
+            }
+            readback.start = page;
+            for (readback.pages = 0; page < comp_pages && !comp_done[page]; page++) {
+                readback.pages++;
+            }
+            missing += readback.pages;
+            simSendCommand(CMD_FLASH_READBACK_COMP, &readback, sizeof (readback));
+            simRunMs(1);
+        }
+        stalls = comp_bytes != got ? 0 : stalls + 1;
+    } while (missing != 0 && stalls < READ_STALLS);
+    fprintf(stderr, "sim: %u compressed pages, %.1f samples per page\n", comp_pages,
+            comp_pages ? (double) telem_received / comp_pages : 0.0);
+    free(comp_image);
+    free(comp_mask);
+    free(comp_done);
+    comp_image = comp_mask = comp_done = NULL;
+    return first;
+}
+
+// Flash readback as velociroach.py downloadTelemetry() does it, with the
+// schema asked for first
+static void readTelemetry(void) {
+    unsigned long first;
+
+    setTelemFields(0);
+    simRunMs(1);
+    telem_mask = calloc(telem_num * schema_record + 1, 1);
+    telem_have = calloc(telem_num + 1, 1);
+    telem_packets = 0;
+    first = telem_comp ? readCompressed() : readPacked();
+    fprintf(stderr, "sim: read back %lu samples in %lu packets, %lu resent\n",
+            telem_received, telem_packets, telem_packets - first);
+    free(telem_mask);
+    free(telem_have);
+    telem_mask = telem_have = NULL;
+}
+
+// relay experiment on every leg at once, polled like autotune() in
+// velociroach.py; returns 0 once all legs have gains
+static int autotune(int amplitude, _args_cmdSetPIDGains *gains) {
+    _args_cmdAutotune args = {0, 1, amplitude, 64, 4, AUTOTUNE_RULE_OVERSHOOT, 5000};
+    int *g = &gains->Kp1;
+    int j, t, running = 1;
+
+    for (j = 0; j < NUM_PIDS; j++) {
+        args.channel = j;
+        simSendCommand(CMD_AUTOTUNE, &args, sizeof (args));
+    }
+    args.start = 0;
+    for (t = 0; running && t < args.timeout; t += 100) {
+        simRunMs(100);
+        running = 0;
+        for (j = 0; j < NUM_PIDS; j++) {
+            args.channel = j;
+            simSendCommand(CMD_AUTOTUNE, &args, sizeof (args));
+            simRunMs(1);
+            running |= tune_results[j].status == AUTOTUNE_RUNNING;
+        }
+    }
+    for (j = 0; j < NUM_PIDS; j++) {
+        autotuneResult *r = &tune_results[j];
+        printf("autotune leg=%d status=%d Ku=%d Pu=%u swing=%u Kp=%d Ki=%d Kd=%d\n",
+                j, r->status, r->Ku, r->Pu, r->swing, r->Kp, r->Ki, r->Kd);
+        if (r->status != AUTOTUNE_DONE) {
+            return -1;
+        }
+        g[5 * j] = r->Kp;
+        g[5 * j + 1] = r->Ki;
+        g[5 * j + 2] = r->Kd;
+    }
+    return 0;
+}
+
+// Same sequence on both legs for -t ms, logged from the first sample
+static int excite(const char *spec, unsigned int run_time) {
+    _args_cmdSetExcitation args;
+    char name[16];
+    int offset, amplitude, j;
+    double f0 = 0.5, f1 = 50.0, g, sum_dc = 0.0, sum_v = 0.0;
+    unsigned long i;
+
+    if (sscanf(spec, "%15[a-z],%d,%d", name, &offset, &amplitude) != 3) {
+        return -1;
+    }
+    memset(&args, 0, sizeof (args));
+    args.offset = offset;
+    args.amplitude = amplitude;
+    args.duration = run_time;
+    if (strcmp(name, "prbs") == 0) {
+        args.type = EXCITE_PRBS;
+        args.order = 10;
+        args.period = 5;
+    } else if (strcmp(name, "sine") == 0) {
+        args.type = EXCITE_MULTISINE;
+        args.order = EXCITE_MAX_HARMONICS;
+        args.period = 2000;
+    } else if (strcmp(name, "chirp") == 0) {
+        // log sweep f0 to f1 over the run, as setExcitation() in velociroach.py
+        uint32_t step = (uint32_t) lround(f0 * 4294967296.0 / 1000.0);
+        g = log(f1 / f0) / run_time * 16777216.0;
+        args.type = EXCITE_CHIRP;
+        args.stepLo = step & 0xffff;
+        args.stepHi = step >> 16;
+        args.growth = (uint16_t) lround(g < 65535.0 ? g : 65535.0);
+    } else {
+        return -1;
+    }
+
+    telem_num = run_time;
+    telem_samples = calloc(telem_num ? telem_num : 1, sizeof (telemStruct_t));
+    for (j = 0; j < NUM_PIDS; j++) {
+        args.channel = j;
+        args.flags = j == NUM_PIDS - 1 ? EXCITE_FLAG_START : 0;
+        args.telemSamples = telem_num;
+        simSendCommand(CMD_SET_EXCITATION, &args, sizeof (args));
+    }
+    simRunMs(run_time + 100);
+
+    readTelemetry();
+    for (i = 0; i < telem_received && i < telem_num; i++) {
+        long dc = fieldValue(i, "dcL") - offset, bemf = fieldValue(i, "bemfL");
+        sum_dc += (double) dc * dc;
+        sum_v += (double) bemf * bemf;
+    }
+    printf("excite type=%s samples=%lu dc0=%ld rms_dcL=%.1f rms_bemfL=%.1f\n",
+            name, telem_received, telem_received ? fieldValue(0, "dcL") : 0,
+            i ? sqrt(sum_dc / i) : 0.0, i ? sqrt(sum_v / i) : 0.0);
+    return 0;
+}
+
+// Columns as the schema names them, like writeFileHeader() in shared.py
+static void writeTelemetry(const char *filename) {
+    FILE *f = fopen(filename, "w");
+    unsigned long i;
+    unsigned int k;
+    if (f == NULL) {
+        perror(filename);
+        return;
+    }
+    fprintf(f, "%% roach host simulator telemetry\n");
+    fprintf(f, "%% time");
+    for (k = 0; k < schema_fields; k++) {
+        fprintf(f, " | %.*s", VR_TELEM_NAME_LEN, schema[k].name);
+    }
+    fprintf(f, "\n");
+    for (i = 0; i < telem_received && i < telem_num; i++) {
+        fprintf(f, "%lu", (unsigned long) telem_samples[i].timestamp);
+        for (k = 0; k < schema_fields; k++) {
+            fprintf(f, ",%ld", fieldValue(i, schema[k].name));
+        }
+        fprintf(f, "\n");
+    }
+    fclose(f);
+}
+
+static void setVelProfile(double freqL, double freqR) {
+    _args_cmdSetVelProfile prof;
+    int i;
+
+    memset(&prof, 0, sizeof (prof));
+    // Equal quarter stride deltas, as velociroach.py sends by default
+    prof.periodLeft = (int16_t) (1000.0 / freqL);
+    prof.periodRight = (int16_t) (1000.0 / freqR);
+    for (i = 0; i < NUM_VELS; i++) {
+        prof.deltaL[i] = 0x4000 / NUM_VELS;
+        prof.deltaR[i] = 0x4000 / NUM_VELS;
+    }
+    simSendCommand(CMD_SET_VEL_PROFILE, &prof, sizeof (prof));
+}
+
+// Uniform leg speed as an n point table, sent GAIT_CHUNK_POINTS at a time
+static void setGaitTable(int num_points, double freqL, double freqR) {
+    _args_cmdSetGaitTable chunk;
+    int j, k;
+
+    for (j = 0; j < NUM_PIDS; j++) {
+        memset(&chunk, 0, sizeof (chunk));
+        chunk.channel = j;
+        chunk.num_points = num_points;
+        chunk.period = (int16_t) (1000.0 / (j == LEFT_LEGS_PID_NUM ? freqL : freqR));
+        chunk.stride = 0x4000;
+        for (chunk.start = 0; chunk.start < num_points; chunk.start += chunk.count) {
+            chunk.count = num_points - chunk.start;
+            if (chunk.count > GAIT_CHUNK_POINTS) {
+                chunk.count = GAIT_CHUNK_POINTS;
+            }
+            for (k = 0; k < chunk.count; k++) {
+                chunk.points[k] = (int16_t) ((long) (chunk.start + k) * 0x4000 / num_points);
+            }
+            simSendCommand(CMD_SET_GAIT_TABLE, &chunk, sizeof (chunk));
+            simRunMs(1);
+        }
+    }
+}
+
+// Swap in the uploaded profile for a stride count at the -f frequencies
+// and -p phase, then retime it to the new ones
+static void setMoveQueue(double freqL, double freqR, int phase, int strides,
+        double freq2L, double freq2R) {
+    _args_cmdSetMoveQueue queue;
+
+    memset(&queue, 0, sizeof (queue));
+    queue.num_segments = 2;
+    queue.segments[0].periodLeft = (int16_t) (1000.0 / freqL);
+    queue.segments[0].periodRight = (int16_t) (1000.0 / freqR);
+    queue.segments[0].phase = phase;
+    queue.segments[0].count = strides;
+    queue.segments[0].flags = MOVE_FLUSH | MOVE_SWAP_TABLE | MOVE_SET_PHASE;
+    queue.segments[1].periodLeft = (int16_t) (1000.0 / freq2L);
+    queue.segments[1].periodRight = (int16_t) (1000.0 / freq2R);
+    queue.segments[1].count = 1;
+    simSendCommand(CMD_SET_MOVE_QUEUE, &queue, sizeof (queue));
+}
+
+int main(int argc, char **argv) {
+    plantParams params;
+    _args_cmdSetPIDGains gains = {1800, 200, 100, 0, 0, 1800, 200, 100, 0, 0};
+    _args_cmdSetPhase phase = {0x8000};
+    _args_cmdStartTimedRun run = {10000};
+    _args_cmdStartTelemetry telem;
+    _args_cmdSetVelEstimator estimator = {PID_VEL_BEMF,
+            VEL_OBS_ALPHA, VEL_OBS_BETA, VEL_OBS_GAMMA};
+    double freqL = 5.0, freqR = 5.0;
+    const char *outfile = NULL;
+    long p_start[NUM_PIDS], p_end[NUM_PIDS];
+    double c_start[NUM_PIDS];
+    _args_cmdSetPhaseLock lock = {0, 0, PHASE_LOCK_KP, PHASE_LOCK_KI};
+    _args_cmdSetSteeringGains steer = {0, 0, 0, 0, 0, STEER_MODE_OFF};
+    _args_cmdSetYawRate yaw = {0};
+    _args_cmdSetBattComp batt = {0, 0};
+    int tune_amplitude = 0;
+    const char *excite_spec = NULL;
+    _args_cmdSetOutputLimits limits = {0, -3800, 3800, 0};
+    int set_limits = 0;
+    _args_cmdSetILC ilc = {0, ILC_GAIN, ILC_LEAD, ILC_FORGET};
+    _args_cmdSetLatencyComp latency = {PID_LATENCY_DEFAULT, PID_CTRL_DELAY_US};
+    int set_latency = 0;
+    double sq_first[NUM_PIDS], sq_last[NUM_PIDS];
+    double vbatt_min = 1e9;
+    double yaw_dps = 0.0;
+    double sq_err[NUM_PIDS], sq_phase = 0.0, sum_yaw = 0.0, run_s;
+    unsigned long n_err = 0, t;
+    clock_t wall_start;
+    double freq2L = 0.0, freq2R = 0.0;
+    int opt, j, gait_points = 0, move_strides = 0;
+    unsigned long clock_start = 0;
+    uint32_t telem_fields = 0;
+    _args_cmdTelemStream stream = {0};
+
+    plantDefaultParams(&params);
+
+    while ((opt = getopt(argc, argv, "g:f:p:t:o:b:d:v:n:m:l:y:c:a:s:x:i:k:w:r:ze:u:h")) != -1) {
+        switch (opt) {
+            case 'g':
+                if (sscanf(optarg, "%d,%d,%d,%d,%d", &gains.Kp1, &gains.Ki1,
+                        &gains.Kd1, &gains.Kaw1, &gains.Kff1) != 5) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                gains.Kp2 = gains.Kp1;
+                gains.Ki2 = gains.Ki1;
+                gains.Kd2 = gains.Kd1;
+                gains.Kaw2 = gains.Kaw1;
+                gains.Kff2 = gains.Kff1;
+                break;
+            case 'f':
+                if (sscanf(optarg, "%lf,%lf", &freqL, &freqR) != 2 ||
+                        freqL <= 0.0 || freqR <= 0.0) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'p':
+                phase.offset = strtol(optarg, NULL, 0);
+                break;
+            case 't':
+                run.run_time = (uint16_t) strtoul(optarg, NULL, 0);
+                break;
+            case 'o':
+                outfile = optarg;
+                break;
+            case 'b':
+                params.Voc = atof(optarg);
+                break;
+            case 'd':
+                params.bemf_dropout = atof(optarg);
+                break;
+            case 'v':
+                estimator.mode = atoi(optarg);
+                break;
+            case 'm':
+                if (sscanf(optarg, "%lf,%lf,%d", &freq2L, &freq2R,
+                        &move_strides) != 3 || freq2L <= 0.0 ||
+                        freq2R <= 0.0 || move_strides < 1) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'l':
+                if (sscanf(optarg, "%hd,%hd", &lock.Kp, &lock.Ki) != 2) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                lock.enable = 1;
+                break;
+            case 'y':
+                if (sscanf(optarg, "%lf,%hd,%hd", &yaw_dps, &steer.Kp,
+                        &steer.Ki) != 3) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                steer.mode = STEER_MODE_GYRO;
+                yaw.rate = (int16_t) lround(yaw_dps * 16.4);
+                break;
+            case 'c':
+                batt.nominal = (uint16_t) lround(atof(optarg) * PLANT_ADC_PER_VOLT);
+                batt.enable = 1;
+                break;
+            case 'a':
+                tune_amplitude = atoi(optarg);
+                break;
+            case 's':
+                if (sscanf(optarg, "%hu,%hd", &limits.slew, &limits.maxDC) < 1) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                limits.minDC = -limits.maxDC;
+                set_limits = 1;
+                break;
+            case 'x':
+                excite_spec = optarg;
+                break;
+            case 'k':
+                if (sscanf(optarg, "%hu,%hu", &latency.mask, &latency.ctrlDelay) < 1) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                set_latency = 1;
+                break;
+            case 'i':
+                if (sscanf(optarg, "%hd,%hu", &ilc.gain, &ilc.lead) < 1) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                ilc.enable = 1;
+                break;
+            case 'w':
+                clock_start = 0x100000000ULL - strtoul(optarg, NULL, 0) * 1000ULL;
+                break;
+            case 'r':
+                telem_loss = atof(optarg);
+                break;
+            case 'z':
+                telem_comp = 1;
+                break;
+            case 'u':
+                stream.rate = (uint16_t) strtoul(optarg, NULL, 0);
+                break;
+            case 'e':
+                telem_fields = strtoul(optarg, NULL, 0);
+                if (telem_fields == 0) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'n':
+                gait_points = atoi(optarg);
+                if (gait_points < 2 || gait_points > GAIT_MAX_POINTS) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    wall_start = clock();
+    simInit(&params);
+    simSetClockStart(clock_start);
+    simSetRadioTxCallback(radioRx);
+    simBoot();
+
+    if (set_latency) {
+        simSendCommand(CMD_SET_LATENCY_COMP, &latency, sizeof (latency));
+    }
+    if (telem_comp) {
+        _args_cmdSetTelemComp comp = {1};
+        simSendCommand(CMD_SET_TELEM_COMP, &comp, sizeof (comp));
+    }
+    if (telem_fields) {
+        setTelemFields(telem_fields);
+    }
+    if (tune_amplitude && autotune(tune_amplitude, &gains) < 0) {
+        return 1;
+    }
+    if (excite_spec != NULL) {
+        if (excite(excite_spec, run.run_time) < 0) {
+            usage(argv[0]);
+            return 1;
+        }
+        if (outfile != NULL) {
+            writeTelemetry(outfile);
+        }
+        return 0;
+    }
+    simSendCommand(CMD_SET_PID_GAINS, &gains, sizeof (gains));
+    simSendCommand(CMD_SET_VEL_ESTIMATOR, &estimator, sizeof (estimator));
+    if (gait_points) {
+        setGaitTable(gait_points, freqL, freqR);
+    } else {
+        setVelProfile(freqL, freqR);
+    }
+    simSendCommand(CMD_ZERO_POS, "zero", 4);
+    simRunMs(1);
+    simSendCommand(CMD_SET_PHASE, &phase, sizeof (phase));
+    lock.target = (int16_t) phase.offset;
+    simSendCommand(CMD_SET_PHASE_LOCK, &lock, sizeof (lock));
+    if (steer.mode != STEER_MODE_OFF) {
+        simSendCommand(CMD_SET_STEERING_GAINS, &steer, sizeof (steer));
+        simSendCommand(CMD_SET_YAW_RATE, &yaw, sizeof (yaw));
+    }
+    if (batt.enable) {
+        simSendCommand(CMD_SET_BATT_COMP, &batt, sizeof (batt));
+    }
+    for (j = 0; set_limits && j < NUM_PIDS; j++) {
+        limits.channel = j;
+        simSendCommand(CMD_SET_OUTPUT_LIMITS, &limits, sizeof (limits));
+    }
+    if (ilc.enable) {
+        simSendCommand(CMD_SET_ILC, &ilc, sizeof (ilc));
+    }
+    if (move_strides) {
+        setMoveQueue(freqL, freqR, phase.offset, move_strides, freq2L, freq2R);
+    }
+
+    telem_num = run.run_time;
+    telem_samples = calloc(telem_num ? telem_num : 1, sizeof (telemStruct_t));
+    telem.numSamples = telem_num;
+    simSendCommand(CMD_START_TELEMETRY, &telem, sizeof (telem));
+    simSendCommand(CMD_START_TIMED_RUN, &run, sizeof (run));
+    simRunMs(1);
+
+    for (j = 0; j < NUM_PIDS; j++) {
+        p_start[j] = pidObjs[j].p_meas;
+        c_start[j] = plantEncoderCounts(&sim_plant, pidObjs[j].encoder_num);
+        sq_err[j] = sq_first[j] = sq_last[j] = 0.0;
+    }
+    for (t = 0; t < run.run_time; t++) {
+        if (t == 0 && stream.rate) {
+            // once the run is going, so the start is timed as without it
+            simSendCommand(CMD_TELEM_STREAM, &stream, sizeof (stream));
+        }
+        simRunMs(1);
+        for (j = 0; j < NUM_PIDS; j++) {
+            // against the plant's own position at the control instant, not
+            // the encoder sample the PID saw
+            double c = plantEncoderCounts(&sim_plant, pidObjs[j].encoder_num) - c_start[j];
+            double e = (double) pidObjs[j].p_input + pidObjs[j].interpolate - p_start[j] -
+                    (pidObjs[j].p_state_flip ? -4.0 : 4.0) * c;
+            sq_err[j] += e * e;
+            if (t < 1000) {
+                sq_first[j] += e * e;
+            }
+            if (t + 1000 >= run.run_time) {
+                sq_last[j] += e * e;
+            }
+        }
+        sq_phase += (double) phaseLockGetError() * phaseLockGetError();
+        sum_yaw += sim_plant.yaw_rate;
+        if (sim_plant.Vbatt < vbatt_min) {
+            vbatt_min = sim_plant.Vbatt;
+        }
+        n_err++;
+    }
+    for (j = 0; j < NUM_PIDS; j++) {
+        p_end[j] = pidObjs[j].p_meas;
+    }
+    simRunMs(100); // coast down
+    if (stream.rate) {
+        _args_cmdTelemStream stop = {0};
+        simSendCommand(CMD_TELEM_STREAM, &stop, sizeof (stop));
+        simRunMs(1);
+        if (stream_samples > 1) {
+            double dt = (uint32_t) (stream_last.timestamp - stream_first.timestamp) / 1e6;
+            fprintf(stderr, "sim: streamed %lu samples at %u Hz in %lu packets, %lu lost,"
+                    " live freqL=%.3f freqR=%.3f vbatt=%d rms_phase=%.1f\n",
+                    stream_samples, stream_rate, stream_packets, stream_lost,
+                    (stream_last.data.posL - stream_first.data.posL) / 65536.0 / dt,
+                    (stream_last.data.posR - stream_first.data.posR) / 65536.0 / dt,
+                    stream_last.data.Vbatt, sqrt(stream_sq_phase / stream_samples));
+        }
+    }
+
+    if (outfile != NULL) {
+        readTelemetry();
+        writeTelemetry(outfile);
+    }
+
+    run_s = run.run_time / 1000.0;
+    printf("run_ms=%u", run.run_time);
+    for (j = 0; j < NUM_PIDS; j++) {
+        const char *side = (j == LEFT_LEGS_PID_NUM) ? "L" : "R";
+        printf(" freq%s=%.3f rms_err%s=%.1f", side,
+                run_s > 0.0 ? (p_end[j] - p_start[j]) / 65536.0 / run_s : 0.0,
+                side, n_err ? sqrt(sq_err[j] / n_err) : 0.0);
+    }
+    printf(" vbatt=%.3f rms_phase=%.1f yaw_dps=%.1f vbatt_min=%.3f\n", sim_plant.Vbatt,
+            n_err ? sqrt(sq_phase / n_err) : 0.0,
+            n_err ? sum_yaw / n_err * 180.0 / M_PI : 0.0, vbatt_min);
+    if (ilc.enable && run.run_time >= 1000) { // learning, first vs last second
+        printf("ilc");
+        for (j = 0; j < NUM_PIDS; j++) {
+            const char *side = (j == LEFT_LEGS_PID_NUM) ? "L" : "R";
+            printf(" rms_err%s_first=%.1f rms_err%s_last=%.1f", side,
+                    sqrt(sq_first[j] / 1000), side, sqrt(sq_last[j] / 1000));
+        }
+        printf("\n");
+    }
+    fprintf(stderr, "sim: %llu ms simulated in %.3f s\n", simGetTimeUs() / 1000,
+            (double) (clock() - wall_start) / CLOCKS_PER_SEC);
+
+    free(telem_samples);
+    return 0;
+}
@@ -0,0 +1,198 @@
+/*
+ * Name: medianbench.c
+ * Desc: Checks and times the back EMF median networks in lib/median.c
+ *
+ * Each network is compared against qsort on every 0/1 input (enough for a
+ * compare-exchange network) and on random samples, and the running filter
+ * built with the configured BEMF_MEDIAN_WINDOW is replayed against the
+ * old measLast1/measLast2 compare tree. Then the filter step (ring insert,
+ * copy and network) is timed for each window over a back EMF like signal
+ * with brush dropouts. Host cycles only rank the variants; the dsPIC
+ * figure comes from the pid slot in CMD_GET_ISR_STATS.
+ *
+ *   make bench
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define CYCLES()    __rdtsc()
+#else
+#define CYCLES()    0ULL
+#endif
+
+#include "median.h"
+
+#define NUM_SAMPLES 1000000
+#define BENCH_REPS  20
+
+static unsigned long rng_state = 12345;
+
+static int rnd(int span) {
+    rng_state = rng_state * 1103515245UL + 12345UL;
+    return (int) ((rng_state >> 8) % (2 * span + 1)) - span;
+}
+
+static int cmpInt(const void *a, const void *b) {
+    return *(const int *) a - *(const int *) b;
+}
+
+static int medianRef(const int *p, int n) {
+    int s[7];
+    memcpy(s, p, n * sizeof(int));
+    qsort(s, n, sizeof(int), cmpInt);
+    return s[n / 2];
+}
+
+// The compare tree pidGetState used before lib/median.c
+static int oldMedian3(int m, int last1, int last2) {
+    if (m > last1) {
+        if (last1 > last2) {
+            return last1;
+        } else {
+            return m > last2 ? last2 : m;
+        }
+    } else {
+        if (last1 < last2) {
+            return last1;
+        } else {
+            return m < last2 ? last2 : m;
+        }
+    }
+}
+
+static int (*const networks[])(int *) = {medianOf3, medianOf5, medianOf7};
+static const int windows[] = {3, 5, 7};
+
+static unsigned long checkNetwork(int k) {
+    int n = windows[k], p[7], q[7], j;
+    unsigned long bits, trial, bad = 0;
+
+    for (bits = 0; bits < (1UL << n); bits++) {
+        for (j = 0; j < n; j++) {
+            p[j] = q[j] = (bits >> j) & 1;
+        }
+        bad += networks[k](p) != medianRef(q, n);
+    }
+    for (trial = 0; trial < 200000; trial++) {
+        for (j = 0; j < n; j++) {
+            p[j] = q[j] = rnd(trial & 1 ? 16383 : 8);
+        }
+        bad += networks[k](p) != medianRef(q, n);
+    }
+    return bad;
+}
+
+static unsigned long checkFilter(void) {
+    medianFilter f;
+    int hist[BEMF_MEDIAN_WINDOW] = {0}, last1 = 0, last2 = 0, s, want, got;
+    unsigned long t, bad = 0;
+
+    medianInit(&f, 0);
+    for (t = 0; t < 200000; t++) {
+        s = rnd(1023);
+        got = medianUpdate(&f, s);
+        if (BEMF_MEDIAN_WINDOW == 3) {
+            want = oldMedian3(s, last1, last2);
+            last2 = last1;
+            last1 = s;
+        } else {
+            memmove(hist, hist + 1, (BEMF_MEDIAN_WINDOW - 1) * sizeof(int));
+            hist[BEMF_MEDIAN_WINDOW - 1] = s;
+            want = medianRef(hist, BEMF_MEDIAN_WINDOW);
+        }
+        bad += got != want;
+    }
+    return bad;
+}
+
+// Measured back emf: a slow sine with 5% brush short zeros
+static void makeSignal(int *sig) {
+    unsigned long t;
+    for (t = 0; t < NUM_SAMPLES; t++) {
+        sig[t] = 300 + (int) (200 * ((t / 50) % 2 ? 1 : -1)) + rnd(20);
+        if (rnd(1000) < -900) {
+            sig[t] = 0;
+        }
+    }
+}
+
+static double benchOld(const int *sig, unsigned long long *cycles) {
+    int last1 = 0, last2 = 0, acc = 0;
+    unsigned long t;
+    unsigned long long c0 = CYCLES();
+    for (t = 0; t < NUM_SAMPLES; t++) {
+        acc += oldMedian3(sig[t], last1, last2);
+        last2 = last1;
+        last1 = sig[t];
+    }
+    *cycles = CYCLES() - c0;
+    return acc;
+}
+
+static double benchNetwork(int k, const int *sig, unsigned long long *cycles) {
+    int n = windows[k], ring[7] = {0}, w[7], acc = 0, j;
+    unsigned int head = 0;
+    unsigned long t;
+    unsigned long long c0 = CYCLES();
+    for (t = 0; t < NUM_SAMPLES; t++) {
+        ring[head] = sig[t];
+        if (++head == (unsigned int) n) {
+            head = 0;
+        }
+        for (j = 0; j < n; j++) {
+            w[j] = ring[j];
+        }
+        acc += networks[k](w);
+    }
+    *cycles = CYCLES() - c0;
+    return acc;
+}
+
+static void bench(void) {
+    int *sig = malloc(NUM_SAMPLES * sizeof(int));
+    unsigned long long cycles, best;
+    volatile double sink = 0;
+    int k, rep;
+
+    makeSignal(sig);
+    best = ~0ULL;
+    for (rep = 0; rep < BENCH_REPS; rep++) {
+        sink += benchOld(sig, &cycles);
+        best = cycles < best ? cycles : best;
+    }
+    printf("old compare tree, 3: %.2f host cycles/sample\n",
+            (double) best / NUM_SAMPLES);
+    for (k = 0; k < 3; k++) {
+        best = ~0ULL;
+        for (rep = 0; rep < BENCH_REPS; rep++) {
+            sink += benchNetwork(k, sig, &cycles);
+            best = cycles < best ? cycles : best;
+        }
+        printf("sorting network, %d: %.2f host cycles/sample\n",
+                windows[k], (double) best / NUM_SAMPLES);
+    }
+    (void) sink;
+    free(sig);
+}
+
+int main(void) {
+    unsigned long bad = 0, b;
+    int k;
+
+    for (k = 0; k < 3; k++) {
+        b = checkNetwork(k);
+        printf("medianOf%d: %lu mismatches\n", windows[k], b);
+        bad += b;
+    }
+    b = checkFilter();
+    printf("medianUpdate, window %d: %lu mismatches\n", BEMF_MEDIAN_WINDOW, b);
+    bad += b;
+    if (bad) {
+        return 1;
+    }
+    bench();
+    return 0;
+}
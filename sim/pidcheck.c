@@ -0,0 +1,352 @@
+/*
+ * Name: pidcheck.c
+ * Desc: Checks the UpdatePID kernel against the long arithmetic it replaced
+ *
+ * Randomized gains, errors, integrator states and output limits are fed to
+ * UpdatePID and to two references computed with 64 bit math:
+ *   legacy     the original code's long arithmetic, extended with the
+ *              ILC feedforward, the output limits and slew rate of
+ *              pidSetLimits and the anti-windup back-calculated from the
+ *              limited output. Cases where any of its 32 bit
+ *              intermediates would have overflowed are counted but not
+ *              compared, since the target just wrapped there.
+ *   saturating the same law with every intermediate clamped to 32 bits,
+ *              the sum into preSat clamped once, which the kernel has to
+ *              match on every case.
+ * Battery compensation is left off, so it scales by exactly 1. p, i, d,
+ * preSat, output, i_error and the saturation flags must all match bit
+ * for bit. The
+ * GAIN_SCALER reciprocal divide is also checked on its own. Afterwards the
+ * kernel and the original code are timed on in-range inputs. The host has
+ * a native 64 bit multiply and divide, so that number says nothing about
+ * the dsPIC; use CMD_BENCH_PID for the time per call on the robot. Here
+ * the kernel pays for building each 32 bit product from 16x16 multiplies
+ * and for its one long dependent chain, where the original code is a few
+ * native multiplies. On the dsPIC those are the other way round: each
+ * long multiply is a __mulsi3 call and each divide by GAIN_SCALER a
+ * __divsi3 call, against single cycle mul.ss and no divide at all.
+ *
+ *   make check
+ *   ./pidcheck [cases]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "pid-ip2.5.h"
+#include "pid_kernel.h"
+#include "ilc.h"
+
+#define MAXTHROT    3800    // pid-ip2.5.c
+#define BENCH_SET   1024
+#define BENCH_LOOPS 20000
+
+typedef struct {
+    int64_t p, i, d, preSat, output, i_error;
+    int sat;
+} pidResult;
+
+static uint64_t rng_state = 0x9e3779b97f4a7c15ULL;
+
+static uint32_t rnd(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return (uint32_t) (rng_state >> 32);
+}
+
+static int32_t rndRange(int32_t span) {
+    return (int32_t) (rnd() % (2 * (uint32_t) span + 1)) - span;
+}
+
+static const int32_t edges[] = {
+    0, 1, -1, 2, -2, 99, -99, 100, -100, 101, -101, 4095, -4096,
+    MAXTHROT, -MAXTHROT, MAXTHROT + 1, -MAXTHROT - 1,
+    0x7fff, -0x8000, 0x10000, -0x10000,
+    INT32_MAX, INT32_MIN, INT32_MAX - 1, INT32_MIN + 1,
+    INT32_MAX / 100, INT32_MIN / 100, 0x40000000, -0x40000000,
+};
+#define NUM_EDGES (sizeof(edges) / sizeof(edges[0]))
+
+static int32_t rndEdge(void) {
+    return edges[rnd() % NUM_EDGES];
+}
+
+static int64_t sat32(int64_t x) {
+    return x > INT32_MAX ? INT32_MAX : (x < INT32_MIN ? INT32_MIN : x);
+}
+
+static int fits32(int64_t x) {
+    return x >= INT32_MIN && x <= INT32_MAX;
+}
+
+static int64_t floorShr(int64_t x, int s) {
+    return x >= 0 ? x >> s : -((-x + (1LL << s) - 1) >> s);
+}
+
+// Output limits and slew rate, setting the saturation flags
+static int64_t limitRef(const pidPos *in, int64_t preSat, int *sat) {
+    int64_t out = preSat > in->maxDC ? in->maxDC :
+            (preSat < in->minDC ? in->minDC : preSat);
+    int64_t step = out;
+
+    *sat = (preSat > in->maxDC ? PID_SAT_MAX : 0) |
+            (preSat < in->minDC ? PID_SAT_MIN : 0);
+    if (in->slew != 0) {
+        if (step > in->output + in->slew) {
+            step = in->output + in->slew;
+        } else if (step < in->output - in->slew) {
+            step = in->output - in->slew;
+        }
+        *sat |= step != out ? PID_SAT_SLEW : 0;
+    }
+    return step;
+}
+
+/* The control law in the original long arithmetic, evaluated exactly:
+   the original terms plus the ILC feedforward, output limits, slew rate
+   and anti-windup from the limited output that came later. Returns 0 if
+   that 32 bit arithmetic would have overflowed somewhere on these inputs. */
+static int legacyRef(const pidPos *in, pidResult *r) {
+    int ok = 1;
+    int64_t kp_e = (int64_t) in->Kp * in->p_error;
+    int64_t ki_e = (int64_t) in->Ki * in->i_error;
+
+    ok &= fits32(kp_e) && fits32(ki_e);
+    r->p = floorShr(kp_e, 12);
+    r->i = floorShr(ki_e, 12);
+    r->d = (int64_t) in->Kd * in->v_error;
+    r->preSat = (int64_t) in->feedforward + in->ff_ilc + r->p;
+    ok &= fits32(r->preSat);
+    r->preSat += floorShr(r->i, 4);
+    ok &= fits32(r->preSat);
+    r->preSat += floorShr(r->d, 4);
+    ok &= fits32(r->preSat);
+    r->output = limitRef(in, r->preSat, &r->sat);
+
+    r->i_error = (int64_t) in->i_error + floorShr(in->p_error, PID_I_SHIFT);
+    ok &= fits32(r->i_error);
+    if (r->output != r->preSat) {
+        int64_t aw = (int64_t) in->Kaw * (r->output - r->preSat);
+        ok &= fits32(r->output - r->preSat) && fits32(aw);
+        r->i_error += floorShr(aw / GAIN_SCALER, PID_TICK_SHIFT);
+        ok &= fits32(r->i_error);
+    }
+    return ok;
+}
+
+// The control law the kernel implements, saturating at every step
+static void saturatingRef(const pidPos *in, pidResult *r) {
+    int64_t aw;
+
+    r->p = sat32(floorShr((int64_t) in->Kp * in->p_error, 12));
+    r->i = sat32(floorShr((int64_t) in->Ki * in->i_error, 12));
+    r->d = (int64_t) in->Kd * in->v_error;
+    r->preSat = sat32((int64_t) in->feedforward + in->ff_ilc + r->p +
+            floorShr(r->i, 4) + floorShr(r->d, 4));
+    r->output = limitRef(in, r->preSat, &r->sat);
+
+    r->i_error = sat32((int64_t) in->i_error + floorShr(in->p_error, PID_I_SHIFT));
+    if (r->output != r->preSat) {
+        aw = sat32((int64_t) in->Kaw * sat32(r->output - r->preSat));
+        r->i_error = sat32(r->i_error + floorShr(aw / GAIN_SCALER, PID_TICK_SHIFT));
+    }
+}
+
+static void runKernel(const pidPos *in, pidResult *r) {
+    pidPos pid = *in;
+
+    UpdatePID(&pid);
+    r->p = pid.p;
+    r->i = pid.i;
+    r->d = pid.d;
+    r->preSat = pid.preSat;
+    r->output = pid.output;
+    r->i_error = pid.i_error;
+    r->sat = pid.satFlags;
+}
+
+static void randomInput(pidPos *pid, int mode) {
+    memset(pid, 0, sizeof(*pid));
+    switch (mode) {
+        case 0:     // gains and errors seen on the robot
+            pid->Kp = rnd() % 4096;
+            pid->Ki = rnd() % 1024;
+            pid->Kd = rnd() % 1024;
+            pid->Kaw = rnd() % 512;
+            pid->feedforward = rndRange(1000);
+            pid->ff_ilc = rndRange(ILC_MAX_CORRECTION);
+            pid->p_error = rndRange(0x40000);
+            pid->i_error = rndRange(0x1000000);
+            pid->v_error = rndRange(2000);
+            break;
+        case 1:     // anything
+            pid->Kp = rnd();
+            pid->Ki = rnd();
+            pid->Kd = rnd();
+            pid->Kaw = rnd();
+            pid->feedforward = rnd();
+            pid->ff_ilc = rnd();
+            pid->p_error = rnd();
+            pid->i_error = rnd();
+            pid->v_error = rnd();
+            break;
+        default:    // corner values
+            pid->Kp = rndEdge();
+            pid->Ki = rndEdge();
+            pid->Kd = rndEdge();
+            pid->Kaw = rndEdge();
+            pid->feedforward = rndEdge();
+            pid->ff_ilc = rndEdge();
+            pid->p_error = rndEdge();
+            pid->i_error = rndEdge();
+            pid->v_error = rndEdge();
+            break;
+    }
+    // default limits half the time, otherwise anything pidSetLimits allows
+    pid->minDC = -MAXTHROT;
+    pid->maxDC = MAXTHROT;
+    if (rnd() & 1) {
+        pid->minDC = -(int32_t) (rnd() % (MAXTHROT + 1));
+        pid->maxDC = rnd() % (MAXTHROT + 1);
+        pid->slew = rnd() % 4 ? rnd() % 1000 : 0;
+        pid->output = rndRange(MAXTHROT);
+    }
+}
+
+static int sameResult(const pidResult *a, const pidResult *b) {
+    return a->p == b->p && a->i == b->i && a->d == b->d &&
+            a->preSat == b->preSat && a->output == b->output &&
+            a->i_error == b->i_error && a->sat == b->sat;
+}
+
+static void printMismatch(const char *what, const pidPos *in,
+        const pidResult *want, const pidResult *got) {
+    fprintf(stderr, "%s mismatch: Kp=%d Ki=%d Kd=%d Kaw=%d ff=%d ilc=%d "
+            "p_error=%d i_error=%d v_error=%d\n", what,
+            in->Kp, in->Ki, in->Kd, in->Kaw, in->feedforward, in->ff_ilc,
+            in->p_error, in->i_error, in->v_error);
+    fprintf(stderr, "  limits %d..%d slew %u from %d\n",
+            in->minDC, in->maxDC, in->slew, in->output);
+    fprintf(stderr, "  want p=%lld i=%lld d=%lld preSat=%lld out=%lld i_error=%lld sat=%d\n",
+            (long long) want->p, (long long) want->i, (long long) want->d,
+            (long long) want->preSat, (long long) want->output,
+            (long long) want->i_error, want->sat);
+    fprintf(stderr, "  got  p=%lld i=%lld d=%lld preSat=%lld out=%lld i_error=%lld sat=%d\n",
+            (long long) got->p, (long long) got->i, (long long) got->d,
+            (long long) got->preSat, (long long) got->output,
+            (long long) got->i_error, got->sat);
+}
+
+static unsigned long checkDivGain(unsigned long cases) {
+    unsigned long n, bad = 0;
+    int32_t x;
+
+    for (n = 0; n < cases + NUM_EDGES; n++) {
+        x = n < NUM_EDGES ? edges[n] : (int32_t) rnd();
+        if (pidDivGain(x) != x / GAIN_SCALER) {
+            if (bad++ < 10) {
+                fprintf(stderr, "pidDivGain(%d) = %d, want %d\n",
+                        x, pidDivGain(x), x / GAIN_SCALER);
+            }
+        }
+    }
+    return bad;
+}
+
+// The original UpdatePID, for timing only. Inputs must not overflow.
+// Not inlined, so that it is called like the kernel in the other file.
+static __attribute__((noinline)) void legacyUpdatePID(pidPos *pid) {
+    pid->p = ((int32_t) pid->Kp * pid->p_error) >> 12;
+    pid->i = (int32_t) pid->Ki * pid->i_error >> 12;
+    pid->d = (int32_t) pid->Kd * (int32_t) pid->v_error;
+    pid->preSat = pid->feedforward + pid->p +
+            ((pid->i) >> 4) +
+            (pid->d >> 4);
+    pid->output = pid->preSat;
+    pid->i_error = (int32_t) pid->i_error + ((int32_t) pid->p_error >> 4);
+    if (pid->preSat > MAXTHROT) {
+        pid->output = MAXTHROT;
+        pid->i_error = (int32_t) pid->i_error +
+                (int32_t) (pid->Kaw) * ((int32_t) (MAXTHROT) - (int32_t) (pid->preSat))
+                / ((int32_t) GAIN_SCALER);
+    }
+    if (pid->preSat < -MAXTHROT) {
+        pid->output = -MAXTHROT;
+        pid->i_error = (int32_t) pid->i_error +
+                (int32_t) (pid->Kaw) * ((int32_t) (MAXTHROT) - (int32_t) (pid->preSat))
+                / ((int32_t) GAIN_SCALER);
+    }
+}
+
+static double benchNs(void (*update)(pidPos *), const pidPos *set) {
+    static pidPos work[BENCH_SET];
+    struct timespec t0, t1;
+    unsigned int loop, k;
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (loop = 0; loop < BENCH_LOOPS; loop++) {
+        memcpy(work, set, sizeof(work));
+        for (k = 0; k < BENCH_SET; k++) {
+            if (update) {
+                update(&work[k]);
+            }
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    return ((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)) /
+            ((double) BENCH_LOOPS * BENCH_SET);
+}
+
+static void bench(void) {
+    static pidPos set[BENCH_SET];
+    pidResult r;
+    unsigned int k = 0;
+    double t_copy, t_legacy, t_kernel;
+
+    while (k < BENCH_SET) {
+        randomInput(&set[k], 0);
+        if (legacyRef(&set[k], &r)) {
+            k++;
+        }
+    }
+    t_copy = benchNs(NULL, set);
+    t_legacy = benchNs(legacyUpdatePID, set) - t_copy;
+    t_kernel = benchNs(UpdatePID, set) - t_copy;
+    printf("host ns/call: legacy %.2f kernel %.2f\n", t_legacy, t_kernel);
+}
+
+int main(int argc, char *argv[]) {
+    unsigned long cases = argc > 1 ? strtoul(argv[1], NULL, 0) : 3000000;
+    unsigned long n, in_range = 0, bad_legacy = 0, bad_sat = 0, bad_div;
+    pidPos in;
+    pidResult legacy, saturating, kernel;
+
+    for (n = 0; n < cases; n++) {
+        randomInput(&in, n % 3);
+        runKernel(&in, &kernel);
+
+        if (legacyRef(&in, &legacy)) {
+            in_range++;
+            if (!sameResult(&legacy, &kernel) && bad_legacy++ < 10) {
+                printMismatch("legacy", &in, &legacy, &kernel);
+            }
+        }
+        saturatingRef(&in, &saturating);
+        if (!sameResult(&saturating, &kernel) && bad_sat++ < 10) {
+            printMismatch("saturating", &in, &saturating, &kernel);
+        }
+    }
+    bad_div = checkDivGain(cases);
+
+    printf("UpdatePID: %lu cases, %lu in legacy range, %lu legacy mismatches, "
+            "%lu saturating mismatches\n", cases, in_range, bad_legacy, bad_sat);
+    printf("pidDivGain: %lu mismatches\n", bad_div);
+
+    if (bad_legacy || bad_sat || bad_div) {
+        return 1;
+    }
+    bench();
+    return 0;
+}
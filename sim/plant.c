@@ -0,0 +1,174 @@
+/*
+ * Name: plant.c
+ * Desc: DC motor, gearbox and leg crank model for the host simulator
+ *
+ * Electrical time constant is neglected; the winding current follows the
+ * applied voltage minus back EMF. Ground contact is modelled as a load
+ * torque over the stance half of each stride. Sensor scalings match the
+ * firmware constants, e.g. 80 rad/s of crank rate reads as 140 A/D units of
+ * back EMF, the same calibration K_EMF in pid-ip2.5.h is derived from.
+ */
+#include "plant.h"
+#include "pid-ip2.5.h"
+
+#include <math.h>
+#include <string.h>
+
+#define PLANT_DC_FULL           4000    // tiH duty cycle at 100% PWM
+#define PLANT_DC_BEMF_BLIND     3868    // above 96.7% duty back EMF can't be sampled
+#define PLANT_ADC_MAX           1023
+#define PLANT_ENC_COUNTS        16384.0 // AMS encoder counts per crank revolution
+#define PLANT_STRIDE_LENGTH     0.04    // m travelled per stride
+#define PLANT_TRACK_WIDTH       0.05    // m between left and right tripods
+#define PLANT_GYRO_LSB_PER_DPS  16.4    // MPU6000 at +-2000 deg/s
+#define PLANT_SUBSTEPS          4
+
+static unsigned long plantRand(plantState *plant) {
+    // xorshift32, deterministic between runs
+    unsigned long x = plant->rng;
+    x ^= (x << 13) & 0xffffffffUL;
+    x ^= x >> 17;
+    x ^= (x << 5) & 0xffffffffUL;
+    plant->rng = x;
+    return x;
+}
+
+void plantDefaultParams(plantParams *params) {
+    params->R = 3.0;
+    params->Ke = 0.0197;            // ~30 Hz no load stride rate at 3.7 V
+    params->J = 2.6e-6;             // ~20 ms mechanical time constant
+    params->b = 2.0e-6;
+    params->tau_coulomb = 0.5e-3;
+    params->tau_stance = 4.0e-3;
+    params->Voc = 3.9;
+    params->Rbatt = 0.15;
+    params->bemf_dropout = 0.0;
+}
+
+void plantInit(plantState *plant, const plantParams *params) {
+    memset(plant, 0, sizeof (plantState));
+    plant->params = *params;
+    plant->Vbatt = params->Voc;
+    plant->rng = 0x2052;
+
+    // Same wiring the firmware assumes with the default leg configuration:
+    // a positive PID output always moves the leg, and p_state, forward.
+    plant->leg[LEFT_LEGS_PID_NUM].tih_chan = LEFT_LEGS_TIH_CHAN;
+    plant->leg[LEFT_LEGS_PID_NUM].enc_num = LEFT_LEGS_ENC_NUM;
+    plant->leg[LEFT_LEGS_PID_NUM].pwm_sign = LEFT_LEGS_PWM_FLIP ? -1 : 1;
+    plant->leg[LEFT_LEGS_PID_NUM].enc_sign =
+            plant->leg[LEFT_LEGS_PID_NUM].pwm_sign * (LEFT_LEGS_ENC_FLIP ? -1 : 1);
+
+    plant->leg[RIGHT_LEGS_PID_NUM].tih_chan = RIGHT_LEGS_TIH_CHAN;
+    plant->leg[RIGHT_LEGS_PID_NUM].enc_num = RIGHT_LEGS_ENC_NUM;
+    plant->leg[RIGHT_LEGS_PID_NUM].pwm_sign = RIGHT_LEGS_PWM_FLIP ? -1 : 1;
+    plant->leg[RIGHT_LEGS_PID_NUM].enc_sign =
+            plant->leg[RIGHT_LEGS_PID_NUM].pwm_sign * (RIGHT_LEGS_FLIP ? -1 : 1);
+}
+
+void plantSetDC(plantState *plant, unsigned char tih_chan, int dc) {
+    int i;
+    if (dc > PLANT_DC_FULL) dc = PLANT_DC_FULL;
+    if (dc < -PLANT_DC_FULL) dc = -PLANT_DC_FULL;
+    for (i = 0; i < PLANT_NUM_LEGS; i++) {
+        if (plant->leg[i].tih_chan == tih_chan) {
+            plant->leg[i].dc = dc;
+        }
+    }
+}
+
+void plantStep(plantState *plant, double dt) {
+    plantParams *p = &plant->params;
+    double h = dt / PLANT_SUBSTEPS;
+    double v_fwd[PLANT_NUM_LEGS];
+    int i, k;
+
+    for (k = 0; k < PLANT_SUBSTEPS; k++) {
+        double ibatt = 0.0;
+        for (i = 0; i < PLANT_NUM_LEGS; i++) {
+            plantLeg *leg = &plant->leg[i];
+            double duty = (double) leg->dc / PLANT_DC_FULL;
+            double tau, phase, load;
+
+            leg->current = (duty * plant->Vbatt - p->Ke * leg->omega) / p->R;
+            ibatt += fabs(duty * leg->current);
+
+            // ground reaction resists forward motion during stance
+            phase = leg->pwm_sign * leg->theta;
+            load = sin(phase);
+            load = (load > 0.0) ? p->tau_stance * load : 0.0;
+            tau = p->Ke * leg->current - p->b * leg->omega - leg->pwm_sign * load;
+
+            if (leg->omega == 0.0 && fabs(tau) <= p->tau_coulomb) {
+                continue; // stiction
+            }
+            if (leg->omega > 0.0 || (leg->omega == 0.0 && tau > 0.0)) {
+                tau -= p->tau_coulomb;
+            } else {
+                tau += p->tau_coulomb;
+            }
+            {
+                double omega_next = leg->omega + tau / p->J * h;
+                // friction can stop the crank but not reverse it
+                if ((leg->omega > 0.0 && omega_next < 0.0) ||
+                        (leg->omega < 0.0 && omega_next > 0.0)) {
+                    omega_next = 0.0;
+                }
+                leg->theta += 0.5 * (leg->omega + omega_next) * h;
+                leg->omega = omega_next;
+            }
+        }
+        plant->Vbatt = p->Voc - p->Rbatt * ibatt;
+    }
+
+    for (i = 0; i < PLANT_NUM_LEGS; i++) {
+        v_fwd[i] = plant->leg[i].pwm_sign * plant->leg[i].omega *
+                PLANT_STRIDE_LENGTH / (2.0 * M_PI);
+    }
+    plant->yaw_rate = (v_fwd[RIGHT_LEGS_PID_NUM] - v_fwd[LEFT_LEGS_PID_NUM]) /
+            PLANT_TRACK_WIDTH;
+}
+
+double plantEncoderCounts(plantState *plant, unsigned char enc_num) {
+    int i;
+    for (i = 0; i < PLANT_NUM_LEGS; i++) {
+        if (plant->leg[i].enc_num == enc_num) {
+            return plant->leg[i].enc_sign * plant->leg[i].theta *
+                    PLANT_ENC_COUNTS / (2.0 * M_PI);
+        }
+    }
+    return 0.0;
+}
+
+// Raw A/D reading of the motor sense line. Forward leg motion reads below
+// the offset, so the firmware's (inputOffset - adc) is positive going forward.
+int plantBemfAdc(plantState *plant, unsigned int leg_num, int offset) {
+    plantLeg *leg;
+    double bemf;
+    int adc;
+
+    if (leg_num >= PLANT_NUM_LEGS) {
+        return offset;
+    }
+    leg = &plant->leg[leg_num];
+    if (leg->dc > PLANT_DC_BEMF_BLIND || leg->dc < -PLANT_DC_BEMF_BLIND) {
+        return offset;
+    }
+    if (plant->params.bemf_dropout > 0.0 &&
+            (plantRand(plant) & 0xffff) < plant->params.bemf_dropout * 0x10000) {
+        return offset;
+    }
+    bemf = leg->pwm_sign * plant->params.Ke * leg->omega * PLANT_ADC_PER_VOLT;
+    adc = offset - (int) lround(bemf);
+    if (adc < 0) adc = 0;
+    if (adc > PLANT_ADC_MAX) adc = PLANT_ADC_MAX;
+    return adc;
+}
+
+unsigned int plantVbattAdc(plantState *plant) {
+    return (unsigned int) lround(plant->Vbatt * PLANT_ADC_PER_VOLT);
+}
+
+int plantGyroZ(plantState *plant) {
+    return (int) lround(plant->yaw_rate * 180.0 / M_PI * PLANT_GYRO_LSB_PER_DPS);
+}
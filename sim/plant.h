@@ -0,0 +1,57 @@
+/*
+ * Name: plant.h
+ * Desc: DC motor, gearbox and leg crank model for the host simulator
+ *
+ * Each leg is a brushed DC motor driving a crank through the gearbox. All
+ * quantities are referred to the crank (output) shaft, so one crank
+ * revolution is one stride and one 14-bit AMS encoder revolution.
+ */
+#ifndef __PLANT_H
+#define __PLANT_H
+
+#define PLANT_NUM_LEGS      2
+#define PLANT_ADC_PER_VOLT  88.7    // motor and battery sense dividers
+
+typedef struct {
+    double R;               // winding resistance, ohm
+    double Ke;              // back EMF / torque constant at crank, V.s/rad
+    double J;               // crank referred inertia, kg.m^2
+    double b;               // viscous friction, N.m.s/rad
+    double tau_coulomb;     // dry friction, N.m
+    double tau_stance;      // peak ground reaction torque during stance, N.m
+    double Voc;             // battery open circuit voltage, V
+    double Rbatt;           // battery internal resistance, ohm
+    double bemf_dropout;    // probability a back EMF sample reads as a brush short
+} plantParams;
+
+typedef struct {
+    // wiring, filled in from the firmware default leg configuration
+    unsigned char tih_chan;     // 1-4
+    unsigned char enc_num;      // 0-1
+    int pwm_sign;               // motor direction that moves the leg forward
+    int enc_sign;               // encoder direction relative to motor
+    // state
+    double theta;               // crank angle, rad
+    double omega;               // crank rate, rad/s
+    double current;             // winding current, A
+    int dc;                     // commanded duty cycle, tiH units
+} plantLeg;
+
+typedef struct {
+    plantParams params;
+    plantLeg leg[PLANT_NUM_LEGS];
+    double Vbatt;               // terminal voltage, V
+    double yaw_rate;            // body yaw rate, rad/s
+    unsigned long rng;
+} plantState;
+
+void plantDefaultParams(plantParams *params);
+void plantInit(plantState *plant, const plantParams *params);
+void plantSetDC(plantState *plant, unsigned char tih_chan, int dc);
+void plantStep(plantState *plant, double dt);
+double plantEncoderCounts(plantState *plant, unsigned char enc_num);
+int plantBemfAdc(plantState *plant, unsigned int leg, int offset);
+unsigned int plantVbattAdc(plantState *plant);
+int plantGyroZ(plantState *plant);
+
+#endif // __PLANT_H
@@ -0,0 +1,467 @@
+/*
+ * Name: sim.c
+ * Desc: Virtual clock and imageproc-lib peripheral shims
+ *
+ * The firmware modules are compiled unmodified against the headers in
+ * sim/include. Everything they expect from imageproc-lib and the dsPIC
+ * peripheral libraries is implemented here on top of the plant model.
+ *
+ * The clock is stepped synchronously and deterministically: delay_us()
+ * and simRunMs() advance it one Timer1 period at a time, running the PWM
+ * triggered ADC conversions and the ISRs that fall inside each period.
+ */
+#include "sim.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <xc.h>
+#include "timer.h"
+#include "utils.h"
+#include "pwm.h"
+#include "sclock.h"
+#include "ams-enc.h"
+#include "mpu6000.h"
+#include "tih.h"
+#include "adc_pid.h"
+#include "dfmem.h"
+#include "radio.h"
+#include "version.h"
+#include "telem.h"
+#include "telem_comp.h"
+#include "telem_stream.h"
+#include "cmd.h"
+#include "pid-ip2.5.h"
+
+void __attribute__((interrupt, no_auto_psv)) _T1Interrupt(void);
+void __attribute__((interrupt, no_auto_psv)) _ADC1Interrupt(void);
+
+// dsPIC registers and flags
+volatile unsigned int PDC1, PDC2, PDC3, PDC4;
+volatile unsigned int PTCON;
+volatile unsigned char _T1IF;
+volatile unsigned char LED_1, LED_2, LED_3;
+volatile unsigned char sim_t1_enabled;
+volatile simAD1CON1bits AD1CON1bits;
+volatile simAD1CON2bits AD1CON2bits;
+volatile simAD1CON3bits AD1CON3bits;
+volatile simAD1CON4bits AD1CON4bits;
+volatile simAD1CHS0bits AD1CHS0bits;
+volatile simAD1CHS123bits AD1CHS123bits;
+volatile unsigned int AD1PCFGL, AD1CSSL, ADC1BUF0;
+volatile unsigned char _AD1IF, _AD1IE, _AD1IP, _DMA0IE;
+volatile simDMA0CONbits DMA0CONbits;
+volatile unsigned int DMA0PAD, DMA0REQ, DMA0STA, DMA0CNT;
+
+// firmware globals normally defined in main.c and init.c
+volatile MacPacket uart_tx_packet;
+volatile unsigned char uart_tx_flag;
+
+plantState sim_plant;
+
+static unsigned long long sim_time_us;
+static unsigned long sim_clock_start;
+static unsigned long long sim_pwm_next_us;
+static unsigned char sim_in_tick;
+static unsigned long long sim_radio_busy_us;
+
+static void simPwmTrigger(void);
+
+/*-----------------------------------------------------------------------------
+ *          Virtual clock
+-----------------------------------------------------------------------------*/
+void simInit(const plantParams *params) {
+    plantInit(&sim_plant, params);
+    sim_time_us = 0;
+    sim_radio_busy_us = 0;
+    sim_pwm_next_us = SIM_PWM_PERIOD_US;
+    sim_t1_enabled = 0;
+    sim_clock_start = 0;
+}
+
+// sclock reading at boot; the firmware only ever sees the low 32 bits
+void simSetClockStart(unsigned long us) {
+    sim_clock_start = us;
+}
+
+void simTick(void) {
+    if (sim_in_tick) {
+        return;
+    }
+    sim_in_tick = 1;
+    plantStep(&sim_plant, SIM_T1_PERIOD_US * 1e-6);
+    sim_time_us += SIM_T1_PERIOD_US;
+    while (sim_pwm_next_us <= sim_time_us) {
+        simPwmTrigger();
+        sim_pwm_next_us += SIM_PWM_PERIOD_US;
+    }
+    if (sim_t1_enabled) {
+        _T1Interrupt();
+    }
+    sim_in_tick = 0;
+}
+
+// Same module setup order as main(), then wait out the back emf calibration
+void simBoot(void) {
+    sclockSetup();
+    cmdSetup();
+    radioInit(RADIO_RXPQ_MAX_SIZE, RADIO_TXPQ_MAX_SIZE);
+    amsEncoderSetup();
+    mpuSetup();
+    tiHSetup();
+    dfmemSetup();
+    telemSetup();
+    telemCompSetup();
+    telemStreamSetup();
+    adcSetup();
+    pidSetup();
+    while (!pidCalibDone()) {
+        simRunMs(1);
+    }
+}
+
+// Main loop equivalent: service commands and compressed telemetry between
+// Timer1 periods
+void simRunMs(unsigned long ms) {
+    unsigned long n = ms * (1000 / SIM_T1_PERIOD_US);
+    while (n--) {
+        cmdHandleRadioRxBuffer();
+        telemCompProcess();
+        telemStreamProcess();
+        simTick();
+    }
+}
+
+unsigned long long simGetTimeUs(void) {
+    return sim_time_us;
+}
+
+void delay_us(unsigned int us) {
+    unsigned long long target = sim_time_us + us;
+    while (sim_time_us < target) {
+        simTick();
+    }
+}
+
+void delay_ms(unsigned int ms) {
+    delay_us(ms * 1000U);
+}
+
+void sclockSetup(void) {
+}
+
+unsigned long sclockGetTime(void) {
+    return (uint32_t) (sim_clock_start + sim_time_us * SCLOCK_TICKS_PER_MS / 1000);
+}
+
+// Stands in for lib/init.c
+void SetupTimer1(void) {
+}
+
+/*-----------------------------------------------------------------------------
+ *          Motor drive and sensors
+-----------------------------------------------------------------------------*/
+void SetDCMCPWM(unsigned int dutycyclereg, unsigned int dutycycle, char updatedisable) {
+    (void) updatedisable;
+    tiHSetDC(dutycyclereg, dutycycle);
+}
+
+void tiHSetup(void) {
+}
+
+void tiHSetDC(unsigned char channel, int dc) {
+    plantSetDC(&sim_plant, channel, dc);
+}
+
+static int enc_latched[NUM_ENC];
+static int enc_offset[NUM_ENC];
+static int enc_oticks_base[NUM_ENC];
+
+static void simEncoderLatch(void) {
+    int i;
+    for (i = 0; i < NUM_ENC; i++) {
+        double c = plantEncoderCounts(&sim_plant, i);
+        enc_latched[i] = (int) (c >= 0.0 ? c : c - 1.0);
+    }
+}
+
+void amsEncoderSetup(void) {
+    simEncoderLatch();
+    amsEncoderResetPos();
+}
+
+void amsEncoderStartAsyncRead(void) {
+    simEncoderLatch();
+}
+
+int amsEncoderGetPos(unsigned char num) {
+    return num < NUM_ENC ? (enc_latched[num] & 0x3fff) : 0;
+}
+
+int amsEncoderGetOticks(unsigned char num) {
+    // arithmetic shift floors negative counts to the revolution below
+    return num < NUM_ENC ? (enc_latched[num] >> 14) - enc_oticks_base[num] : 0;
+}
+
+unsigned int amsEncoderGetOffset(unsigned char num) {
+    return num < NUM_ENC ? enc_offset[num] : 0;
+}
+
+void amsEncoderResetPos(void) {
+    int i;
+    for (i = 0; i < NUM_ENC; i++) {
+        enc_offset[i] = enc_latched[i] & 0x3fff;
+        enc_oticks_base[i] = enc_latched[i] >> 14;
+    }
+}
+
+static int gyro_latched[3];
+static int xl_latched[3];
+
+void mpuSetup(void) {
+    mpuBeginUpdate();
+}
+
+void mpuBeginUpdate(void) {
+    gyro_latched[0] = 0;
+    gyro_latched[1] = 0;
+    gyro_latched[2] = plantGyroZ(&sim_plant);
+    xl_latched[0] = 0;
+    xl_latched[1] = 0;
+    xl_latched[2] = 2048;   // 1 g at +-16 g full scale
+}
+
+void mpuGetGyro(int* buff) {
+    memcpy(buff, gyro_latched, sizeof (gyro_latched));
+}
+
+void mpuGetXl(int* buff) {
+    memcpy(buff, xl_latched, sizeof (xl_latched));
+}
+
+/* ADC1 + DMA0. Each PWM special event converts the next scanned input on
+   CH0 and the CH1 input, DMA0 stores the results in order and wraps after
+   DMA0CNT + 1 words, and the ADC interrupt fires every SMPI + 1 results. */
+static unsigned int *sim_dma_ram;
+static unsigned int sim_dma_pos, sim_adc_scan, sim_adc_results;
+
+unsigned int simDmaOffset(volatile void *p) {
+    sim_dma_ram = (unsigned int *) p;
+    sim_dma_pos = 0;
+    sim_adc_scan = 0;
+    sim_adc_results = 0;
+    return 0;
+}
+
+static unsigned int simConvert(unsigned int an) {
+    switch (an) {
+        case 0:
+            return plantVbattAdc(&sim_plant);
+        case 8:     // motor A
+            return plantBemfAdc(&sim_plant, 0, SIM_ADC_OFFSET);
+        case 9:     // motor B
+            return plantBemfAdc(&sim_plant, 1, SIM_ADC_OFFSET);
+        default:
+            return SIM_ADC_OFFSET;
+    }
+}
+
+static void simDmaStore(unsigned int value) {
+    sim_dma_ram[sim_dma_pos] = value;
+    if (++sim_dma_pos > DMA0CNT) {
+        sim_dma_pos = 0;
+    }
+    if (++sim_adc_results > AD1CON2bits.SMPI) {
+        sim_adc_results = 0;
+        _AD1IF = 1;
+        if (_AD1IE) {
+            _ADC1Interrupt();
+        }
+    }
+}
+
+static void simPwmTrigger(void) {
+    unsigned int an;
+
+    if (!AD1CON1bits.ADON || !DMA0CONbits.CHEN || sim_dma_ram == NULL ||
+            AD1CSSL == 0) {
+        return;
+    }
+    do {
+        an = sim_adc_scan;
+        sim_adc_scan = (sim_adc_scan + 1) & 0x0f;
+    } while (!(AD1CSSL & (1 << an)));
+    simDmaStore(simConvert(an));
+    simDmaStore(simConvert(AD1CHS123bits.CH123SA ? 3 : 0));
+}
+
+/*-----------------------------------------------------------------------------
+ *          Dataflash, AT45DB161D geometry held in RAM
+-----------------------------------------------------------------------------*/
+#define DFMEM_MAX_PAGES         4096
+#define DFMEM_BYTES_PER_PAGE    528
+#define DFMEM_PAGES_PER_BLOCK   8
+#define DFMEM_BLOCKS_PER_SECTOR 32
+
+static unsigned char dfmem_image[DFMEM_MAX_PAGES][DFMEM_BYTES_PER_PAGE];
+
+void dfmemSetup(void) {
+    memset(dfmem_image, 0xff, sizeof (dfmem_image));
+}
+
+void dfmemWrite(unsigned char *data, unsigned int length, unsigned int page,
+        unsigned int byte, unsigned char buffer) {
+    (void) buffer;
+    if (page >= DFMEM_MAX_PAGES || byte + length > DFMEM_BYTES_PER_PAGE) {
+        return;
+    }
+    memcpy(&dfmem_image[page][byte], data, length);
+}
+
+void dfmemRead(unsigned int page, unsigned int byte, unsigned int length,
+        unsigned char *data) {
+    if (page >= DFMEM_MAX_PAGES || byte + length > DFMEM_BYTES_PER_PAGE) {
+        memset(data, 0xff, length);
+        return;
+    }
+    memcpy(data, &dfmem_image[page][byte], length);
+}
+
+void dfmemEraseSector(unsigned int page) {
+    unsigned int per_sector = DFMEM_PAGES_PER_BLOCK * DFMEM_BLOCKS_PER_SECTOR;
+    unsigned int first = page - (page % per_sector);
+    if (first < DFMEM_MAX_PAGES) {
+        memset(dfmem_image[first], 0xff, per_sector * DFMEM_BYTES_PER_PAGE);
+    }
+}
+
+void dfmemGetGeometryParams(DfmemGeometry geo) {
+    geo->max_pages = DFMEM_MAX_PAGES;
+    geo->bytes_per_page = DFMEM_BYTES_PER_PAGE;
+    geo->pages_per_block = DFMEM_PAGES_PER_BLOCK;
+    geo->blocks_per_sector = DFMEM_BLOCKS_PER_SECTOR;
+    geo->pages_per_sector = DFMEM_PAGES_PER_BLOCK * DFMEM_BLOCKS_PER_SECTOR;
+}
+
+/*-----------------------------------------------------------------------------
+ *          Radio
+-----------------------------------------------------------------------------*/
+#define SIM_RX_QUEUE_LEN    16
+#define SIM_HOST_ADDR       0x2011
+
+static MacPacketStruct rx_queue[SIM_RX_QUEUE_LEN];
+static unsigned int rx_head, rx_count;
+static simRadioTxCallback radio_tx_callback;
+
+void simSetRadioTxCallback(simRadioTxCallback callback) {
+    radio_tx_callback = callback;
+}
+
+void simSendCommand(unsigned char type, void *data, unsigned char length) {
+    MacPacket packet;
+    if (rx_count == SIM_RX_QUEUE_LEN || length > PAYLOAD_MAX_DATA) {
+        fprintf(stderr, "sim: dropped command 0x%02X\n", type);
+        return;
+    }
+    packet = &rx_queue[(rx_head + rx_count) % SIM_RX_QUEUE_LEN];
+    packet->src_addr.val = SIM_HOST_ADDR;
+    packet->dest_addr.val = RADIO_SRC_ADDR;
+    packet->payload.status = 0;
+    packet->payload.type = type;
+    packet->payload.data_length = length;
+    memcpy(packet->payload.data, data, length);
+    rx_count++;
+}
+
+void radioInit(unsigned int rx_queue_length, unsigned int tx_queue_length) {
+    (void) rx_queue_length;
+    (void) tx_queue_length;
+    rx_head = 0;
+    rx_count = 0;
+}
+
+void radioSetChannel(unsigned char channel) {
+    (void) channel;
+}
+
+void radioSetSrcAddr(unsigned int addr) {
+    (void) addr;
+}
+
+void radioSetSrcPanID(unsigned int pan_id) {
+    (void) pan_id;
+}
+
+unsigned int radioSendData(unsigned int dest_addr, unsigned char status,
+        unsigned char type, unsigned int datalen, unsigned char* dataptr,
+        unsigned char fast_fail) {
+    (void) dest_addr;
+    (void) fast_fail;
+    // on air one after another, SIM_RADIO_PACKET_US each
+    if (sim_radio_busy_us < sim_time_us) {
+        sim_radio_busy_us = sim_time_us;
+    }
+    sim_radio_busy_us += SIM_RADIO_PACKET_US;
+    if (radio_tx_callback != NULL) {
+        radio_tx_callback(status, type, dataptr, datalen);
+    }
+    return 1;
+}
+
+MacPacket radioDequeueRxPacket(void) {
+    MacPacket packet;
+    if (rx_count == 0) {
+        return NULL;
+    }
+    packet = &rx_queue[rx_head];
+    rx_head = (rx_head + 1) % SIM_RX_QUEUE_LEN;
+    rx_count--;
+    return packet;
+}
+
+void radioReturnPacket(MacPacket packet) {
+    (void) packet;
+}
+
+void radioProcess(void) {
+}
+
+unsigned int radioRxQueueEmpty(void) {
+    return rx_count == 0;
+}
+
+unsigned int radioTxQueueEmpty(void) {
+    return radioGetTxQueueSize() == 0;
+}
+
+// Packets not yet on air
+unsigned int radioGetTxQueueSize(void) {
+    if (sim_radio_busy_us <= sim_time_us) {
+        return 0;
+    }
+    return (sim_radio_busy_us - sim_time_us + SIM_RADIO_PACKET_US - 1) / SIM_RADIO_PACKET_US;
+}
+
+Payload macGetPayload(MacPacket packet) {
+    return &packet->payload;
+}
+
+unsigned char payGetStatus(Payload pld) {
+    return pld->status;
+}
+
+unsigned char payGetType(Payload pld) {
+    return pld->type;
+}
+
+unsigned char* payGetData(Payload pld) {
+    return pld->data;
+}
+
+unsigned char payGetDataLength(Payload pld) {
+    return pld->data_length;
+}
+
+char* versionGetString(void) {
+    return "roach host simulator";
+}
@@ -0,0 +1,37 @@
+/*
+ * Name: sim.h
+ * Desc: Virtual clock and peripheral shims for running the roach firmware
+ *       modules on a host.
+ *
+ * Timer1 is not a hardware timer here. Each simTick() advances the plant by
+ * one Timer1 period and then calls _T1Interrupt() if the interrupt is
+ * enabled, so simulated time runs as fast as the host can compute it.
+ */
+#ifndef __SIM_H
+#define __SIM_H
+
+#include "plant.h"
+#include "loop_rate.h"
+
+#define SIM_T1_PERIOD_US    SCHED_TICK_PERIOD_US    // see SetupTimer1()
+#define SIM_PWM_PERIOD_US   250     // PWM at 4 kHz, ADC special event trigger
+#define SIM_ADC_OFFSET      512     // motor sense A/D reading at rest
+#ifndef SIM_RADIO_PACKET_US
+#define SIM_RADIO_PACKET_US 4000    // 127 byte frame at 250 kbit/s, CSMA and ACK
+#endif
+
+typedef void (*simRadioTxCallback)(unsigned char status, unsigned char type,
+        unsigned char *data, unsigned int length);
+
+extern plantState sim_plant;
+
+void simInit(const plantParams *params);
+void simSetClockStart(unsigned long us);
+void simBoot(void);
+void simTick(void);
+void simRunMs(unsigned long ms);
+unsigned long long simGetTimeUs(void);
+void simSendCommand(unsigned char type, void *data, unsigned char length);
+void simSetRadioTxCallback(simRadioTxCallback callback);
+
+#endif // __SIM_H
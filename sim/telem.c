@@ -0,0 +1,106 @@
+/*
+ * Name: telem.c
+ * Desc: Host port of the imageproc-lib telemetry module
+ *
+ * Samples are packed whole into dataflash pages, never straddling a page
+ * boundary, and read back one sample per CMD_FLASH_READBACK packet, the
+ * same as on the robot.
+ */
+#include "telem.h"
+#include "dfmem.h"
+#include "radio.h"
+#include "sclock.h"
+#include "utils.h"
+#include "cmd.h"
+
+#define READBACK_DELAY_TIME_MS  2
+
+static DfmemGeometryStruct mem_geo;
+static unsigned int samplesPerPage;
+static volatile unsigned long samplesToSave;
+static unsigned long sampleIndex;
+static unsigned long telemStartTime;
+static unsigned int telemSkip, skipcounter;
+
+static void telemLocate(unsigned long index, unsigned int *page, unsigned int *byte) {
+    *page = index / samplesPerPage;
+    *byte = (index % samplesPerPage) * PACKETSIZE;
+}
+
+void telemSetup(void) {
+    dfmemGetGeometryParams(&mem_geo);
+    samplesPerPage = mem_geo.bytes_per_page / PACKETSIZE;
+    samplesToSave = 0;
+    sampleIndex = 0;
+    telemSkip = 0;
+    skipcounter = 0;
+}
+
+void telemSetSamplesToSave(unsigned long n) {
+    samplesToSave = n;
+    sampleIndex = 0;
+}
+
+void telemSetStartTime(void) {
+    telemStartTime = sclockGetTime();
+}
+
+void telemSetSkip(unsigned int skipnum) {
+    telemSkip = skipnum;
+}
+
+void telemSaveData(telemStruct_t *data) {
+    unsigned int page, byte;
+    telemLocate(data->sampleIndex, &page, &byte);
+    dfmemWrite((unsigned char *) data, PACKETSIZE, page, byte, 0);
+}
+
+// Called from the Timer1 ISR at 1 kHz
+void telemSaveNow(void) {
+    telemStruct_t sample;
+
+    if (samplesToSave == 0) {
+        return;
+    }
+    if (skipcounter != 0) {
+        skipcounter--;
+        return;
+    }
+    skipcounter = telemSkip;
+
+    sample.sampleIndex = sampleIndex;
+    sample.timestamp = sclockGetTime() - telemStartTime;
+    TELEMPACKFUNC(&sample.telemData);
+    telemSaveData(&sample);
+    sampleIndex++;
+    samplesToSave--;
+}
+
+void telemErase(unsigned long numSamples) {
+    unsigned int page, byte, p;
+    if (numSamples == 0) {
+        return;
+    }
+    telemLocate(numSamples - 1, &page, &byte);
+    for (p = 0; p <= page; p += mem_geo.pages_per_sector) {
+        dfmemEraseSector(p);
+    }
+}
+
+void telemSendDataDelay(telemStruct_t* sample, int delaytime_ms, unsigned int src_addr) {
+    radioSendData(src_addr, 0, CMD_FLASH_READBACK, PACKETSIZE,
+            (unsigned char *) sample, 0);
+    delay_ms(delaytime_ms);
+}
+
+void telemReadbackSamples(unsigned long numSamples, unsigned int src_addr) {
+    telemStruct_t sample;
+    unsigned int page, byte;
+    unsigned long i;
+
+    for (i = 0; i < numSamples; i++) {
+        telemLocate(i, &page, &byte);
+        dfmemRead(page, byte, PACKETSIZE, (unsigned char *) &sample);
+        telemSendDataDelay(&sample, READBACK_DELAY_TIME_MS, src_addr);
+    }
+}